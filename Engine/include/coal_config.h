@@ -18,9 +18,38 @@
 #define MAX_PATH_SIZE                     256
 #define MAX_NUM_APPLICATION_ICONS           8
 #define MAX_NUM_UBOS                        8
-#define FRAME_RATE_RECORD_RATE             60
+#define MAX_TRACKED_TEXTURE_UNITS          16       // Texture units whose bindings are cached
+#define STAGING_RING_SIZE          (64 << 20)       // Bytes of the persistently mapped upload ring
+#define MAX_STAGING_ALLOCATIONS          4096
+#define MAX_STAGING_FRAMES_IN_FLIGHT        3
+#define UBO_RING_SLICES (MAX_STAGING_FRAMES_IN_FLIGHT + 1)       // Persistently mapped copies of every Ubo
+#define MAX_GPU_TIMER_QUERIES               4       // Frames a gpu timer result can lag behind
+#define MAX_UPLOAD_JOBS                  2048       // Jobs waiting for the upload thread or for their fence
+#define MAX_STARTUP_ASSETS                 64       // Files prefetched or traced until the first frame
+#define STARTUP_ASSET_THREADS               4       // Threads reading and decoding the prefetched files
+#define FRAME_TIME_HISTORY                256       // Frames of the frame rate and the frame time stats
+#define FRAME_PACING_SPIN_TIME          0.002       // Seconds spun before the frame deadline instead of sleeping
+#define FRAME_PACING_MIN_SPIN          0.0002       // Range of the adaptive spin time
+#define FRAME_PACING_MAX_SPIN           0.004
+#define FRAME_PACING_SPIN_DECAY          0.05       // Part of the extra spin time dropped per frame in adaptive pacing
+#define FIXED_TIME_STEP          (1.0 / 60.0)       // Seconds simulated by every fixed update
+#define MAX_FIXED_STEPS_PER_FRAME           5       // Fixed updates run by a late frame, the time above is dropped
+
+#define SHADER_BINARY_CACHE                         // Keep linked programs on disk, keyed by their sources and the driver
+#define SHADER_CACHE_DIRECTORY     "shader_cache"
+#define TEXTURE_CACHE_DIRECTORY   "texture_cache"     // Compressed texture arrays, keyed by their source files
+
+//#define ENABLE_PROFILER                           // CPU scopes, GPU passes and job spans, compiled out when undefined
+#define PROFILE_TRACE_PATH  "profile_trace.json"    // Chrome trace written when the window closes
+#define MAX_PROFILE_EVENTS           (1 << 18)
+#define MAX_PROFILE_THREADS                64
+#define MAX_PROFILE_SCOPE_DEPTH            32
+#define MAX_PROFILE_GPU_PASSES             64       // GPU passes waiting for their query result
+#define MAX_PROFILE_SUMMARIES              16       // Names shown in the window title overlay
+#define PROFILE_OVERLAY_FRAMES             60       // Frames averaged by the overlay
 
 #define MAX_THREADS_IN_THREAD_POOL         32
+#define MAX_JOB_GRAPH_DEPENDENTS           32       // Terrain caves feed their surface and the meshing of 26 neighbours
 #define MAX_SHADER_UNIFORM_NAME_LENGTH     64
 
 #endif //COAL_CONFIG_H
@@ -2,12 +2,18 @@
 #define COAL_HELPER_H
 
 #include <stdint.h>
+#include <stddef.h>
+
+#define CM_HASH_SEED 14695981039346656037ull
 
 extern void cm_spiral_loop(unsigned int width, unsigned int height,
                            void (*func)(unsigned int x, unsigned int y));
 extern uint32_t cm_trailing_zeros(uint64_t n);
+extern uint32_t cm_leading_zeros(uint64_t n);
 extern uint32_t cm_trailing_ones(uint64_t n);
 extern uint32_t cm_pow2(uint32_t n);
 extern uint32_t cm_max(uint32_t u1, uint32_t u2);
 extern uint32_t cm_min(uint32_t u1, uint32_t u2);
+extern uint64_t cm_hash_bytes(uint64_t hash, const void* data, size_t size);   // FNV-1a, start from CM_HASH_SEED
+extern void cm_make_directory(const char* path);                              // Nothing happens if it exists
 #endif //COAL_HELPER_H
@@ -37,7 +37,8 @@ typedef enum rlPixelFormat
 	RL_PIXELFORMAT_COMPRESSED_PVRT_RGB,            // 4 bpp
 	RL_PIXELFORMAT_COMPRESSED_PVRT_RGBA,           // 4 bpp
 	RL_PIXELFORMAT_COMPRESSED_ASTC_4x4_RGBA,       // 8 bpp
-	RL_PIXELFORMAT_COMPRESSED_ASTC_8x8_RGBA        // 2 bpp
+	RL_PIXELFORMAT_COMPRESSED_ASTC_8x8_RGBA,       // 2 bpp
+	RL_PIXELFORMAT_COMPRESSED_BPTC_RGBA            // 8 bpp
 } rlPixelFormat;
 
 extern unsigned char* cm_load_file_data(const char* filePath, int* dataSize);
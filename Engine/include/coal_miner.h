@@ -28,6 +28,7 @@
 #include <cglm/quat.h>
 #include <inttypes.h>
 #include "threadpool/cm_threadpool.h"
+#include "threadpool/cm_jobgraph.h"
 #include "list/list.h"
 #include "log.h"
 
@@ -250,7 +251,8 @@ typedef enum {
 	PIXELFORMAT_COMPRESSED_PVRT_RGB,        // 4 bpp
 	PIXELFORMAT_COMPRESSED_PVRT_RGBA,       // 4 bpp
 	PIXELFORMAT_COMPRESSED_ASTC_4x4_RGBA,   // 8 bpp
-	PIXELFORMAT_COMPRESSED_ASTC_8x8_RGBA    // 2 bpp
+	PIXELFORMAT_COMPRESSED_ASTC_8x8_RGBA,   // 2 bpp
+	PIXELFORMAT_COMPRESSED_BPTC_RGBA        // 8 bpp
 } PixelFormat;
 
 // Texture parameters: filter mode
@@ -310,6 +312,7 @@ typedef struct Texture
 	int height;             // Texture base height
 	int mipmaps;            // Mipmap levels, 1 by default
 	int format;             // Data format (PixelFormat type)
+	int layers;             // Array layers, 0 for 2D textures
 } Texture;
 
 // RenderTexture, fbo for texture rendering
@@ -391,10 +394,53 @@ typedef struct Vbo
 	unsigned int id;
 	unsigned int dataSize;
 	unsigned int vertexCount;
+	unsigned int capacity;              // Allocated bytes on the GPU, only grown by cm_reserve_vbo
 	const void* data;
 	Ebo ebo;
 }Vbo;
 
+typedef struct GpuTimer
+{
+	unsigned int queries[MAX_GPU_TIMER_QUERIES];
+	unsigned int first;
+	unsigned int pending;
+	bool isRunning;
+}GpuTimer;
+
+typedef enum GlStateType
+{
+	CM_GL_STATE_PROGRAM = 0,
+	CM_GL_STATE_VERTEX_ARRAY,
+	CM_GL_STATE_TEXTURE,
+	CM_GL_STATE_BUFFER,
+	CM_GL_STATE_UBO_UPLOAD,
+	CM_GL_STATE_COUNT
+} GlStateType;
+
+// Calls of a frame that reached the driver and calls skipped because the state already matched
+typedef struct GlStateStats
+{
+	unsigned int issued[CM_GL_STATE_COUNT];
+	unsigned int skipped[CM_GL_STATE_COUNT];
+} GlStateStats;
+
+// Seconds, over the last FRAME_TIME_HISTORY frames including their wait for the deadline
+typedef struct FrameTimeStats
+{
+	double p50;
+	double p99;
+	double max;
+	unsigned int count;
+}FrameTimeStats;
+
+typedef struct StagingAllocation
+{
+	unsigned int id;
+	unsigned int offset;                // Offset inside the staging ring
+	unsigned int size;
+	void* data;                         // Mapped memory, writable from any thread
+}StagingAllocation;
+
 typedef struct Ssbo
 {
 	unsigned int id;
@@ -459,6 +505,12 @@ extern void cm_unload_images(Image* image, int size);
 extern Texture cm_load_texture(const char* filePath, TextureFlags wrap, TextureFlags filter, bool useMipMaps);
 extern void cm_unload_texture(Texture tex);
 extern Texture cm_load_texture_from_image(Image image, TextureFlags wrap, TextureFlags filter);
+extern Texture cm_load_texture_atlas_array(const char** filePaths, int atlasCount, int tileSize, TextureFlags wrap, TextureFlags filter); // A layer per tile, cached compressed with its mipmaps
+//endregion
+
+//region Startup Assets
+extern void cm_prefetch_image(const char* filePath);       // Decoded on a worker, taken by the next cm_load_image or cm_load_texture of the path
+extern void cm_prefetch_file_text(const char* filePath);   // Read on a worker, taken by the next cm_load_file_text or cm_load_shader of the path
 //endregion
 
 //region Shader
@@ -467,7 +519,7 @@ extern Shader cm_load_shader_from_memory(const char *vsCode, const char *fsCode)
 extern void cm_unload_shader(Shader shader);
 
 extern void cm_begin_shader_mode(Shader shader);
-extern void cm_end_shader_mode();
+extern void cm_end_shader_mode();   // No-op, the program stays bound for the state cache
 
 extern int cm_get_uniform_location(Shader shader, const char* name);
 
@@ -490,6 +542,7 @@ extern void cm_set_uniform_i(int id, int f);
 extern void cm_set_uniform_u(int id, unsigned int f);
 
 extern void cm_set_texture(int id, unsigned int texId, unsigned char bindingPoint);
+extern void cm_set_texture_array(int id, unsigned int texId, unsigned char bindingPoint);
 //endregion
 
 //region Camera
@@ -510,14 +563,18 @@ extern Ssbo cm_load_ssbo(unsigned int bindingId, unsigned int dataSize, const vo
 extern void cm_upload_ssbo(Ssbo ssbo, unsigned int offset, unsigned int size, const void* data);
 extern void cm_unload_ssbo(Ssbo ssbo);
 extern bool cm_load_ubo(const char* name, unsigned int bindingId, unsigned int dataSize, const void* data);
+extern void cm_mark_ubo_dirty(const void* data);   // The block registered with this data is sent on the next cm_upload_ubos
 extern void cm_upload_ubos();
 extern Vao cm_load_vao(VaoAttribute* attributes, unsigned int attributeCount, Vbo vbo);
+extern void cm_set_vao_instance_attribute(Vao vao, unsigned int location, VaoAttribute attribute, Vbo instances);  // Read once per instance, from the base instance of the draw
+extern void cm_set_vao_vbo(Vao* vao, Vbo vbo);      // The previous vbo is kept alive, the caller owns it again
 extern void cm_unload_vao(Vao vao);
 
 extern Vbo cm_load_vbo(unsigned int dataSize, unsigned int vertexCount, const void* data, Ebo ebo);
 extern void cm_unload_vbo(Vbo vbo);
 extern void cm_reupload_vbo(Vbo* vbo, unsigned int dataSize, const void* data);
 extern void cm_reupload_vbo_partial(Vbo* vbo, unsigned int dataOffset, unsigned int uploadSize);
+extern void cm_reserve_vbo(Vbo* vbo, unsigned int capacity);
 extern Ebo cm_load_ebo(unsigned int dataSize, const void* data,
 					   unsigned int type, unsigned int indexCount);
 extern void cm_unload_ebo(Ebo ebo);
@@ -525,10 +582,84 @@ extern void cm_reupload_ebo(Ebo* ebo, unsigned int dataSize, const void* data, u
 
 extern void cm_draw_vao(Vao vao, DrawType drawType);
 extern void cm_draw_instanced_vao(Vao vao, DrawType drawType, unsigned int instanceCount);
+extern void cm_draw_vao_base_instance(Vao vao, DrawType drawType, unsigned int baseInstance);  // A single instance, its attributes start at baseInstance
+
+extern bool cm_is_staging_available();
+extern uint64_t cm_get_gpu_frame();                 // Frame whose fence covers the commands issued from now on
+extern bool cm_is_gpu_frame_done(uint64_t frame);   // The GPU finished every command of that frame
+extern uint64_t cm_get_completed_gpu_frame();       // Latest frame the GPU finished
+extern bool cm_alloc_staging(unsigned int size, StagingAllocation* allocation);    // Thread safe, false when the ring is full
+extern void cm_release_staging(StagingAllocation allocation);                      // Thread safe, reused once the GPU is done with the frame
+extern void cm_copy_staging_to_buffer(StagingAllocation allocation, unsigned int srcOffset,
+                                      unsigned int bufferId, unsigned int dstOffset, unsigned int size);
+//endregion
+
+//region GL State
+extern GlStateStats cm_get_gl_state_stats();   // Last frame of the calling thread's context
+//endregion
+
+//region GPU Timers
+// NOTE: Only one timer can be running at a time, results are read without stalling a few frames later
+extern GpuTimer cm_load_gpu_timer();
+extern bool cm_begin_gpu_timer(GpuTimer* timer);                  // False when all the queries are still pending
+extern void cm_end_gpu_timer(GpuTimer* timer);
+extern bool cm_read_gpu_timer(GpuTimer* timer, double* seconds);  // Oldest finished measure, in begin order
+extern void cm_unload_gpu_timer(GpuTimer timer);
+//endregion
+
+//region Profiler
+// NOTE: Names are kept by pointer until the trace is written, use string literals. GPU passes use GL_TIME_ELAPSED
+//       queries which can not nest, they are placed on their own track at the time their commands were issued
+typedef enum ProfileCategory
+{
+	CM_PROFILE_CPU = 0,
+	CM_PROFILE_GPU,
+	CM_PROFILE_JOB,
+} ProfileCategory;
+
+#ifdef ENABLE_PROFILER
+extern void cm_begin_profile_scope(const char* name, ProfileCategory category);   // Nested per thread
+extern void cm_end_profile_scope();
+extern void cm_begin_gpu_pass(const char* name);    // Main thread only
+extern void cm_end_gpu_pass();
+extern void cm_set_profile_thread_name(const char* name);
+extern void cm_toggle_profile_overlay();            // Per frame averages in the window title
+extern bool cm_save_profile_trace(const char* filePath);
+
+#define CM_PROFILE_BEGIN(name) cm_begin_profile_scope(name, CM_PROFILE_CPU)
+#define CM_PROFILE_JOB_BEGIN(name) cm_begin_profile_scope(name, CM_PROFILE_JOB)
+#define CM_PROFILE_END() cm_end_profile_scope()
+#define CM_PROFILE_GPU_BEGIN(name) cm_begin_gpu_pass(name)
+#define CM_PROFILE_GPU_END() cm_end_gpu_pass()
+#define CM_PROFILE_THREAD(name) cm_set_profile_thread_name(name)
+#else
+#define CM_PROFILE_BEGIN(name) ((void)0)
+#define CM_PROFILE_JOB_BEGIN(name) ((void)0)
+#define CM_PROFILE_END() ((void)0)
+#define CM_PROFILE_GPU_BEGIN(name) ((void)0)
+#define CM_PROFILE_GPU_END() ((void)0)
+#define CM_PROFILE_THREAD(name) ((void)0)
+#endif
+//endregion
+
+//region Replay
+extern bool cm_is_replaying();
+extern bool cm_replay_camera(Camera3D* camera);     // Moves the camera to the recorded transform, false when not replaying
+//endregion
+
+//region Upload Thread
+// NOTE: job.job runs on a thread sharing the GL objects of the window, job.callbackJob runs on the main thread
+//       once the GPU finished the commands of the job. Vertex arrays are not shared, only fill buffers and textures
+extern bool cm_load_upload_thread();                // False when the platform can not share the context
+extern bool cm_is_upload_thread_available();
+extern bool cm_submit_upload(ThreadJob job);        // Takes ownership of job.args, false when the queue is full
+extern void cm_get_upload_timing(double* cpuTime, double* gpuTime);   // Of the job whose callback is running, 0 outside of it
+extern void cm_unload_upload_thread();              // Runs the submitted jobs, their callbacks are not called
 //endregion
 
 //region Drawing
 extern Vao cm_get_unit_quad();
+extern double cm_get_present_time();   // cm_get_time when the last frame was swapped, before its pacing wait
 //endregion
 
 //region Input Functions
@@ -584,8 +715,17 @@ extern int cm_get_touch_point_count(void);                       // Get number o
 
 extern ThreadPool* cm_create_thread_pool(unsigned int numThreads, uint32_t initialCapacity);
 extern void cm_submit_job(ThreadPool* pool, ThreadJob job, bool asLast);
+extern void cm_wait_thread_pool(ThreadPool* pool);   // Blocks until no job is queued or running, callbacks wait for the drain
+extern uint32_t cm_drain_thread_pool(ThreadPool* pool);   // One thread only, runs the callbacks of the finished jobs, returns their count
 extern void cm_destroy_thread_pool(ThreadPool* pool);
 
+extern JobGraph* cm_create_job_graph(ThreadPool* pool, uint32_t nodeCount);
+extern bool cm_set_job_graph_node(JobGraph* graph, uint32_t node, ThreadJob job, bool asLast);   // Takes ownership of job.args
+extern void cm_add_job_graph_dependency(JobGraph* graph, uint32_t node, uint32_t dependency);
+extern void cm_commit_job_graph_node(JobGraph* graph, uint32_t node);
+extern bool cm_is_job_graph_idle(JobGraph* graph);   // Every node ran and its pool was drained since
+extern void cm_destroy_job_graph(JobGraph* graph);   // Destroy the pool first
+
 //endregion
 
 //region Time
@@ -594,10 +734,17 @@ extern void cm_sleep(double sleepTime);
 extern float cm_delta_time_f();
 extern double cm_delta_time();
 extern double cm_time_since_start();
+extern float cm_fixed_delta_time_f();                            // FIXED_TIME_STEP, the delta of every fixed update
+extern double cm_fixed_delta_time();
+extern float cm_interpolation_alpha();                           // Part of a fixed step between the last two simulated states
+extern unsigned long cm_fixed_step_count();
 extern unsigned int cm_get_target_frame_rate();
-extern void cm_set_target_frame_rate(unsigned int t);
-extern unsigned int cm_frame_rate();
-extern double cm_frame_time();
+extern void cm_set_target_frame_rate(unsigned int t);            // 0 for no limit
+extern void cm_set_adaptive_frame_pacing(bool isAdaptive);       // Adapts the spin before the deadline to the late wake ups
+extern unsigned int cm_frame_rate();                             // Average of the last FRAME_TIME_HISTORY frames
+extern double cm_frame_time();                                   // Last frame without its wait for the deadline
+extern FrameTimeStats cm_get_frame_time_stats();
+extern double cm_get_time();    // Precise monotonic time in seconds, can be called from any thread and without a window
 
 //endregion
 
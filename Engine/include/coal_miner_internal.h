@@ -39,6 +39,15 @@ typedef struct EngineData
 	void (*updateCallback)();
 	void (*renderCallback)();
 
+	// Optional, runs every FIXED_TIME_STEP on a worker while the main thread renders and swaps.
+	// It must not call GL and the render state it produces is published by updateCallback.
+	void (*fixedUpdateCallback)();
+
+	// Optional, frames after the loading are recorded to or replayed from a file, the timings are written as CSV
+	const char* recordPath;
+	const char* replayPath;
+	const char* timingsPath;
+
 	void (*appCloseCallback)();
 
 }EngineData;
@@ -1190,6 +1190,33 @@ void swap_screen_buffer(void)
 	glfwSwapBuffers(WINDOW_ptr->platformHandle);
 }
 
+// Get an OpenGL function which is not part of the loaded glad profile
+void* get_proc_address(const char* name)
+{
+	return (void*)glfwGetProcAddress(name);
+}
+
+// Create a hidden context sharing the objects of the window context, must be called from the main thread
+void* create_shared_context(void)
+{
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	GLFWwindow* context = glfwCreateWindow(1, 1, "", NULL, WINDOW_ptr->platformHandle);
+	if(context == NULL) log_warn("%s", "GLFW: Failed to create a shared context");
+	return context;
+}
+
+// Make the context current on the calling thread, NULL releases the current one
+void make_context_current(void* context)
+{
+	glfwMakeContextCurrent(context);
+}
+
+// The context must not be current on any thread
+void destroy_shared_context(void* context)
+{
+	glfwDestroyWindow(context);
+}
+
 // Get elapsed time measure in seconds since InitTimer()
 double get_time(void)
 {
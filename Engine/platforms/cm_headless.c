@@ -0,0 +1,283 @@
+#include "coal_miner_internal.h"
+#include "cmplatform.h"
+#include <glad/glad.h>
+
+// No window and no GL context, the frames run at the speed of the simulation and of the CPU side of the renderer.
+// Every GL call goes to a stub: ids are counted, queries and fences are always finished, shaders always compile
+// and buffer mappings return CPU memory, so the staging ring and the terrain streaming still do their copies.
+// NOTE: GL is only called from the main thread, no shared context can be created
+
+#define HEADLESS_GL_VERSION "4.4.0 Headless"   // Buffer storage is core, the staging ring is used
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+
+Window* WINDOW_ptr;
+Input* INPUT_ptr;
+
+static double startTime;
+static GLuint nextGlId = 1;
+static void** persistentMaps;
+static uint32_t persistentMapCount;
+static void* mapScratch;
+static GLsizeiptr mapScratchSize;
+
+static void* GetHeadlessGlProc(const char* name);
+
+bool init_platform(Window* window, Input* input)
+{
+	WINDOW_ptr = window;
+	INPUT_ptr = input;
+	startTime = cm_get_time();
+
+	if (window->screen.width == 0) window->screen.width = window->display.width;
+	if (window->screen.height == 0) window->screen.height = window->display.height;
+	window->render = window->screen;
+	window->currentFbo = window->screen;
+	window->platformHandle = NULL;
+	window->ready = true;
+
+	if(!gladLoadGLLoader((GLADloadproc)GetHeadlessGlProc))
+	{
+		log_error("Unable to load glad!!!");
+		return false;
+	}
+
+	log_info("Headless platform, %ix%i without a window", window->screen.width, window->screen.height);
+	return true;
+}
+
+void terminate_platform()
+{
+	for (uint32_t i = 0; i < persistentMapCount; ++i) CM_FREE(persistentMaps[i]);
+	CM_FREE(persistentMaps);
+	persistentMaps = NULL;
+	persistentMapCount = 0;
+
+	CM_FREE(mapScratch);
+	mapScratch = NULL;
+	mapScratchSize = 0;
+}
+
+void setup_viewport(int width, int height)
+{
+	WINDOW_ptr->render.width = width;
+	WINDOW_ptr->render.height = height;
+}
+
+//region Window
+
+void toggle_fullscreen(void) { }
+void toggle_borderless_windowed(void) { }
+void maximize_window(void) { }
+void minimize_window(void) { }
+void restore_window(void) { }
+void set_window_state(unsigned int flags) { WINDOW_ptr->flags |= flags; }
+void clear_window_state(unsigned int flags) { WINDOW_ptr->flags &= ~flags; }
+
+void set_window_title(const char *title) { WINDOW_ptr->title = title; }
+void set_window_position(int x, int y) { WINDOW_ptr->position = (Point){ x, y }; }
+void set_window_monitor(int monitor) { }
+void set_window_min_size(int width, int height) { WINDOW_ptr->screenMin = (Size){ width, height }; }
+void set_window_max_size(int width, int height) { WINDOW_ptr->screenMax = (Size){ width, height }; }
+void set_window_size(int width, int height) { WINDOW_ptr->screen = (Size){ width, height }; }
+void set_window_opacity(float opacity) { }
+void set_window_focused(void) { }
+
+void set_window_icon(Image image) { }
+void set_window_icons(Image* images, int count) { }
+
+void *get_window_handle(void) { return NULL; }
+void get_window_position(float* dest) { glm_vec2((vec2){ (float)WINDOW_ptr->position.x, (float)WINDOW_ptr->position.y }, dest); }
+void get_window_scale_dpi(float* dest) { glm_vec2_one(dest); }
+void set_clipboard_text(const char *text) { }
+const char *get_clipboard_text(void) { return NULL; }
+void show_cursor(void) { INPUT_ptr->Mouse.cursorHidden = false; }
+void hide_cursor(void) { INPUT_ptr->Mouse.cursorHidden = true; }
+void enable_cursor(void) { INPUT_ptr->Mouse.cursorHidden = false; }
+void disable_cursor(void) { INPUT_ptr->Mouse.cursorHidden = true; }
+void swap_screen_buffer(void) { }
+
+void* get_proc_address(const char* name) { return GetHeadlessGlProc(name); }
+void* create_shared_context(void) { return NULL; }
+void make_context_current(void* context) { }
+void destroy_shared_context(void* context) { }
+
+double get_time(void) { return cm_get_time() - startTime; }
+
+int set_gamepad_mappings(const char *mappings) { return 0; }
+
+void set_mouse_position(int x, int y)
+{
+	glm_vec2((vec2){(float)x, (float)y }, INPUT_ptr->Mouse.currentPosition);
+	glm_vec2(INPUT_ptr->Mouse.currentPosition, INPUT_ptr->Mouse.previousPosition);
+}
+
+void set_mouse_cursor(int cursor) { INPUT_ptr->Mouse.cursor = cursor; }
+
+// There are no events, the states only move to the previous frame so a replay can apply its own
+void poll_input_events(void)
+{
+	INPUT_ptr->Keyboard.keyPressedQueueCount = 0;
+	INPUT_ptr->Keyboard.charPressedQueueCount = 0;
+	INPUT_ptr->Gamepad.lastButtonPressed = 0;
+
+	memcpy(INPUT_ptr->Keyboard.previousKeyState, INPUT_ptr->Keyboard.currentKeyState, MAX_KEYBOARD_KEYS);
+	memset(INPUT_ptr->Keyboard.keyRepeatInFrame, 0, MAX_KEYBOARD_KEYS);
+	memcpy(INPUT_ptr->Mouse.previousButtonState, INPUT_ptr->Mouse.currentButtonState, MAX_MOUSE_BUTTONS);
+	memcpy(INPUT_ptr->Touch.previousTouchState, INPUT_ptr->Touch.currentTouchState, MAX_TOUCH_POINTS);
+
+	glm_vec2(INPUT_ptr->Mouse.currentWheelMove, INPUT_ptr->Mouse.previousWheelMove);
+	glm_vec2((vec2){ 0.0f, 0.0f }, INPUT_ptr->Mouse.currentWheelMove);
+	glm_vec2(INPUT_ptr->Mouse.currentPosition, INPUT_ptr->Mouse.previousPosition);
+}
+
+//endregion
+
+//region Monitor
+
+int get_monitor_count(void) { return 1; }
+int get_current_monitor(void) { return 0; }
+void get_monitor_position(int monitor, float* dest) { glm_vec2((vec2){ 0.0f, 0.0f }, dest); }
+int get_monitor_width(int monitor) { return (int)WINDOW_ptr->display.width; }
+int get_monitor_height(int monitor) { return (int)WINDOW_ptr->display.height; }
+int get_monitor_physical_width(int monitor) { return 0; }
+int get_monitor_physical_height(int monitor) { return 0; }
+int get_monitor_refresh_rate(int monitor) { return 0; }
+const char *get_monitor_name(int monitor) { return "Headless"; }
+
+//endregion
+
+//region Local Functions
+
+// NOTE: Loaded for every function without a stub, the engine never reads the result of those
+static void APIENTRY HeadlessNoop(void) { }
+
+static const GLubyte* APIENTRY HeadlessGetString(GLenum name)
+{
+	return (const GLubyte*)(name == GL_VERSION ? HEADLESS_GL_VERSION : "Headless");
+}
+
+// NOTE: glad fails to load without any extension
+static const GLubyte* APIENTRY HeadlessGetStringi(GLenum name, GLuint index) { return (const GLubyte*)"GL_ARB_buffer_storage"; }
+static GLenum APIENTRY HeadlessGetError(void) { return GL_NO_ERROR; }
+
+static void APIENTRY HeadlessGetIntegerv(GLenum pname, GLint* data)
+{
+	switch (pname)
+	{
+		case GL_NUM_EXTENSIONS: *data = 1; break;
+		case GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT: *data = 256; break;
+		default: *data = 0; break;
+	}
+}
+
+static void APIENTRY HeadlessGetFloatv(GLenum pname, GLfloat* data) { *data = pname == GL_LINE_WIDTH ? 1.0f : 0.0f; }
+static void APIENTRY HeadlessGetTexLevelParameteriv(GLenum target, GLint level, GLenum pname, GLint* params) { *params = 0; }
+
+static void APIENTRY HeadlessGenIds(GLsizei n, GLuint* ids)
+{
+	for (GLsizei i = 0; i < n; ++i) ids[i] = nextGlId++;
+}
+
+static GLuint APIENTRY HeadlessCreateShader(GLenum type) { return nextGlId++; }
+static GLuint APIENTRY HeadlessCreateProgram(void) { return nextGlId++; }
+static GLint APIENTRY HeadlessGetUniformLocation(GLuint program, const GLchar* name) { return (GLint)nextGlId++; }
+static GLuint APIENTRY HeadlessGetUniformBlockIndex(GLuint program, const GLchar* name) { return 0; }
+
+static void APIENTRY HeadlessGetObjectiv(GLuint object, GLenum pname, GLint* params)
+{
+	*params = (pname == GL_COMPILE_STATUS || pname == GL_LINK_STATUS) ? GL_TRUE : 0;
+}
+
+static void APIENTRY HeadlessGetInfoLog(GLuint object, GLsizei bufSize, GLsizei* length, GLchar* infoLog)
+{
+	if (length != NULL) *length = 0;
+	if (bufSize > 0) infoLog[0] = '\0';
+}
+
+static void APIENTRY HeadlessGetProgramBinary(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary)
+{
+	if (length != NULL) *length = 0;
+}
+
+static void APIENTRY HeadlessGetQueryObjectiv(GLuint id, GLenum pname, GLint* params) { *params = pname == GL_QUERY_RESULT_AVAILABLE ? GL_TRUE : 0; }
+static void APIENTRY HeadlessGetQueryObjectui64v(GLuint id, GLenum pname, GLuint64* params) { *params = 0; }
+
+static GLsync APIENTRY HeadlessFenceSync(GLenum condition, GLbitfield flags) { return (GLsync)(uintptr_t)1; }
+static GLenum APIENTRY HeadlessClientWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout) { return GL_ALREADY_SIGNALED; }
+
+// Persistent mappings live until the platform terminates, the others share a scratch buffer that is never read
+static void* APIENTRY HeadlessMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access)
+{
+	if (access & GL_MAP_PERSISTENT_BIT)
+	{
+		void** maps = CM_REALLOC(persistentMaps, (persistentMapCount + 1) * sizeof(void*));
+		if (maps == NULL) return NULL;
+		persistentMaps = maps;
+
+		void* map = CM_MALLOC(length);
+		if (map != NULL) persistentMaps[persistentMapCount++] = map;
+		return map;
+	}
+
+	if (length > mapScratchSize)
+	{
+		void* scratch = CM_REALLOC(mapScratch, length);
+		if (scratch == NULL) return NULL;
+		mapScratch = scratch;
+		mapScratchSize = length;
+	}
+
+	return mapScratch;
+}
+
+static GLboolean APIENTRY HeadlessUnmapBuffer(GLenum target) { return GL_TRUE; }
+
+typedef struct
+{
+	const char* name;
+	void* proc;
+}HeadlessGlProc;
+
+static const HeadlessGlProc headlessGlProcs[] =
+{
+	{ "glGetString", (void*)HeadlessGetString },
+	{ "glGetStringi", (void*)HeadlessGetStringi },
+	{ "glGetError", (void*)HeadlessGetError },
+	{ "glGetIntegerv", (void*)HeadlessGetIntegerv },
+	{ "glGetFloatv", (void*)HeadlessGetFloatv },
+	{ "glGetTexLevelParameteriv", (void*)HeadlessGetTexLevelParameteriv },
+	{ "glGenBuffers", (void*)HeadlessGenIds },
+	{ "glGenTextures", (void*)HeadlessGenIds },
+	{ "glGenVertexArrays", (void*)HeadlessGenIds },
+	{ "glGenQueries", (void*)HeadlessGenIds },
+	{ "glGenFramebuffers", (void*)HeadlessGenIds },
+	{ "glGenRenderbuffers", (void*)HeadlessGenIds },
+	{ "glCreateShader", (void*)HeadlessCreateShader },
+	{ "glCreateProgram", (void*)HeadlessCreateProgram },
+	{ "glGetUniformLocation", (void*)HeadlessGetUniformLocation },
+	{ "glGetUniformBlockIndex", (void*)HeadlessGetUniformBlockIndex },
+	{ "glGetShaderiv", (void*)HeadlessGetObjectiv },
+	{ "glGetProgramiv", (void*)HeadlessGetObjectiv },
+	{ "glGetShaderInfoLog", (void*)HeadlessGetInfoLog },
+	{ "glGetProgramInfoLog", (void*)HeadlessGetInfoLog },
+	{ "glGetProgramBinary", (void*)HeadlessGetProgramBinary },
+	{ "glGetQueryObjectiv", (void*)HeadlessGetQueryObjectiv },
+	{ "glGetQueryObjectui64v", (void*)HeadlessGetQueryObjectui64v },
+	{ "glFenceSync", (void*)HeadlessFenceSync },
+	{ "glClientWaitSync", (void*)HeadlessClientWaitSync },
+	{ "glMapBufferRange", (void*)HeadlessMapBufferRange },
+	{ "glUnmapBuffer", (void*)HeadlessUnmapBuffer },
+};
+
+static void* GetHeadlessGlProc(const char* name)
+{
+	for (uint32_t i = 0; i < sizeof(headlessGlProcs) / sizeof(headlessGlProcs[0]); ++i)
+		if (strcmp(headlessGlProcs[i].name, name) == 0) return headlessGlProcs[i].proc;
+
+	return (void*)HeadlessNoop;
+}
+
+//endregion
@@ -0,0 +1,243 @@
+#include "cmassets.h"
+#include "cmplatform.h"
+#include "coal_image.h"
+
+typedef enum
+{
+	STARTUP_IMAGE,
+	STARTUP_TEXT,
+}StartupAssetType;
+
+typedef struct
+{
+	Path path;
+	StartupAssetType type;
+	bool isPrefetched;
+	bool isReady;
+	bool isTaken;
+	Image image;
+	char* text;
+	double readTime;      //seconds reading the file
+	double decodeTime;    //seconds decoding the image
+	double waitTime;      //seconds the main thread waited for it
+	double createTime;    //seconds creating GL objects from it
+	double savedTime;     //seconds a cache saved on the creation
+}StartupAsset;
+
+typedef struct
+{
+	ThreadPool* pool;
+	pthread_mutex_t lock;
+	pthread_cond_t ready;
+	StartupAsset assets[MAX_STARTUP_ASSETS];
+	uint32_t assetCount;
+	uint32_t prefetchCount;
+	double windowTime;    //platform clock once the window is loaded, counted from the platform initialization
+	double startTime;
+	double lastReadyTime;
+	bool isActive;
+}StartupAssets;
+
+StartupAssets CM_STARTUP_ASSETS = { 0 };
+
+static void Prefetch(const char* filePath, StartupAssetType type);
+static StartupAsset* FindAsset(const char* filePath, StartupAssetType type);
+static StartupAsset* WaitAsset(const char* filePath, StartupAssetType type);
+static void T_LoadStartupAsset(uint32_t threadId, void* args);
+
+void load_startup_assets()
+{
+	StartupAssets* assets = &CM_STARTUP_ASSETS;
+
+	pthread_mutex_init(&assets->lock, NULL);
+	pthread_cond_init(&assets->ready, NULL);
+	assets->pool = cm_create_thread_pool(STARTUP_ASSET_THREADS, MAX_STARTUP_ASSETS);
+	assets->assetCount = 0;
+	assets->prefetchCount = 0;
+	assets->windowTime = get_time();
+	assets->startTime = cm_get_time();
+	assets->lastReadyTime = assets->startTime;
+	assets->isActive = true;
+}
+
+void finish_startup_assets()
+{
+	StartupAssets* assets = &CM_STARTUP_ASSETS;
+	if(!assets->isActive) return;
+
+	cm_wait_thread_pool(assets->pool);
+	cm_destroy_thread_pool(assets->pool);
+	assets->pool = NULL;
+	assets->isActive = false;
+
+	double endTime = cm_get_time();
+	double workTime = 0, savedTime = 0;
+	for (uint32_t i = 0; i < assets->assetCount; ++i)
+	{
+		if(assets->assets[i].isPrefetched) workTime += assets->assets[i].readTime + assets->assets[i].decodeTime;
+		savedTime += assets->assets[i].savedTime;
+	}
+
+	log_info("Startup: window after %.1f ms, awake done %.1f ms later\n", assets->windowTime * 1000.0,
+	         (endTime - assets->startTime) * 1000.0);
+	log_info("Startup: %u prefetched assets ready %.1f ms after the window, %.1f ms of work on %u threads\n",
+	         assets->prefetchCount, (assets->lastReadyTime - assets->startTime) * 1000.0, workTime * 1000.0, STARTUP_ASSET_THREADS);
+	log_info("Startup: %.1f ms saved by cached GL objects\n", savedTime * 1000.0);
+
+	for (uint32_t i = 0; i < assets->assetCount; ++i)
+	{
+		StartupAsset* asset = &assets->assets[i];
+		const char* source = !asset->isPrefetched ? "main thread" : asset->isTaken ? "prefetched" : "unused";
+
+		log_info("  %s: read %.2f, decode %.2f, wait %.2f, create %.2f, saved %.2f ms (%s)\n", asset->path,
+		         asset->readTime * 1000.0, asset->decodeTime * 1000.0, asset->waitTime * 1000.0,
+		         asset->createTime * 1000.0, asset->savedTime * 1000.0, source);
+
+		if(asset->isTaken) continue;
+		cm_unload_image(asset->image);
+		cm_unload_file_text(asset->text);
+	}
+
+	pthread_mutex_destroy(&assets->lock);
+	pthread_cond_destroy(&assets->ready);
+}
+
+void cm_prefetch_image(const char* filePath) { Prefetch(filePath, STARTUP_IMAGE); }
+void cm_prefetch_file_text(const char* filePath) { Prefetch(filePath, STARTUP_TEXT); }
+
+bool take_startup_image(const char* filePath, Image* image)
+{
+	StartupAsset* asset = WaitAsset(filePath, STARTUP_IMAGE);
+	if(asset == NULL) return false;
+
+	*image = asset->image;
+	return true;
+}
+
+bool take_startup_text(const char* filePath, char** text)
+{
+	StartupAsset* asset = WaitAsset(filePath, STARTUP_TEXT);
+	if(asset == NULL) return false;
+
+	*text = asset->text;
+	return true;
+}
+
+void trace_startup_load(const char* filePath, double seconds)
+{
+	StartupAssets* assets = &CM_STARTUP_ASSETS;
+	if(!assets->isActive || assets->assetCount >= MAX_STARTUP_ASSETS) return;
+
+	StartupAsset* asset = &assets->assets[assets->assetCount++];
+	*asset = (StartupAsset){ .isReady = true, .isTaken = true, .readTime = seconds };
+	snprintf(asset->path, MAX_PATH_SIZE, "%s", filePath);
+}
+
+void trace_startup_creation(const char* filePath, double seconds, double savedSeconds)
+{
+	StartupAssets* assets = &CM_STARTUP_ASSETS;
+	if(!assets->isActive) return;
+
+	for (uint32_t i = assets->assetCount; i > 0; --i)
+	{
+		if(strcmp(assets->assets[i - 1].path, filePath) != 0) continue;
+		assets->assets[i - 1].createTime += seconds;
+		assets->assets[i - 1].savedTime += savedSeconds;
+		return;
+	}
+}
+
+//Main thread only, the workers only touch the asset they were given
+static void Prefetch(const char* filePath, StartupAssetType type)
+{
+	StartupAssets* assets = &CM_STARTUP_ASSETS;
+	if(!assets->isActive || FindAsset(filePath, type) != NULL) return;
+
+	if(assets->assetCount >= MAX_STARTUP_ASSETS)
+	{
+		log_warn("Startup assets are full (%u), %s is loaded on the main thread\n", MAX_STARTUP_ASSETS, filePath);
+		return;
+	}
+
+	uint32_t* args = CM_MALLOC(sizeof(uint32_t));
+	*args = assets->assetCount;
+
+	StartupAsset* asset = &assets->assets[assets->assetCount++];
+	*asset = (StartupAsset){ .type = type, .isPrefetched = true };
+	snprintf(asset->path, MAX_PATH_SIZE, "%s", filePath);
+	assets->prefetchCount++;
+
+	ThreadJob job = { .args = args, .job = T_LoadStartupAsset };
+	cm_submit_job(assets->pool, job, false);
+}
+
+static StartupAsset* FindAsset(const char* filePath, StartupAssetType type)
+{
+	StartupAssets* assets = &CM_STARTUP_ASSETS;
+	for (uint32_t i = 0; i < assets->assetCount; ++i)
+	{
+		StartupAsset* asset = &assets->assets[i];
+		if(asset->isPrefetched && !asset->isTaken && asset->type == type && strcmp(asset->path, filePath) == 0)
+			return asset;
+	}
+
+	return NULL;
+}
+
+static StartupAsset* WaitAsset(const char* filePath, StartupAssetType type)
+{
+	StartupAssets* assets = &CM_STARTUP_ASSETS;
+	if(!assets->isActive) return NULL;
+
+	StartupAsset* asset = FindAsset(filePath, type);
+	if(asset == NULL) return NULL;
+
+	double startTime = cm_get_time();
+	pthread_mutex_lock(&assets->lock);
+	while(!asset->isReady) pthread_cond_wait(&assets->ready, &assets->lock);
+	pthread_mutex_unlock(&assets->lock);
+
+	asset->waitTime = cm_get_time() - startTime;
+	asset->isTaken = true;
+	return asset;
+}
+
+static void T_LoadStartupAsset(uint32_t threadId, void* args)
+{
+	StartupAssets* assets = &CM_STARTUP_ASSETS;
+	StartupAsset* asset = &assets->assets[*(uint32_t*)args];
+	Image image = { 0 };
+	char* text = NULL;
+
+	double startTime = cm_get_time();
+	double readTime, decodeTime = 0;
+
+	if(asset->type == STARTUP_IMAGE)
+	{
+		int dataSize = 0;
+		unsigned char* fileData = cm_load_file_data(asset->path, &dataSize);
+		readTime = cm_get_time() - startTime;
+
+		if(fileData != NULL) image = cm_load_image_from_memory(cm_get_file_extension(asset->path), fileData, dataSize);
+		CM_FREE(fileData);
+		decodeTime = cm_get_time() - startTime - readTime;
+	}
+	else
+	{
+		text = read_file_text(asset->path);
+		readTime = cm_get_time() - startTime;
+	}
+
+	pthread_mutex_lock(&assets->lock);
+
+	asset->image = image;
+	asset->text = text;
+	asset->readTime = readTime;
+	asset->decodeTime = decodeTime;
+	asset->isReady = true;
+	double readyTime = cm_get_time();
+	if(readyTime > assets->lastReadyTime) assets->lastReadyTime = readyTime;
+	pthread_cond_broadcast(&assets->ready);
+
+	pthread_mutex_unlock(&assets->lock);
+}
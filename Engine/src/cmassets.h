@@ -0,0 +1,19 @@
+#ifndef CMASSETS_H
+#define CMASSETS_H
+
+#include <stdbool.h>
+#include "coal_miner.h"
+
+//Files prefetched during startup are read and decoded on a thread pool, the main thread takes them
+//when it loads the same path and keeps creating the GL objects. Every startup load is traced.
+void load_startup_assets();
+void finish_startup_assets();   // Logs the trace, unused prefetches are dropped
+
+bool take_startup_image(const char* filePath, Image* image);
+bool take_startup_text(const char* filePath, char** text);
+void trace_startup_load(const char* filePath, double seconds);     // File loaded on the main thread
+void trace_startup_creation(const char* filePath, double seconds, double savedSeconds); // GL objects created from it
+
+char* read_file_text(const char* filePath);   // cm_load_file_text without the startup assets
+
+#endif //CMASSETS_H
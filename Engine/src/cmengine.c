@@ -1,5 +1,8 @@
 #include "coal_miner_internal.h"
 #include "cmwindow.h"
+#include "cmassets.h"
+#include "cmtime.h"
+#include "cmreplay.h"
 
 EngineData CM_DEFAULT_ENGINE_DATA =
 {
@@ -10,24 +13,114 @@ EngineData CM_DEFAULT_ENGINE_DATA =
 	NULL,
 };
 
+typedef struct
+{
+	void (*fixedUpdateCallback)();
+	uint32_t steps;
+}Simulation;
+
+static Simulation simulation;
+
+static void RunLoop(EngineData* data);
+static void RunOverlappedLoop(EngineData* data);
+static void T_Simulate(uint32_t threadId, void* args);
+
 void coal_run(EngineData data)
 {
 	set_window_flags(data.configFlags);
 	create_window(data.windowWidth, data.windowHeight, data.title, data.iconLocation);
 
+	CM_PROFILE_BEGIN("Awake");
 	data.awakeCallback();
+	finish_startup_assets();
+	CM_PROFILE_END();
+
+	if(data.fixedUpdateCallback != NULL) RunOverlappedLoop(&data);
+	else RunLoop(&data);
+
+	data.appCloseCallback();
+	close_window();
+}
+
+static void RunLoop(EngineData* data)
+{
 	bool isLoading = true;
 
 	while (!window_should_close())
 	{
-		if(isLoading) isLoading = data.loadingCallback();
-		if(!isLoading) data.updateCallback();
+		CM_PROFILE_BEGIN("Update");
+		if(isLoading)
+		{
+			isLoading = data->loadingCallback();
+			if(!isLoading) begin_replay(data->recordPath, data->replayPath, data->timingsPath);
+		}
+		if(!isLoading) data->updateCallback();
+		CM_PROFILE_END();
 
+		CM_PROFILE_BEGIN("Render");
 		begin_draw();
-		if(!isLoading) data.renderCallback();
-		end_draw();
+		if(!isLoading) data->renderCallback();
+		CM_PROFILE_END();
+
+		// The profiler closes the frame scope in finish_frame, it stays out of any scope
+		CM_PROFILE_BEGIN("End Draw");
+		present_draw();
+		CM_PROFILE_END();
+
+		finish_frame();
 	}
+}
 
-	data.appCloseCallback();
-	close_window();
+// The fixed updates due this frame run on a worker while the main thread submits and swaps the frame.
+// The update callback runs between two batches and publishes the last simulated state, with
+// cm_interpolation_alpha between it and the state before, so what is drawn lags the simulation by a frame.
+// The inputs are polled only while no batch runs. Only the fixed updates are overlapped, the update callback
+// and whatever it schedules still run on the main thread before the render.
+static void RunOverlappedLoop(EngineData* data)
+{
+	ThreadPool* pool = cm_create_thread_pool(1, 1);
+	simulation.fixedUpdateCallback = data->fixedUpdateCallback;
+	bool isLoading = true;
+
+	while (!window_should_close())
+	{
+		CM_PROFILE_BEGIN("Update");
+		if(isLoading)
+		{
+			isLoading = data->loadingCallback();
+			if(!isLoading) begin_replay(data->recordPath, data->replayPath, data->timingsPath);
+		}
+		if(!isLoading)
+		{
+			data->updateCallback();
+
+			simulation.steps = consume_fixed_steps();
+			if(simulation.steps > 0)
+				cm_submit_job(pool, (ThreadJob){ .job = T_Simulate, .name = "Simulation" }, true);
+		}
+		CM_PROFILE_END();
+
+		CM_PROFILE_BEGIN("Render");
+		begin_draw();
+		if(!isLoading) data->renderCallback();
+		CM_PROFILE_END();
+
+		CM_PROFILE_BEGIN("End Draw");
+		present_draw();
+		CM_PROFILE_END();
+
+		CM_PROFILE_BEGIN("Wait Simulation");
+		cm_wait_thread_pool(pool);
+		CM_PROFILE_END();
+
+		finish_frame();
+	}
+
+	cm_destroy_thread_pool(pool);
+}
+
+static void T_Simulate(uint32_t threadId, void* args)
+{
+	for (uint32_t i = 0; i < simulation.steps; ++i)
+		simulation.fixedUpdateCallback();
 }
\ No newline at end of file
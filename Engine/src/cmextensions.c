@@ -1,4 +1,5 @@
 #include "coal_miner.h"
+#include "cmassets.h"
 
 void cm_print_mat4(vec4* mat)
 {
@@ -46,6 +47,17 @@ const char *cm_get_file_extension(const char *filePath)
 }
 
 char *cm_load_file_text(const char *filePath)
+{
+	char *text = NULL;
+	if (take_startup_text(filePath, &text)) return text;
+
+	double startTime = cm_get_time();
+	text = read_file_text(filePath);
+	trace_startup_load(filePath, cm_get_time() - startTime);
+	return text;
+}
+
+char *read_file_text(const char *filePath)
 {
 	char *text = NULL;
 
@@ -1,6 +1,17 @@
 #include "cmgl.h"
+#include <time.h>
 #include <glad/glad.h>
 #include "coal_image.h"
+#include "coal_helper.h"
+#include "cmplatform.h"
+#include "cmassets.h"
+
+// NOTE: Buffer storage is core since 4.4, the loaded glad profile stops at 4.3
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+typedef void (APIENTRYP PFNGLBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
 
 #define CHECK_GL_ERROR(...)                                     \
     {                                                           \
@@ -21,12 +32,126 @@ typedef struct Ubo
 	uint32_t bindingId;
 	uint32_t dataSize;
 	const void* data;
+	bool isDirty;           // Set by cm_mark_ubo_dirty, the block is sent on the next cm_upload_ubos
+	uint8_t* mapped;        // Persistently mapped slices, NULL when the block is updated with glBufferSubData
+	uint32_t sliceSize;     // Data size rounded up to the uniform buffer offset alignment
+	uint32_t slice;         // Slice bound to the binding point
 } Ubo;
 
 Ubo CM_UBOS[MAX_NUM_UBOS];
 uint32_t cmUboCount;
 
+typedef struct StagingRecord
+{
+	uint32_t start;             // Ring position before any wrap padding
+	uint32_t length;            // Size plus wrap padding
+	bool isReleased;
+	uint64_t frame;             // Frame whose fence covers the copies issued before the release
+} StagingRecord;
+
+typedef struct StagingRing
+{
+	bool isReady;
+	uint32_t id;
+	uint8_t* mapped;
+
+	uint32_t head;
+	uint32_t tail;
+	uint32_t used;
+
+	StagingRecord records[MAX_STAGING_ALLOCATIONS];
+	uint32_t firstRecord;
+	uint32_t recordCount;
+
+	GLsync fences[MAX_STAGING_FRAMES_IN_FLIGHT];
+	uint64_t fenceFrames[MAX_STAGING_FRAMES_IN_FLIGHT];
+	uint64_t frame;
+	uint64_t completedFrame;
+
+	pthread_mutex_t lock;
+} StagingRing;
+
+StagingRing CM_STAGING_RING;
+static PFNGLBUFFERSTORAGEPROC cmBufferStorage;    // NULL when buffer storage is not supported
+
+typedef struct UploadEntry
+{
+	ThreadJob job;
+	GLsync fence;               // Set by the upload thread once the job commands are flushed
+	double cpuTime;             // Spent running the job
+	double gpuTime;             // Read by the upload thread, the queries belong to its context
+} UploadEntry;
+
+// Jobs are run and completed in submission order: [first, ran) wait for their fence, [ran, first + count) for the thread
+// and the first timedCount of the ran ones have their GPU time
+typedef struct UploadThread
+{
+	bool isReady;
+	volatile bool isAlive;
+	void* context;
+	pthread_t thread;
+
+	UploadEntry entries[MAX_UPLOAD_JOBS];
+	uint32_t queries[MAX_UPLOAD_JOBS];
+	uint32_t first;
+	uint32_t ranCount;
+	uint32_t timedCount;
+	uint32_t count;
+	UploadEntry* completing;    // Entry whose callback is running
+
+	pthread_mutex_t lock;
+	pthread_cond_t signal;
+} UploadThread;
+
+UploadThread CM_UPLOAD_THREAD;
+
+//Written before the program binary in the cache files
+typedef struct ProgramCacheHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint64_t key;
+	uint32_t format;
+	uint32_t length;
+	double compileTime;     // Seconds the program took to compile and link
+} ProgramCacheHeader;
+
+#define GL_STATE_BUFFER_TARGETS 5
+
+//Bindings of the context current on this thread, only tracked on the window context: a shared context
+//does not see the objects another one deletes and could skip binding a recycled name
+typedef struct GlState
+{
+	bool isTracked;
+	uint32_t program;
+	uint32_t vertexArray;
+	uint32_t activeTexture;
+	uint32_t textures[MAX_TRACKED_TEXTURE_UNITS][2];   // 2D and 2D array
+	uint32_t buffers[GL_STATE_BUFFER_TARGETS];
+	GlStateStats frame;
+	GlStateStats lastFrame;
+} GlState;
+
+static _Thread_local GlState CM_GL_STATE;
+
+#define PROGRAM_CACHE_MAGIC "CMPB"
+#define PROGRAM_CACHE_VERSION 1
+
 static int GetPixelDataSize(int width, int height, int format);
+static bool SkipState(GlStateType type, bool isBound);
+static int GetBufferSlot(uint32_t target);
+static void BindUboSlice(Ubo* ubo);
+static void ForgetBuffer(uint32_t id);
+static void ForgetTexture(uint32_t id);
+static uint32_t CompileProgram(const char *vsCode, const char *fsCode);
+static void SetVertexAttributes(Vao* vao);
+static void ReadUploadQueries(UploadThread* upload);
+#ifdef SHADER_BINARY_CACHE
+static uint64_t GetProgramKey(const char *vsCode, const char *fsCode);
+static void GetProgramCachePath(uint64_t key, char *path);
+static uint32_t LoadCachedProgram(uint64_t key, double *compileTime);
+static void SaveCachedProgram(uint64_t key, uint32_t program, double compileTime);
+#endif
 
 const char *get_pixel_format_name(uint32_t format)
 {
@@ -56,6 +181,7 @@ const char *get_pixel_format_name(uint32_t format)
 		case RL_PIXELFORMAT_COMPRESSED_PVRT_RGBA: return "PVRT_RGBA";           // 4 bpp
 		case RL_PIXELFORMAT_COMPRESSED_ASTC_4x4_RGBA: return "ASTC_4x4_RGBA";   // 8 bpp
 		case RL_PIXELFORMAT_COMPRESSED_ASTC_8x8_RGBA: return "ASTC_8x8_RGBA";   // 2 bpp
+		case RL_PIXELFORMAT_COMPRESSED_BPTC_RGBA: return "BPTC_RGBA";           // 8 bpp
 		default: return "UNKNOWN";
 	}
 }
@@ -65,11 +191,11 @@ uint32_t load_texture(const void *data, int width, int height,
 {
 	uint32_t id = 0;
 	
-	glBindTexture(GL_TEXTURE_2D, 0);    // Free any old binding
+	bind_texture(0, GL_TEXTURE_2D, 0);    // Free any old binding
 	
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 	glGenTextures(1, &id);              // Generate texture id
-	glBindTexture(GL_TEXTURE_2D, id);
+	bind_texture(0, GL_TEXTURE_2D, id);
 	
 	int mipWidth = width;
 	int mipHeight = height;
@@ -141,7 +267,7 @@ uint32_t load_texture(const void *data, int width, int height,
 	// NOTE: If mipmaps were not in data, they are not generated automatically
 	
 	// Unbind current texture
-	glBindTexture(GL_TEXTURE_2D, 0);
+	bind_texture(0, GL_TEXTURE_2D, 0);
 	
 	if (id > 0) log_trace("TEXTURE: [ID %i] Texture loaded successfully (%ix%i | %s | %i mipmaps)", id, width, height, get_pixel_format_name(format), mipmapCount);
 	else log_warn("TEXTURE: Failed to load texture");
@@ -151,9 +277,124 @@ uint32_t load_texture(const void *data, int width, int height,
 
 void cm_unload_texture(Texture tex)
 {
+	ForgetTexture(tex.id);
 	glDeleteTextures(1, &tex.id);
 }
 
+uint32_t load_texture_array(const void *data, int width, int height, int layers,
+                            TextureFlags wrap, TextureFlags filter, int format, int storeFormat, int mipmapCount)
+{
+	uint32_t id = 0;
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glGenTextures(1, &id);
+	bind_texture(0, GL_TEXTURE_2D_ARRAY, id);
+
+	uint32_t glInternalFormat, glFormat, glType, glStoreFormat, unused;
+	get_gl_texture_formats(format, &glInternalFormat, &glFormat, &glType);
+	get_gl_texture_formats(storeFormat, &glStoreFormat, &unused, &unused);
+
+	int mipWidth = width;
+	int mipHeight = height;
+	const unsigned char *dataPtr = (const unsigned char *)data;
+
+	// Every level holds all the layers, the driver compresses the uncompressed data to storeFormat
+	for (int i = 0; i < mipmapCount && glStoreFormat != 0; i++)
+	{
+		uint32_t mipSize = GetPixelDataSize(mipWidth, mipHeight, format) * layers;
+
+		if (format < RL_PIXELFORMAT_COMPRESSED_DXT1_RGB) glTexImage3D(GL_TEXTURE_2D_ARRAY, i, (int)glStoreFormat, mipWidth, mipHeight, layers, 0, glFormat, glType, dataPtr);
+		else glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, i, glInternalFormat, mipWidth, mipHeight, layers, 0, (int)mipSize, dataPtr);
+
+		mipWidth = mipWidth > 1 ? mipWidth / 2 : 1;
+		mipHeight = mipHeight > 1 ? mipHeight / 2 : 1;
+		dataPtr += mipSize;
+	}
+
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, wrap);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, wrap);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, mipmapCount - 1);
+
+	if (filter == CM_TEXTURE_FILTER_TRILINEAR)
+	{
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, mipmapCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	}
+	else
+	{
+		// Nearest keeps the texels sharp up close and blends the mipmaps far away
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, filter);
+		if (mipmapCount > 1) glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, filter == CM_TEXTURE_FILTER_NEAREST ? GL_NEAREST_MIPMAP_LINEAR : GL_LINEAR_MIPMAP_LINEAR);
+		else glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, filter);
+	}
+
+	bind_texture(0, GL_TEXTURE_2D_ARRAY, 0);
+
+	if (glStoreFormat != 0) log_trace("TEXTURE: [ID %i] Texture array loaded successfully (%ix%i x %i layers | %s | %i mipmaps)", id, width, height, layers, get_pixel_format_name(storeFormat), mipmapCount);
+	else log_warn("TEXTURE: Failed to load texture array");
+
+	return id;
+}
+
+void *read_compressed_texture_array(uint32_t id, int width, int height, int layers, int format, int mipmapCount, int *dataSize)
+{
+	uint32_t glInternalFormat, unused;
+	get_gl_texture_formats(format, &glInternalFormat, &unused, &unused);
+	*dataSize = 0;
+
+	bind_texture(0, GL_TEXTURE_2D_ARRAY, id);
+
+	// The driver may have kept another format than the one asked for
+	GLint storedFormat = 0, isCompressed = 0;
+	glGetTexLevelParameteriv(GL_TEXTURE_2D_ARRAY, 0, GL_TEXTURE_INTERNAL_FORMAT, &storedFormat);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D_ARRAY, 0, GL_TEXTURE_COMPRESSED, &isCompressed);
+
+	if (!isCompressed || storedFormat != (GLint)glInternalFormat)
+	{
+		bind_texture(0, GL_TEXTURE_2D_ARRAY, 0);
+		return NULL;
+	}
+
+	int size = (int)get_texture_array_data_size(width, height, layers, format, mipmapCount);
+	unsigned char *data = CM_MALLOC(size);
+	if (data == NULL)
+	{
+		bind_texture(0, GL_TEXTURE_2D_ARRAY, 0);
+		return NULL;
+	}
+
+	unsigned char *dataPtr = data;
+
+	for (int i = 0; i < mipmapCount; i++)
+	{
+		GLint levelSize = 0;
+		glGetTexLevelParameteriv(GL_TEXTURE_2D_ARRAY, i, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &levelSize);
+
+		if (levelSize != GetPixelDataSize(cm_max(width >> i, 1), cm_max(height >> i, 1), format) * layers)
+		{
+			CM_FREE(data);
+			data = NULL;
+			break;
+		}
+
+		glGetCompressedTexImage(GL_TEXTURE_2D_ARRAY, i, dataPtr);
+		dataPtr += levelSize;
+	}
+
+	bind_texture(0, GL_TEXTURE_2D_ARRAY, 0);
+	if (data != NULL) *dataSize = size;
+	return data;
+}
+
+uint64_t get_texture_array_data_size(int width, int height, int layers, int format, int mipmapCount)
+{
+	uint64_t size = 0;
+	for (int i = 0; i < mipmapCount; i++)
+		size += (uint64_t)GetPixelDataSize(cm_max(width >> i, 1), cm_max(height >> i, 1), format) * layers;
+
+	return size;
+}
+
 void get_gl_texture_formats(int format, uint32_t *glInternalFormat, uint32_t *glFormat, uint32_t *glType)
 {
 	*glInternalFormat = 0;
@@ -177,6 +418,7 @@ void get_gl_texture_formats(int format, uint32_t *glInternalFormat, uint32_t *gl
         case RL_PIXELFORMAT_UNCOMPRESSED_R16G16B16A16: *glInternalFormat = GL_RGBA16F; *glFormat = GL_RGBA; *glType = GL_HALF_FLOAT; break;
 		case RL_PIXELFORMAT_COMPRESSED_ETC2_RGB: *glInternalFormat = GL_COMPRESSED_RGB8_ETC2; break;               // NOTE: Requires OpenGL ES 3.0 or OpenGL 4.3
 		case RL_PIXELFORMAT_COMPRESSED_ETC2_EAC_RGBA: *glInternalFormat = GL_COMPRESSED_RGBA8_ETC2_EAC; break;     // NOTE: Requires OpenGL ES 3.0 or OpenGL 4.3
+		case RL_PIXELFORMAT_COMPRESSED_BPTC_RGBA: *glInternalFormat = GL_COMPRESSED_RGBA_BPTC_UNORM; break;          // NOTE: Requires OpenGL 4.2
 		
 		default: log_warn("TEXTURE: Current format not supported (%i)", format); break;
 	}
@@ -213,7 +455,8 @@ static int GetPixelDataSize(int width, int height, int format)
 		case RL_PIXELFORMAT_COMPRESSED_DXT3_RGBA:
 		case RL_PIXELFORMAT_COMPRESSED_DXT5_RGBA:
 		case RL_PIXELFORMAT_COMPRESSED_ETC2_EAC_RGBA:
-		case RL_PIXELFORMAT_COMPRESSED_ASTC_4x4_RGBA: bpp = 8; break;
+		case RL_PIXELFORMAT_COMPRESSED_ASTC_4x4_RGBA:
+		case RL_PIXELFORMAT_COMPRESSED_BPTC_RGBA: bpp = 8; break;
 		case RL_PIXELFORMAT_COMPRESSED_ASTC_8x8_RGBA: bpp = 2; break;
 		default: break;
 	}
@@ -226,6 +469,7 @@ static int GetPixelDataSize(int width, int height, int format)
 	{
 		if ((format >= RL_PIXELFORMAT_COMPRESSED_DXT1_RGB) && (format < RL_PIXELFORMAT_COMPRESSED_DXT3_RGBA)) dataSize = 8;
 		else if ((format >= RL_PIXELFORMAT_COMPRESSED_DXT3_RGBA) && (format < RL_PIXELFORMAT_COMPRESSED_ASTC_8x8_RGBA)) dataSize = 16;
+		else if (format == RL_PIXELFORMAT_COMPRESSED_BPTC_RGBA) dataSize = 16;
 	}
 	
 	return dataSize;
@@ -241,7 +485,10 @@ Shader cm_load_shader(const char *vsPath, const char *fsPath)
 	if (vsPath != NULL) vShaderStr = cm_load_file_text(vsPath);
 	if (fsPath != NULL) fShaderStr = cm_load_file_text(fsPath);
 
-	shader = cm_load_shader_from_memory(vShaderStr, fShaderStr);
+	double startTime = cm_get_time();
+	double savedTime = 0;
+	shader = load_shader(vShaderStr, fShaderStr, &savedTime);
+	if (vsPath != NULL) trace_startup_creation(vsPath, cm_get_time() - startTime, savedTime);   // the program is traced on the vertex shader
 
 	cm_unload_file_text(vShaderStr);
 	cm_unload_file_text(fShaderStr);
@@ -250,20 +497,37 @@ Shader cm_load_shader(const char *vsPath, const char *fsPath)
 }
 
 Shader cm_load_shader_from_memory(const char *vsCode, const char *fsCode)
+{
+	return load_shader(vsCode, fsCode, NULL);
+}
+
+Shader load_shader(const char *vsCode, const char *fsCode, double *savedTime)
 {
 	Shader shader = { 0 };
+	double startTime = cm_get_time();
 
-	uint32_t vertexShaderId = 0;
-    uint32_t fragmentShaderId = 0;
+#ifdef SHADER_BINARY_CACHE
+	// A cached binary of the same sources built by the same driver skips the compilation
+	int formatCount = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
 
-    // Compile vertex shader (if provided)
-    if (vsCode != NULL) vertexShaderId = compile_shader(vsCode, GL_VERTEX_SHADER);
+	uint64_t key = GetProgramKey(vsCode, fsCode);
+	double compileTime = 0;
+	if (formatCount > 0) shader.id = LoadCachedProgram(key, &compileTime);
 
-    // Compile fragment shader (if provided)
-    if (fsCode != NULL) fragmentShaderId = compile_shader(fsCode, GL_FRAGMENT_SHADER);
+	if (shader.id != 0)
+	{
+		if (savedTime != NULL) *savedTime = compileTime - (cm_get_time() - startTime);
+	}
+	else
+	{
+		shader.id = CompileProgram(vsCode, fsCode);
+		if (shader.id != 0 && formatCount > 0) SaveCachedProgram(key, shader.id, cm_get_time() - startTime);
+	}
+#else
+	shader.id = CompileProgram(vsCode, fsCode);
+#endif
 
-	// One of or both shader are new, we need to compile a new shader program
-	shader.id = load_shader_program(vertexShaderId, fragmentShaderId);
 	shader.uniforms = list_create(0);
 	
 	// Get available shader uniforms
@@ -295,27 +559,158 @@ Shader cm_load_shader_from_memory(const char *vsCode, const char *fsCode)
 		
 		// Bind the buffer to the specified binding point
 		glUniformBlockBinding(shader.id, blockIndex, CM_UBOS[i].bindingId);
-		glBindBufferBase(GL_UNIFORM_BUFFER, CM_UBOS[i].bindingId, CM_UBOS[i].id);
+		BindUboSlice(&CM_UBOS[i]);
 	}
+	
+	return shader;
+}
+
+static uint32_t CompileProgram(const char *vsCode, const char *fsCode)
+{
+	uint32_t vertexShaderId = 0;
+    uint32_t fragmentShaderId = 0;
+
+    // Compile vertex shader (if provided)
+    if (vsCode != NULL) vertexShaderId = compile_shader(vsCode, GL_VERTEX_SHADER);
+
+    // Compile fragment shader (if provided)
+    if (fsCode != NULL) fragmentShaderId = compile_shader(fsCode, GL_FRAGMENT_SHADER);
+
+	// One of or both shader are new, we need to compile a new shader program
+	uint32_t program = load_shader_program(vertexShaderId, fragmentShaderId);
 
 	// We can detach and delete vertex/fragment shaders (if not default ones)
 	// NOTE: We detach shader before deletion to make sure memory is freed
 	if (vertexShaderId != 0)
 	{
 		// WARNING: Shader program linkage could fail and returned id is 0
-		if (shader.id > 0) glDetachShader(shader.id, vertexShaderId);
+		if (program > 0) glDetachShader(program, vertexShaderId);
 		glDeleteShader(vertexShaderId);
 	}
 	if (fragmentShaderId != 0)
 	{
 		// WARNING: Shader program linkage could fail and returned id is 0
-		if (shader.id > 0) glDetachShader(shader.id, fragmentShaderId);
+		if (program > 0) glDetachShader(program, fragmentShaderId);
 		glDeleteShader(fragmentShaderId);
 	}
-	
-	return shader;
+
+	return program;
+}
+
+#ifdef SHADER_BINARY_CACHE
+// FNV-1a of both sources and of the driver strings, a driver update gives new keys
+static uint64_t GetProgramKey(const char *vsCode, const char *fsCode)
+{
+	const char *parts[5] =
+	{
+		vsCode, fsCode,
+		(const char *)glGetString(GL_VENDOR),
+		(const char *)glGetString(GL_RENDERER),
+		(const char *)glGetString(GL_VERSION),
+	};
+
+	uint64_t key = CM_HASH_SEED;
+	for (int i = 0; i < 5; ++i)
+	{
+		// The terminator is hashed too so the parts can't shift into each other
+		const char *part = parts[i] != NULL ? parts[i] : "";
+		key = cm_hash_bytes(key, part, strlen(part) + 1);
+	}
+
+	return key;
+}
+
+static void GetProgramCachePath(uint64_t key, char *path)
+{
+	snprintf(path, MAX_PATH_SIZE, "%s/%016llx.bin", SHADER_CACHE_DIRECTORY, (unsigned long long)key);
+}
+
+// Returns 0 when there is no usable binary, the driver may also reject one it wrote itself
+static uint32_t LoadCachedProgram(uint64_t key, double *compileTime)
+{
+	Path path;
+	GetProgramCachePath(key, path);
+
+	FILE *file;
+	if (fopen_s(&file, path, "rb")) return 0;
+
+	uint32_t program = 0;
+	void *binary = NULL;
+	ProgramCacheHeader header;
+
+	// A truncated or corrupted file must not size the allocation, the binary has to fill the rest of it exactly
+	fseek(file, 0, SEEK_END);
+	long fileSize = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	if (fread(&header, sizeof(ProgramCacheHeader), 1, file) == 1 &&
+	    memcmp(header.magic, PROGRAM_CACHE_MAGIC, 4) == 0 &&
+	    header.version == PROGRAM_CACHE_VERSION && header.key == key &&
+	    header.length > 0 && header.length <= INT32_MAX && fileSize > 0 &&
+	    (uint64_t)fileSize == sizeof(ProgramCacheHeader) + (uint64_t)header.length &&
+	    (binary = CM_MALLOC(header.length)) != NULL)
+	{
+		if (fread(binary, 1, header.length, file) == header.length)
+		{
+			GLint success = 0;
+			program = glCreateProgram();
+			glProgramBinary(program, header.format, binary, (GLsizei)header.length);
+			glGetProgramiv(program, GL_LINK_STATUS, &success);
+
+			if (success == GL_FALSE)
+			{
+				log_info("SHADER: Cached program %s is stale, compiling it again", path);
+				glDeleteProgram(program);
+				program = 0;
+			}
+			else *compileTime = header.compileTime;
+		}
+	}
+
+	CM_FREE(binary);
+	fclose(file);
+	return program;
 }
 
+static void SaveCachedProgram(uint64_t key, uint32_t program, double compileTime)
+{
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) return;
+
+	ProgramCacheHeader header =
+	{
+		.magic = PROGRAM_CACHE_MAGIC,
+		.version = PROGRAM_CACHE_VERSION,
+		.key = key,
+		.length = (uint32_t)length,
+		.compileTime = compileTime,
+	};
+
+	void *binary = CM_MALLOC(length);
+	if (binary == NULL) return;
+
+	GLenum format = 0;
+	glGetProgramBinary(program, length, NULL, &format, binary);
+	header.format = format;
+
+	Path path;
+	GetProgramCachePath(key, path);
+	cm_make_directory(SHADER_CACHE_DIRECTORY);
+
+	FILE *file;
+	if (!fopen_s(&file, path, "wb"))
+	{
+		fwrite(&header, sizeof(ProgramCacheHeader), 1, file);
+		fwrite(binary, 1, length, file);
+		fclose(file);
+	}
+	else log_warn("SHADER: Unable to write the program cache %s", path);
+
+	CM_FREE(binary);
+}
+#endif
+
 void cm_unload_shader(Shader shader)
 {
 	if (shader.id != 0)
@@ -372,6 +767,9 @@ uint32_t load_shader_program(uint32_t vShaderId, uint32_t fShaderId)
 
     glAttachShader(program, vShaderId);
     glAttachShader(program, fShaderId);
+#ifdef SHADER_BINARY_CACHE
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+#endif
     glLinkProgram(program);
 
     // NOTE: All uniform variables are intitialised to 0 when a program links
@@ -404,6 +802,7 @@ uint32_t load_shader_program(uint32_t vShaderId, uint32_t fShaderId)
 
 void unload_shader_program(uint32_t id)
 {
+	if (CM_GL_STATE.program == id) CM_GL_STATE.program = 0;
 	glDeleteProgram(id);
 }
 
@@ -414,25 +813,24 @@ Ssbo cm_load_ssbo(uint32_t bindingId, uint32_t dataSize, const void* data)
 	ssbo.dataSize = dataSize;
 
 	glGenBuffers(1, &ssbo.id);
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo.id);
+	bind_buffer(GL_SHADER_STORAGE_BUFFER, ssbo.id);
 
 	if(data != NULL) glBufferData(GL_SHADER_STORAGE_BUFFER, ssbo.dataSize, data, GL_STATIC_DRAW);
 	else glBufferData(GL_SHADER_STORAGE_BUFFER, ssbo.dataSize, data, GL_DYNAMIC_DRAW);
 
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ssbo.bindingId, ssbo.id); // Bind to binding point 0
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	bind_buffer_base(GL_SHADER_STORAGE_BUFFER, ssbo.bindingId, ssbo.id); // Bind to binding point 0
 	return ssbo;
 }
 
 void cm_upload_ssbo(Ssbo ssbo, uint32_t offset, uint32_t size, const void* data)
 {
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo.id);
+	bind_buffer(GL_SHADER_STORAGE_BUFFER, ssbo.id);
 	glBufferSubData(GL_SHADER_STORAGE_BUFFER, offset, size, data);
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 }
 
 void cm_unload_ssbo(Ssbo ssbo)
 {
+	ForgetBuffer(ssbo.id);
 	glDeleteBuffers(1, &ssbo.id);
 }
 
@@ -455,12 +853,28 @@ bool cm_load_ubo(const char* name, uint32_t bindingId, uint32_t dataSize, const
 	ubo.dataSize = dataSize;
 	ubo.data = data;
 	ubo.bindingId = bindingId;
-	
+	ubo.sliceSize = dataSize;
+
 	glGenBuffers(1, &ubo.id);
-	glBindBuffer(GL_UNIFORM_BUFFER, ubo.id);
-	glBufferData(GL_UNIFORM_BUFFER, dataSize, data, GL_DYNAMIC_DRAW);
-	glBindBufferBase(GL_UNIFORM_BUFFER, ubo.bindingId, ubo.id);
-	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	bind_buffer(GL_UNIFORM_BUFFER, ubo.id);
+
+	// NOTE: The staging ring fences every frame, which is what makes reusing a slice safe
+	if(CM_STAGING_RING.isReady && cmBufferStorage != NULL)
+	{
+		GLint alignment = 256;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		ubo.sliceSize = (dataSize + alignment - 1) / alignment * alignment;
+
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		cmBufferStorage(GL_UNIFORM_BUFFER, ubo.sliceSize * UBO_RING_SLICES, NULL, flags);
+		ubo.mapped = glMapBufferRange(GL_UNIFORM_BUFFER, 0, ubo.sliceSize * UBO_RING_SLICES, flags);
+		if(ubo.mapped == NULL) log_warn("Unable to map Ubo %s, it is updated with glBufferSubData", name);
+	}
+
+	if(ubo.mapped != NULL) memcpy(ubo.mapped, data, dataSize);
+	else glBufferData(GL_UNIFORM_BUFFER, dataSize, data, GL_DYNAMIC_DRAW);
+
+	BindUboSlice(&ubo);
 	
 	ubo.isReady = true;
 	CM_UBOS[cmUboCount] = ubo;
@@ -468,13 +882,32 @@ bool cm_load_ubo(const char* name, uint32_t bindingId, uint32_t dataSize, const
 	return true;
 }
 
+void cm_mark_ubo_dirty(const void* data)
+{
+	for (int i = 0; i < cmUboCount; ++i)
+		if(CM_UBOS[i].data == data) CM_UBOS[i].isDirty = true;
+}
+
 void cm_upload_ubos()
 {
 	for (int i = 0; i < cmUboCount; ++i)
 	{
-		glBindBuffer(GL_UNIFORM_BUFFER, CM_UBOS[i].id);
-		glBufferSubData(GL_UNIFORM_BUFFER, 0, CM_UBOS[i].dataSize, CM_UBOS[i].data);
-		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		// Blocks that were not marked dirty since their last upload are not sent again
+		Ubo* ubo = &CM_UBOS[i];
+		if(SkipState(CM_GL_STATE_UBO_UPLOAD, !ubo->isDirty)) continue;
+
+		ubo->isDirty = false;
+		if(ubo->mapped == NULL)
+		{
+			bind_buffer(GL_UNIFORM_BUFFER, ubo->id);
+			glBufferSubData(GL_UNIFORM_BUFFER, 0, ubo->dataSize, ubo->data);
+			continue;
+		}
+
+		// The next slice was last read at least UBO_RING_SLICES - 1 frames ago, so writing it never waits on the GPU
+		ubo->slice = (ubo->slice + 1) % UBO_RING_SLICES;
+		memcpy(ubo->mapped + ubo->slice * ubo->sliceSize, ubo->data, ubo->dataSize);
+		BindUboSlice(ubo);
 	}
 }
 
@@ -482,12 +915,32 @@ void unload_ubos()
 {
 	for (int i = 0; i < cmUboCount; ++i)
 	{
+		if(CM_UBOS[i].mapped != NULL)
+		{
+			bind_buffer(GL_UNIFORM_BUFFER, CM_UBOS[i].id);
+			glUnmapBuffer(GL_UNIFORM_BUFFER);
+		}
+
+		ForgetBuffer(CM_UBOS[i].id);
 		glDeleteBuffers(1, &CM_UBOS[i].id);
 		CM_UBOS[i].isReady = false;
 	}
 	cmUboCount = 0;
 }
 
+// NOTE: Binding a range also binds the buffer to the generic target
+static void BindUboSlice(Ubo* ubo)
+{
+	if(ubo->mapped == NULL)
+	{
+		bind_buffer_base(GL_UNIFORM_BUFFER, ubo->bindingId, ubo->id);
+		return;
+	}
+
+	bind_buffer(GL_UNIFORM_BUFFER, ubo->id);
+	glBindBufferRange(GL_UNIFORM_BUFFER, ubo->bindingId, ubo->id, ubo->slice * ubo->sliceSize, ubo->dataSize);
+}
+
 Vao cm_load_vao(VaoAttribute* attributes, uint32_t attributeCount, Vbo vbo)
 {
 	Vao vao = { 0 };
@@ -497,43 +950,80 @@ Vao cm_load_vao(VaoAttribute* attributes, uint32_t attributeCount, Vbo vbo)
 	vao.stride = 0;
 	memcpy(vao.attributes, attributes, attributeCount * sizeof(VaoAttribute));
 	glGenVertexArrays(1, &vao.id);
-	glBindVertexArray(vao.id);
 
+	// Loading the ebo unbinds the vertex arrays, the new one gets its element buffer once it is bound
 	vao.vbo = cm_load_vbo(vbo.dataSize, vbo.vertexCount, vbo.data, vbo.ebo);
+	bind_vertex_array(vao.id);
+	if(vao.vbo.ebo.dataSize > 0) glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vao.vbo.ebo.id);
 
 	for (int i = 0; i < vao.attributeCount; ++i) vao.stride += vao.attributes[i].stride;
 
+	SetVertexAttributes(&vao);
+
+	bind_vertex_array(0);
+
+	return vao;
+}
+
+// The vertex attributes read the new buffer from now on, the instance attributes are kept.
+// The buffer is always bound again, which makes the writes of another context visible to this one
+void cm_set_vao_vbo(Vao* vao, Vbo vbo)
+{
+	bind_vertex_array(vao->id);
+	vao->vbo = vbo;
+	ForgetBuffer(vbo.id);
+	bind_buffer(GL_ARRAY_BUFFER, vbo.id);
+	if(vbo.ebo.dataSize > 0) glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbo.ebo.id);
+
+	SetVertexAttributes(vao);
+
+	bind_vertex_array(0);
+}
+
+// Reads the buffer bound to GL_ARRAY_BUFFER, the vao has to be bound
+static void SetVertexAttributes(Vao* vao)
+{
 	uint32_t offset = 0;
 	
-	for (int i = 0; i < vao.attributeCount; ++i)
+	for (int i = 0; i < vao->attributeCount; ++i)
 	{
-		VaoAttribute attrib = vao.attributes[i];
+		VaoAttribute attrib = vao->attributes[i];
 		if(attrib.type < CM_HALF_FLOAT)
 		{
 			glVertexAttribIPointer(i, (int)attrib.size, attrib.type,
-			                      (int)vao.stride, (void*)(uintptr_t)offset);
+			                      (int)vao->stride, (void*)(uintptr_t)offset);
 		}
 		else
 		{
 			glVertexAttribPointer(i, (int)attrib.size,
 			                      attrib.type,
 			                      attrib.normalized,
-			                      (int)vao.stride, (void*)(uintptr_t)offset);
+			                      (int)vao->stride, (void*)(uintptr_t)offset);
 		}
 		
 		offset += attrib.stride;
 		glEnableVertexAttribArray(i);
 	}
+}
 
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindVertexArray(0);
+void cm_set_vao_instance_attribute(Vao vao, uint32_t location, VaoAttribute attribute, Vbo instances)
+{
+	bind_vertex_array(vao.id);
+	bind_buffer(GL_ARRAY_BUFFER, instances.id);
 
-	return vao;
+	if(attribute.type < CM_HALF_FLOAT) glVertexAttribIPointer(location, (int)attribute.size, attribute.type, (int)attribute.stride, NULL);
+	else glVertexAttribPointer(location, (int)attribute.size, attribute.type, attribute.normalized, (int)attribute.stride, NULL);
+
+	glVertexAttribDivisor(location, 1);
+	glEnableVertexAttribArray(location);
+
+	bind_vertex_array(0);
 }
 
 void cm_unload_vao(Vao vao)
 {
 	cm_unload_vbo(vao.vbo);
+	if(CM_GL_STATE.vertexArray == vao.id) CM_GL_STATE.vertexArray = 0;
 	glDeleteVertexArrays(1, &vao.id);
 	CM_FREE(vao.attributes);
 }
@@ -543,10 +1033,11 @@ Vbo cm_load_vbo(uint32_t dataSize, uint32_t vertexCount, const void* data, Ebo e
 	Vbo vbo = { 0 };
 	vbo.ebo = (Ebo){ 0 };
 	vbo.dataSize = dataSize;
+	vbo.capacity = dataSize;
 	vbo.vertexCount = vertexCount;
 	vbo.data = data;
 	glGenBuffers(1, &vbo.id);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo.id);
+	bind_buffer(GL_ARRAY_BUFFER, vbo.id);
 
 	if(vbo.data != NULL) glBufferData(GL_ARRAY_BUFFER, vbo.dataSize, vbo.data, GL_STATIC_DRAW);
 	else glBufferData(GL_ARRAY_BUFFER, vbo.dataSize, vbo.data, GL_DYNAMIC_DRAW);
@@ -560,23 +1051,33 @@ Vbo cm_load_vbo(uint32_t dataSize, uint32_t vertexCount, const void* data, Ebo e
 void cm_unload_vbo(Vbo vbo)
 {
 	cm_unload_ebo(vbo.ebo);
+	ForgetBuffer(vbo.id);
 	glDeleteBuffers(1, &vbo.id);
 }
 
 void cm_reupload_vbo(Vbo* vbo, uint32_t dataSize, const void* data)
 {
-	glBindBuffer(GL_ARRAY_BUFFER, vbo->id);
+	bind_buffer(GL_ARRAY_BUFFER, vbo->id);
 	vbo->dataSize = dataSize;
+	vbo->capacity = dataSize;
 	vbo->data = data;
 	glBufferData(GL_ARRAY_BUFFER, vbo->dataSize, vbo->data, GL_DYNAMIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 void cm_reupload_vbo_partial(Vbo* vbo, uint32_t dataOffset, uint32_t uploadSize)
 {
-	glBindBuffer(GL_ARRAY_BUFFER, vbo->id);
+	bind_buffer(GL_ARRAY_BUFFER, vbo->id);
 	glBufferSubData(GL_ARRAY_BUFFER, dataOffset, uploadSize, vbo->data);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Grow the buffer storage, the content is lost when it has to grow
+void cm_reserve_vbo(Vbo* vbo, uint32_t capacity)
+{
+	if(capacity <= vbo->capacity) return;
+
+	vbo->capacity = cm_max(capacity, vbo->capacity * 2);
+	bind_buffer(GL_ARRAY_BUFFER, vbo->id);
+	glBufferData(GL_ARRAY_BUFFER, vbo->capacity, NULL, GL_DYNAMIC_DRAW);
 }
 
 Ebo cm_load_ebo(uint32_t dataSize, const void* data, uint32_t type, uint32_t indexCount)
@@ -587,6 +1088,8 @@ Ebo cm_load_ebo(uint32_t dataSize, const void* data, uint32_t type, uint32_t ind
 	ebo.type = type;
 	ebo.indexCount = indexCount;
 	glGenBuffers(1, &ebo.id);
+	// The element buffer binding belongs to the vertex array, the last drawn one stays bound
+	bind_vertex_array(0);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo.id);
 
 	if(ebo.data != NULL) glBufferData(GL_ELEMENT_ARRAY_BUFFER, ebo.dataSize, ebo.data, GL_STATIC_DRAW);
@@ -602,6 +1105,8 @@ void cm_unload_ebo(Ebo ebo)
 
 void cm_reupload_ebo(Ebo* ebo, uint32_t dataSize, const void* data, uint32_t indexCount)
 {
+	// The element buffer binding belongs to the vertex array, the last drawn one stays bound
+	bind_vertex_array(0);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo->id);
 	ebo->dataSize = dataSize;
 	ebo->data = data;
@@ -610,9 +1115,446 @@ void cm_reupload_ebo(Ebo* ebo, uint32_t dataSize, const void* data, uint32_t ind
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 }
 
+static bool SupportsBufferStorage()
+{
+	if(GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 4)) return true;
+
+	int extensionCount = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+	for (int i = 0; i < extensionCount; ++i)
+	{
+		const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+		if(extension != NULL && strcmp(extension, "GL_ARB_buffer_storage") == 0) return true;
+	}
+
+	return false;
+}
+
+void load_staging_ring()
+{
+	StagingRing* ring = &CM_STAGING_RING;
+	memset(ring, 0, sizeof(StagingRing));
+	pthread_mutex_init(&ring->lock, NULL);
+
+	cmBufferStorage = NULL;
+	if(SupportsBufferStorage())
+	{
+		cmBufferStorage = (PFNGLBUFFERSTORAGEPROC)get_proc_address("glBufferStorage");
+		if(cmBufferStorage == NULL) cmBufferStorage = (PFNGLBUFFERSTORAGEPROC)get_proc_address("glBufferStorageARB");
+	}
+
+	if(cmBufferStorage == NULL)
+	{
+		log_warn("%s", "Buffer storage is not supported, staging uploads are disabled");
+		return;
+	}
+
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glGenBuffers(1, &ring->id);
+	bind_buffer(GL_COPY_READ_BUFFER, ring->id);
+	cmBufferStorage(GL_COPY_READ_BUFFER, STAGING_RING_SIZE, NULL, flags);
+	ring->mapped = glMapBufferRange(GL_COPY_READ_BUFFER, 0, STAGING_RING_SIZE, flags);
+
+	if(ring->mapped == NULL)
+	{
+		log_warn("%s", "Unable to map the staging ring, staging uploads are disabled");
+		ForgetBuffer(ring->id);
+		glDeleteBuffers(1, &ring->id);
+		ring->id = 0;
+		return;
+	}
+
+	ring->isReady = true;
+}
+
+// Fence the commands of this frame and reclaim the staging allocations of the frames the GPU finished,
+// the fences are kept without the ring for cm_is_gpu_frame_done
+void update_staging_ring()
+{
+	StagingRing* ring = &CM_STAGING_RING;
+
+	uint32_t slot = ring->frame % MAX_STAGING_FRAMES_IN_FLIGHT;
+	for (uint32_t i = 0; i < MAX_STAGING_FRAMES_IN_FLIGHT; ++i)
+	{
+		if(ring->fences[i] == NULL) continue;
+
+		// The slot about to be reused is waited on (up to a second), the others are only polled
+		GLenum result = i == slot ? glClientWaitSync(ring->fences[i], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000)
+		                          : glClientWaitSync(ring->fences[i], 0, 0);
+
+		if(result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED)
+		{
+			glDeleteSync(ring->fences[i]);
+			ring->fences[i] = NULL;
+			if(ring->fenceFrames[i] > ring->completedFrame) ring->completedFrame = ring->fenceFrames[i];
+		}
+	}
+
+	ring->fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	pthread_mutex_lock(&ring->lock);
+
+	ring->fenceFrames[slot] = ++ring->frame;
+
+	while(ring->recordCount > 0)
+	{
+		StagingRecord* record = &ring->records[ring->firstRecord];
+		if(!record->isReleased || record->frame > ring->completedFrame) break;
+
+		ring->tail = (record->start + record->length) % STAGING_RING_SIZE;
+		ring->used -= record->length;
+		ring->firstRecord = (ring->firstRecord + 1) % MAX_STAGING_ALLOCATIONS;
+		ring->recordCount--;
+	}
+
+	pthread_mutex_unlock(&ring->lock);
+}
+
+void unload_staging_ring()
+{
+	StagingRing* ring = &CM_STAGING_RING;
+
+	for (uint32_t i = 0; i < MAX_STAGING_FRAMES_IN_FLIGHT; ++i)
+		if(ring->fences[i] != NULL) glDeleteSync(ring->fences[i]);
+
+	if(ring->isReady)
+	{
+		bind_buffer(GL_COPY_READ_BUFFER, ring->id);
+		glUnmapBuffer(GL_COPY_READ_BUFFER);
+		ForgetBuffer(ring->id);
+		glDeleteBuffers(1, &ring->id);
+	}
+
+	pthread_mutex_destroy(&ring->lock);
+	ring->isReady = false;
+}
+
+bool cm_is_staging_available() { return CM_STAGING_RING.isReady; }
+
+uint64_t cm_get_gpu_frame() { return CM_STAGING_RING.frame + 1; }
+
+bool cm_is_gpu_frame_done(uint64_t frame) { return frame <= CM_STAGING_RING.completedFrame; }
+
+uint64_t cm_get_completed_gpu_frame() { return CM_STAGING_RING.completedFrame; }
+
+bool cm_alloc_staging(uint32_t size, StagingAllocation* allocation)
+{
+	StagingRing* ring = &CM_STAGING_RING;
+	if(!ring->isReady || size == 0 || size > STAGING_RING_SIZE) return false;
+
+	size = (size + 15u) & ~15u;
+
+	pthread_mutex_lock(&ring->lock);
+
+	if(ring->recordCount == MAX_STAGING_ALLOCATIONS)
+	{
+		pthread_mutex_unlock(&ring->lock);
+		return false;
+	}
+
+	if(ring->used == 0) ring->head = ring->tail = 0;
+
+	uint32_t start = ring->head, offset, padding = 0;
+	if(ring->used > 0 && ring->head <= ring->tail)
+	{
+		if(ring->tail - ring->head < size)
+		{
+			pthread_mutex_unlock(&ring->lock);
+			return false;
+		}
+		offset = ring->head;
+	}
+	else if(STAGING_RING_SIZE - ring->head >= size) offset = ring->head;
+	else if(ring->tail >= size)
+	{
+		padding = STAGING_RING_SIZE - ring->head;
+		offset = 0;
+	}
+	else
+	{
+		pthread_mutex_unlock(&ring->lock);
+		return false;
+	}
+
+	uint32_t recordId = (ring->firstRecord + ring->recordCount) % MAX_STAGING_ALLOCATIONS;
+	ring->records[recordId] = (StagingRecord){ .start = start, .length = size + padding, .isReleased = false, .frame = 0 };
+	ring->recordCount++;
+	ring->head = (offset + size) % STAGING_RING_SIZE;
+	ring->used += size + padding;
+
+	pthread_mutex_unlock(&ring->lock);
+
+	allocation->id = recordId;
+	allocation->offset = offset;
+	allocation->size = size;
+	allocation->data = ring->mapped + offset;
+	return true;
+}
+
+void cm_release_staging(StagingAllocation allocation)
+{
+	StagingRing* ring = &CM_STAGING_RING;
+
+	pthread_mutex_lock(&ring->lock);
+	ring->records[allocation.id].isReleased = true;
+	ring->records[allocation.id].frame = ring->frame + 1;
+	pthread_mutex_unlock(&ring->lock);
+}
+
+void cm_copy_staging_to_buffer(StagingAllocation allocation, uint32_t srcOffset, uint32_t bufferId, uint32_t dstOffset, uint32_t size)
+{
+	bind_buffer(GL_COPY_READ_BUFFER, CM_STAGING_RING.id);
+	bind_buffer(GL_COPY_WRITE_BUFFER, bufferId);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, allocation.offset + srcOffset, dstOffset, size);
+}
+
+GpuTimer cm_load_gpu_timer()
+{
+	GpuTimer timer = { 0 };
+	glGenQueries(MAX_GPU_TIMER_QUERIES, timer.queries);
+	return timer;
+}
+
+bool cm_begin_gpu_timer(GpuTimer* timer)
+{
+	if(timer->isRunning || timer->pending == MAX_GPU_TIMER_QUERIES) return false;
+
+	uint32_t query = timer->queries[(timer->first + timer->pending) % MAX_GPU_TIMER_QUERIES];
+	glBeginQuery(GL_TIME_ELAPSED, query);
+	timer->isRunning = true;
+	return true;
+}
+
+void cm_end_gpu_timer(GpuTimer* timer)
+{
+	if(!timer->isRunning) return;
+
+	glEndQuery(GL_TIME_ELAPSED);
+	timer->isRunning = false;
+	timer->pending++;
+}
+
+bool cm_read_gpu_timer(GpuTimer* timer, double* seconds)
+{
+	if(timer->pending == 0) return false;
+
+	uint32_t query = timer->queries[timer->first];
+	int isAvailable = 0;
+	glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &isAvailable);
+	if(!isAvailable) return false;
+
+	GLuint64 elapsed = 0;
+	glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+	*seconds = (double)elapsed * 1e-9;
+
+	timer->first = (timer->first + 1) % MAX_GPU_TIMER_QUERIES;
+	timer->pending--;
+	return true;
+}
+
+void cm_unload_gpu_timer(GpuTimer timer)
+{
+	glDeleteQueries(MAX_GPU_TIMER_QUERIES, timer.queries);
+}
+
+static void* T_RunUploads(void* args)
+{
+	UploadThread* upload = &CM_UPLOAD_THREAD;
+	make_context_current(upload->context);
+	CM_PROFILE_THREAD("Upload");
+	glGenQueries(MAX_UPLOAD_JOBS, upload->queries);
+
+	while(true)
+	{
+		pthread_mutex_lock(&upload->lock);
+		ReadUploadQueries(upload);
+
+		// Pending GPU times are polled every millisecond while there is nothing to run
+		while(upload->ranCount == upload->count && upload->isAlive)
+		{
+			if(upload->timedCount == upload->ranCount) pthread_cond_wait(&upload->signal, &upload->lock);
+			else
+			{
+				struct timespec wakeTime;
+				timespec_get(&wakeTime, TIME_UTC);
+				wakeTime.tv_nsec += 1000000;
+				if(wakeTime.tv_nsec >= 1000000000) { wakeTime.tv_sec++; wakeTime.tv_nsec -= 1000000000; }
+				pthread_cond_timedwait(&upload->signal, &upload->lock, &wakeTime);
+			}
+
+			ReadUploadQueries(upload);
+		}
+
+		if(upload->ranCount == upload->count)
+		{
+			pthread_mutex_unlock(&upload->lock);
+			break;
+		}
+
+		uint32_t entryId = (upload->first + upload->ranCount) % MAX_UPLOAD_JOBS;
+		ThreadJob job = upload->entries[entryId].job;
+		pthread_mutex_unlock(&upload->lock);
+
+		CM_PROFILE_JOB_BEGIN(job.name != NULL ? job.name : "Upload");
+		glBeginQuery(GL_TIME_ELAPSED, upload->queries[entryId]);
+		double startTime = cm_get_time();
+		if(job.job != NULL) job.job(0, job.args);
+		double cpuTime = cm_get_time() - startTime;
+		glEndQuery(GL_TIME_ELAPSED);
+		CM_PROFILE_END();
+
+		// The flush makes the fence visible to the main context
+		GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		glFlush();
+
+		pthread_mutex_lock(&upload->lock);
+		upload->entries[entryId].fence = fence;
+		upload->entries[entryId].cpuTime = cpuTime;
+		upload->ranCount++;
+		pthread_mutex_unlock(&upload->lock);
+	}
+
+	glDeleteQueries(MAX_UPLOAD_JOBS, upload->queries);
+	make_context_current(NULL);
+	return NULL;
+}
+
+// Upload thread with the lock held, the results are read without stalling and in submission order
+static void ReadUploadQueries(UploadThread* upload)
+{
+	while(upload->timedCount < upload->ranCount)
+	{
+		uint32_t entryId = (upload->first + upload->timedCount) % MAX_UPLOAD_JOBS;
+		int isAvailable = 0;
+		glGetQueryObjectiv(upload->queries[entryId], GL_QUERY_RESULT_AVAILABLE, &isAvailable);
+		if(!isAvailable) return;
+
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(upload->queries[entryId], GL_QUERY_RESULT, &elapsed);
+		upload->entries[entryId].gpuTime = (double)elapsed * 1e-9;
+		upload->timedCount++;
+	}
+}
+
+bool cm_load_upload_thread()
+{
+	UploadThread* upload = &CM_UPLOAD_THREAD;
+	if(upload->isReady) return true;
+
+	memset(upload, 0, sizeof(UploadThread));
+	upload->context = create_shared_context();
+	if(upload->context == NULL) return false;
+
+	pthread_mutex_init(&upload->lock, NULL);
+	pthread_cond_init(&upload->signal, NULL);
+	upload->isAlive = true;
+
+	if(pthread_create(&upload->thread, NULL, &T_RunUploads, NULL) != 0)
+	{
+		log_warn("%s", "Failed to create the upload thread");
+		pthread_mutex_destroy(&upload->lock);
+		pthread_cond_destroy(&upload->signal);
+		destroy_shared_context(upload->context);
+		return false;
+	}
+
+	upload->isReady = true;
+	return true;
+}
+
+bool cm_is_upload_thread_available() { return CM_UPLOAD_THREAD.isReady; }
+
+bool cm_submit_upload(ThreadJob job)
+{
+	UploadThread* upload = &CM_UPLOAD_THREAD;
+	if(!upload->isReady) return false;
+
+	pthread_mutex_lock(&upload->lock);
+
+	if(upload->count == MAX_UPLOAD_JOBS)
+	{
+		pthread_mutex_unlock(&upload->lock);
+		return false;
+	}
+
+	upload->entries[(upload->first + upload->count) % MAX_UPLOAD_JOBS] = (UploadEntry){ .job = job, .fence = NULL };
+	upload->count++;
+	pthread_cond_signal(&upload->signal);
+
+	pthread_mutex_unlock(&upload->lock);
+	return true;
+}
+
+// Runs the callbacks of the jobs the GPU finished, in submission order
+void update_upload_thread()
+{
+	UploadThread* upload = &CM_UPLOAD_THREAD;
+	if(!upload->isReady) return;
+
+	// Only the timed entries are completed, their time is read by the callbacks
+	pthread_mutex_lock(&upload->lock);
+	uint32_t timedCount = upload->timedCount;
+	pthread_mutex_unlock(&upload->lock);
+
+	uint32_t completedCount = 0;
+	for (; completedCount < timedCount; ++completedCount)
+	{
+		UploadEntry* entry = &upload->entries[(upload->first + completedCount) % MAX_UPLOAD_JOBS];
+		GLenum result = glClientWaitSync(entry->fence, 0, 0);
+		if(result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED) break;
+
+		glDeleteSync(entry->fence);
+		upload->completing = entry;
+		if(entry->job.callbackJob != NULL) entry->job.callbackJob(0, entry->job.args);
+		upload->completing = NULL;
+		CM_FREE(entry->job.args);
+	}
+
+	pthread_mutex_lock(&upload->lock);
+	upload->first = (upload->first + completedCount) % MAX_UPLOAD_JOBS;
+	upload->ranCount -= completedCount;
+	upload->timedCount -= completedCount;
+	upload->count -= completedCount;
+	pthread_mutex_unlock(&upload->lock);
+}
+
+void cm_get_upload_timing(double* cpuTime, double* gpuTime)
+{
+	UploadEntry* entry = CM_UPLOAD_THREAD.completing;
+	*cpuTime = entry != NULL ? entry->cpuTime : 0.0;
+	*gpuTime = entry != NULL ? entry->gpuTime : 0.0;
+}
+
+void cm_unload_upload_thread()
+{
+	UploadThread* upload = &CM_UPLOAD_THREAD;
+	if(!upload->isReady) return;
+
+	pthread_mutex_lock(&upload->lock);
+	upload->isAlive = false;
+	pthread_cond_broadcast(&upload->signal);
+	pthread_mutex_unlock(&upload->lock);
+
+	// The thread runs every submitted job before leaving
+	pthread_join(upload->thread, NULL);
+	glFinish();
+
+	for (uint32_t i = 0; i < upload->count; ++i)
+	{
+		UploadEntry* entry = &upload->entries[(upload->first + i) % MAX_UPLOAD_JOBS];
+		glDeleteSync(entry->fence);
+		CM_FREE(entry->job.args);
+	}
+
+	pthread_mutex_destroy(&upload->lock);
+	pthread_cond_destroy(&upload->signal);
+	destroy_shared_context(upload->context);
+	upload->isReady = false;
+}
+
 extern void cm_draw_vao(Vao vao, DrawType drawType)
 {
-	glBindVertexArray(vao.id);
+	bind_vertex_array(vao.id);
 
 
 	if(vao.vbo.ebo.dataSize == 0)
@@ -628,7 +1570,7 @@ extern void cm_draw_vao(Vao vao, DrawType drawType)
 
 void cm_draw_instanced_vao(Vao vao, DrawType drawType, uint32_t instanceCount)
 {
-	glBindVertexArray(vao.id);
+	bind_vertex_array(vao.id);
 
 	if(vao.vbo.ebo.dataSize == 0)
 	{
@@ -641,16 +1583,29 @@ void cm_draw_instanced_vao(Vao vao, DrawType drawType, uint32_t instanceCount)
 	}
 }
 
-void cm_begin_shader_mode(Shader shader)
+void cm_draw_vao_base_instance(Vao vao, DrawType drawType, uint32_t baseInstance)
 {
-	glUseProgram(shader.id);
+	bind_vertex_array(vao.id);
+
+	if(vao.vbo.ebo.dataSize == 0)
+	{
+		glDrawArraysInstancedBaseInstance(drawType, 0, (int)vao.vbo.vertexCount, 1, baseInstance);
+	}
+	else
+	{
+		Ebo ebo = vao.vbo.ebo;
+		glDrawElementsInstancedBaseInstance(drawType, (int)ebo.indexCount, ebo.type, 0, 1, baseInstance);
+	}
 }
 
-void cm_end_shader_mode()
+void cm_begin_shader_mode(Shader shader)
 {
-	glUseProgram(0);
+	use_program(shader.id);
 }
 
+// Left empty on purpose, the program binding belongs to the state cache and beginning the same shader next frame costs nothing
+void cm_end_shader_mode() { }
+
 int cm_get_uniform_location(Shader shader, const char* name) { return glGetUniformLocation(shader.id, name); }
 
 void cm_set_uniform_m4x4(int id, float* m) { glUniformMatrix4fv(id, 1, GL_FALSE, m); }
@@ -673,8 +1628,13 @@ void cm_set_uniform_u(int id, uint32_t f) { glUniform1ui(id, f); }
 
 void cm_set_texture(int id, uint32_t texId, unsigned char bindingPoint)
 {
-	glActiveTexture(GL_TEXTURE0 + bindingPoint);
-	glBindTexture(GL_TEXTURE_2D, texId);
+	bind_texture(bindingPoint, GL_TEXTURE_2D, texId);
+	glUniform1i(id, bindingPoint);
+}
+
+void cm_set_texture_array(int id, uint32_t texId, unsigned char bindingPoint)
+{
+	bind_texture(bindingPoint, GL_TEXTURE_2D_ARRAY, texId);
 	glUniform1i(id, bindingPoint);
 }
 
@@ -739,4 +1699,108 @@ float get_line_width(void)
 // Enable line aliasing
 void enable_smooth_lines(void) { glEnable(GL_LINE_SMOOTH); }
 // Disable line aliasing
-void disable_smooth_lines(void) { glDisable(GL_LINE_SMOOTH); }
\ No newline at end of file
+void disable_smooth_lines(void) { glDisable(GL_LINE_SMOOTH); }
+
+//region GL State
+
+void use_program(uint32_t id)
+{
+	if(SkipState(CM_GL_STATE_PROGRAM, CM_GL_STATE.program == id)) return;
+
+	CM_GL_STATE.program = id;
+	glUseProgram(id);
+}
+
+void bind_vertex_array(uint32_t id)
+{
+	if(SkipState(CM_GL_STATE_VERTEX_ARRAY, CM_GL_STATE.vertexArray == id)) return;
+
+	CM_GL_STATE.vertexArray = id;
+	glBindVertexArray(id);
+}
+
+void bind_buffer(uint32_t target, uint32_t id)
+{
+	int slot = GetBufferSlot(target);
+	if(SkipState(CM_GL_STATE_BUFFER, slot >= 0 && CM_GL_STATE.buffers[slot] == id)) return;
+
+	if(slot >= 0) CM_GL_STATE.buffers[slot] = id;
+	glBindBuffer(target, id);
+}
+
+// NOTE: Binding to an indexed point also binds the buffer to the generic target
+void bind_buffer_base(uint32_t target, uint32_t index, uint32_t id)
+{
+	int slot = GetBufferSlot(target);
+	if(slot >= 0) CM_GL_STATE.buffers[slot] = id;
+	glBindBufferBase(target, index, id);
+}
+
+void bind_texture(uint32_t unit, uint32_t target, uint32_t id)
+{
+	bool isTracked = unit < MAX_TRACKED_TEXTURE_UNITS && (target == GL_TEXTURE_2D || target == GL_TEXTURE_2D_ARRAY);
+	uint32_t slot = target == GL_TEXTURE_2D_ARRAY;
+	if(SkipState(CM_GL_STATE_TEXTURE, isTracked && CM_GL_STATE.textures[unit][slot] == id)) return;
+
+	if(CM_GL_STATE.activeTexture != unit)
+	{
+		CM_GL_STATE.activeTexture = unit;
+		glActiveTexture(GL_TEXTURE0 + unit);
+	}
+
+	if(isTracked) CM_GL_STATE.textures[unit][slot] = id;
+	glBindTexture(target, id);
+}
+
+void load_gl_state()
+{
+	CM_GL_STATE = (GlState){ .isTracked = true };
+}
+
+void update_gl_state()
+{
+	CM_GL_STATE.lastFrame = CM_GL_STATE.frame;
+	CM_GL_STATE.frame = (GlStateStats){ 0 };
+}
+
+GlStateStats cm_get_gl_state_stats() { return CM_GL_STATE.lastFrame; }
+
+static bool SkipState(GlStateType type, bool isBound)
+{
+	if(!CM_GL_STATE.isTracked) return false;
+
+	if(isBound) CM_GL_STATE.frame.skipped[type]++;
+	else CM_GL_STATE.frame.issued[type]++;
+	return isBound;
+}
+
+static int GetBufferSlot(uint32_t target)
+{
+	switch (target)
+	{
+		case GL_ARRAY_BUFFER: return 0;
+		case GL_UNIFORM_BUFFER: return 1;
+		case GL_SHADER_STORAGE_BUFFER: return 2;
+		case GL_COPY_READ_BUFFER: return 3;
+		case GL_COPY_WRITE_BUFFER: return 4;
+		default: return -1;
+	}
+}
+
+// A deleted object is unbound from the targets of the current context
+static void ForgetBuffer(uint32_t id)
+{
+	for (int i = 0; i < GL_STATE_BUFFER_TARGETS; ++i)
+		if(CM_GL_STATE.buffers[i] == id) CM_GL_STATE.buffers[i] = 0;
+}
+
+static void ForgetTexture(uint32_t id)
+{
+	for (int i = 0; i < MAX_TRACKED_TEXTURE_UNITS; ++i)
+	{
+		if(CM_GL_STATE.textures[i][0] == id) CM_GL_STATE.textures[i][0] = 0;
+		if(CM_GL_STATE.textures[i][1] == id) CM_GL_STATE.textures[i][1] = 0;
+	}
+}
+
+//endregion
@@ -21,13 +21,33 @@ typedef enum ColorMask
 const char *get_pixel_format_name(unsigned int format);
 unsigned int load_texture(const void *data, int width, int height,
                           TextureFlags wrap, TextureFlags filter, int format, int mipmapCount);
+unsigned int load_texture_array(const void *data, int width, int height, int layers,
+                                TextureFlags wrap, TextureFlags filter, int format, int storeFormat, int mipmapCount);
+void *read_compressed_texture_array(unsigned int id, int width, int height, int layers, int format, int mipmapCount, int *dataSize);   // NULL if it isn't stored in format
+uint64_t get_texture_array_data_size(int width, int height, int layers, int format, int mipmapCount);   // Every level, 0 for an unknown format
 void get_gl_texture_formats(int format, unsigned int *glInternalFormat, unsigned int *glFormat, unsigned int *glType);
+Shader load_shader(const char *vsCode, const char *fsCode, double *savedTime);   // savedTime is set when a cached binary was used
 unsigned int compile_shader(const char *shaderCode, int type);
 unsigned int load_shader_program(unsigned int vShaderId, unsigned int fShaderId);
 void unload_shader_program(unsigned int id);
 
 void unload_ubos();
 
+// Bindings go through a cache of the current context, calls that would not change anything are skipped
+void use_program(unsigned int id);
+void bind_vertex_array(unsigned int id);
+void bind_buffer(unsigned int target, unsigned int id);
+void bind_buffer_base(unsigned int target, unsigned int index, unsigned int id);
+void bind_texture(unsigned int unit, unsigned int target, unsigned int id);
+void load_gl_state();     // Tracks the context current on the calling thread, fresh contexts only
+void update_gl_state();   // Ends the frame of the counters
+
+void load_staging_ring();
+void update_staging_ring();
+void unload_staging_ring();
+
+void update_upload_thread();
+
 void set_line_width(float width);
 float get_line_width(void);
 void enable_smooth_lines(void);
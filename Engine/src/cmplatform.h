@@ -130,6 +130,10 @@ void hide_cursor(void);
 void enable_cursor(void);
 void disable_cursor(void);
 void swap_screen_buffer(void);
+void* get_proc_address(const char* name);
+void* create_shared_context(void);
+void make_context_current(void* context);
+void destroy_shared_context(void* context);
 double get_time(void);
 int set_gamepad_mappings(const char *mappings);
 void set_mouse_position(int x, int y);
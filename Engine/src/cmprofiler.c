@@ -0,0 +1,345 @@
+#include "cmprofiler.h"
+
+#ifdef ENABLE_PROFILER
+#include <glad/glad.h>
+#include <pthread.h>
+#include "cmplatform.h"
+
+#define PROFILE_GPU_TRACK MAX_PROFILE_THREADS
+
+typedef struct
+{
+	const char* name;
+	ProfileCategory category;
+	uint32_t thread;
+	double start;               // Seconds since the profiler was loaded
+	double duration;
+}ProfileEvent;
+
+typedef struct
+{
+	const char* name;
+	ProfileCategory category;
+	double start;
+}ProfileScope;
+
+typedef struct
+{
+	const char* name;
+	uint32_t query;
+	double start;               // CPU time the commands of the pass were issued
+}ProfileGpuPass;
+
+typedef struct
+{
+	const char* name;
+	ProfileCategory category;
+	double total;               // Seconds since the overlay was last refreshed
+}ProfileSummary;
+
+typedef struct
+{
+	bool isLoaded;
+	double startTime;
+	pthread_mutex_t lock;
+
+	ProfileEvent* events;
+	uint32_t eventCount;
+	uint32_t droppedCount;
+
+	char threadNames[MAX_PROFILE_THREADS][32];
+	uint32_t threadCount;
+
+	ProfileGpuPass gpuPasses[MAX_PROFILE_GPU_PASSES];
+	uint32_t firstGpuPass;
+	uint32_t gpuPassCount;
+	bool isGpuPassRunning;
+	double gpuTrackEnd;
+
+	ProfileSummary summaries[MAX_PROFILE_SUMMARIES];
+	uint32_t summaryCount;
+	uint32_t summaryFrames;
+	bool isOverlayShown;
+	char baseTitle[128];
+	char overlayTitle[512];
+}Profiler;
+
+typedef struct
+{
+	int32_t id;
+	ProfileScope scopes[MAX_PROFILE_SCOPE_DEPTH];
+	uint32_t depth;
+}ProfileThread;
+
+Profiler CM_PROFILER = { 0 };
+static _Thread_local ProfileThread cmProfileThread = { .id = -1 };
+
+static int32_t GetThreadId();
+static void AddEvent(const char* name, ProfileCategory category, uint32_t thread, double start, double duration);
+static void AddSummary(const char* name, ProfileCategory category, double duration);
+static void CollectGpuPasses();
+static void RefreshOverlay();
+
+void load_profiler(const char* title)
+{
+	Profiler* profiler = &CM_PROFILER;
+
+	pthread_mutex_init(&profiler->lock, NULL);
+	profiler->events = CM_MALLOC(MAX_PROFILE_EVENTS * sizeof(ProfileEvent));
+	profiler->startTime = cm_get_time();
+	snprintf(profiler->baseTitle, sizeof(profiler->baseTitle), "%s", title);
+
+	for (uint32_t i = 0; i < MAX_PROFILE_GPU_PASSES; ++i)
+		glGenQueries(1, &profiler->gpuPasses[i].query);
+
+	profiler->isLoaded = true;
+	cm_set_profile_thread_name("Main");
+	cm_begin_profile_scope("Frame", CM_PROFILE_CPU);
+}
+
+void update_profiler()
+{
+	Profiler* profiler = &CM_PROFILER;
+	if(!profiler->isLoaded) return;
+
+	// Every scope left open by the frame is closed with it
+	while(cmProfileThread.depth > 1) cm_end_profile_scope();
+	cm_end_profile_scope();
+
+	CollectGpuPasses();
+
+	if(++profiler->summaryFrames >= PROFILE_OVERLAY_FRAMES)
+	{
+		if(profiler->isOverlayShown) RefreshOverlay();
+
+		for (uint32_t i = 0; i < profiler->summaryCount; ++i) profiler->summaries[i].total = 0;
+		profiler->summaryFrames = 0;
+	}
+
+	cm_begin_profile_scope("Frame", CM_PROFILE_CPU);
+}
+
+void unload_profiler()
+{
+	Profiler* profiler = &CM_PROFILER;
+	if(!profiler->isLoaded) return;
+
+	while(cmProfileThread.depth > 0) cm_end_profile_scope();
+	if(profiler->isGpuPassRunning) cm_end_gpu_pass();
+
+	// The last frames are waited on, their passes belong in the trace
+	glFinish();
+	CollectGpuPasses();
+
+	if(profiler->droppedCount > 0)
+		log_warn("Profiler: %u events dropped, the buffer holds %u\n", profiler->droppedCount, MAX_PROFILE_EVENTS);
+
+	cm_save_profile_trace(PROFILE_TRACE_PATH);
+
+	for (uint32_t i = 0; i < MAX_PROFILE_GPU_PASSES; ++i)
+		glDeleteQueries(1, &profiler->gpuPasses[i].query);
+
+	if(profiler->isOverlayShown) set_window_title(profiler->baseTitle);
+
+	profiler->isLoaded = false;
+	CM_FREE(profiler->events);
+	profiler->events = NULL;
+	pthread_mutex_destroy(&profiler->lock);
+}
+
+void cm_begin_profile_scope(const char* name, ProfileCategory category)
+{
+	ProfileThread* thread = &cmProfileThread;
+	if(!CM_PROFILER.isLoaded || GetThreadId() < 0) return;
+
+	// Scopes deeper than the stack are not traced, their end still has to be balanced
+	if(thread->depth < MAX_PROFILE_SCOPE_DEPTH)
+		thread->scopes[thread->depth] = (ProfileScope){ .name = name, .category = category, .start = cm_get_time() };
+	thread->depth++;
+}
+
+void cm_end_profile_scope()
+{
+	ProfileThread* thread = &cmProfileThread;
+	if(!CM_PROFILER.isLoaded || thread->depth == 0) return;
+
+	thread->depth--;
+	if(thread->depth >= MAX_PROFILE_SCOPE_DEPTH) return;
+
+	ProfileScope* scope = &thread->scopes[thread->depth];
+	double duration = cm_get_time() - scope->start;
+	AddEvent(scope->name, scope->category, thread->id, scope->start - CM_PROFILER.startTime, duration);
+
+	// The overlay sums the top level scopes of the main thread, the frame itself included
+	if(thread->id == 0 && thread->depth <= 1) AddSummary(scope->name, scope->category, duration);
+}
+
+void cm_begin_gpu_pass(const char* name)
+{
+	Profiler* profiler = &CM_PROFILER;
+	if(!profiler->isLoaded || profiler->isGpuPassRunning || profiler->gpuPassCount == MAX_PROFILE_GPU_PASSES) return;
+
+	ProfileGpuPass* pass = &profiler->gpuPasses[(profiler->firstGpuPass + profiler->gpuPassCount) % MAX_PROFILE_GPU_PASSES];
+	pass->name = name;
+	pass->start = cm_get_time() - profiler->startTime;
+
+	glBeginQuery(GL_TIME_ELAPSED, pass->query);
+	profiler->isGpuPassRunning = true;
+}
+
+void cm_end_gpu_pass()
+{
+	Profiler* profiler = &CM_PROFILER;
+	if(!profiler->isGpuPassRunning) return;
+
+	glEndQuery(GL_TIME_ELAPSED);
+	profiler->isGpuPassRunning = false;
+	profiler->gpuPassCount++;
+}
+
+void cm_set_profile_thread_name(const char* name)
+{
+	int32_t id = GetThreadId();
+	if(id < 0) return;
+
+	pthread_mutex_lock(&CM_PROFILER.lock);
+	snprintf(CM_PROFILER.threadNames[id], sizeof(CM_PROFILER.threadNames[id]), "%s", name);
+	pthread_mutex_unlock(&CM_PROFILER.lock);
+}
+
+void cm_toggle_profile_overlay()
+{
+	Profiler* profiler = &CM_PROFILER;
+	profiler->isOverlayShown = !profiler->isOverlayShown;
+	if(!profiler->isOverlayShown) set_window_title(profiler->baseTitle);
+}
+
+bool cm_save_profile_trace(const char* filePath)
+{
+	Profiler* profiler = &CM_PROFILER;
+	if(!profiler->isLoaded) return false;
+
+	FILE* file = fopen(filePath, "w");
+	if(file == NULL)
+	{
+		log_error("Unable to write the profile trace %s\n", filePath);
+		return false;
+	}
+
+	pthread_mutex_lock(&profiler->lock);
+
+	static const char* categories[] = { "cpu", "gpu", "job" };
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"GPU\"}}", PROFILE_GPU_TRACK);
+
+	for (uint32_t i = 0; i < profiler->threadCount; ++i)
+		fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+		        i, profiler->threadNames[i]);
+
+	for (uint32_t i = 0; i < profiler->eventCount; ++i)
+	{
+		ProfileEvent* event = &profiler->events[i];
+		fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+		        event->name, categories[event->category], event->thread, event->start * 1e6, event->duration * 1e6);
+	}
+
+	fprintf(file, "\n]}\n");
+	uint32_t eventCount = profiler->eventCount;
+	pthread_mutex_unlock(&profiler->lock);
+
+	fclose(file);
+	log_info("Profiler: %u events written to %s\n", eventCount, filePath);
+	return true;
+}
+
+//Threads are numbered in the order they first record, the first one is the main thread
+static int32_t GetThreadId()
+{
+	ProfileThread* thread = &cmProfileThread;
+	if(thread->id >= 0) return thread->id;
+
+	pthread_mutex_lock(&CM_PROFILER.lock);
+	if(CM_PROFILER.threadCount < MAX_PROFILE_THREADS)
+	{
+		thread->id = (int32_t)CM_PROFILER.threadCount++;
+		snprintf(CM_PROFILER.threadNames[thread->id], sizeof(CM_PROFILER.threadNames[thread->id]), "Thread %i", thread->id);
+	}
+	pthread_mutex_unlock(&CM_PROFILER.lock);
+
+	return thread->id;
+}
+
+static void AddEvent(const char* name, ProfileCategory category, uint32_t thread, double start, double duration)
+{
+	Profiler* profiler = &CM_PROFILER;
+	pthread_mutex_lock(&profiler->lock);
+
+	if(profiler->eventCount < MAX_PROFILE_EVENTS)
+		profiler->events[profiler->eventCount++] = (ProfileEvent){ name, category, thread, start, duration };
+	else profiler->droppedCount++;
+
+	pthread_mutex_unlock(&profiler->lock);
+}
+
+//Main thread only
+static void AddSummary(const char* name, ProfileCategory category, double duration)
+{
+	Profiler* profiler = &CM_PROFILER;
+	for (uint32_t i = 0; i < profiler->summaryCount; ++i)
+	{
+		ProfileSummary* summary = &profiler->summaries[i];
+		if(summary->category != category || (summary->name != name && strcmp(summary->name, name) != 0)) continue;
+
+		summary->total += duration;
+		return;
+	}
+
+	if(profiler->summaryCount < MAX_PROFILE_SUMMARIES)
+		profiler->summaries[profiler->summaryCount++] = (ProfileSummary){ name, category, duration };
+}
+
+//Queries are read in issue order without stalling, the GPU track keeps the passes from overlapping
+static void CollectGpuPasses()
+{
+	Profiler* profiler = &CM_PROFILER;
+	while(profiler->gpuPassCount > 0)
+	{
+		ProfileGpuPass* pass = &profiler->gpuPasses[profiler->firstGpuPass];
+
+		GLint isAvailable = 0;
+		glGetQueryObjectiv(pass->query, GL_QUERY_RESULT_AVAILABLE, &isAvailable);
+		if(!isAvailable) break;
+
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(pass->query, GL_QUERY_RESULT, &elapsed);
+
+		double duration = (double)elapsed / 1e9;
+		double start = pass->start > profiler->gpuTrackEnd ? pass->start : profiler->gpuTrackEnd;
+		profiler->gpuTrackEnd = start + duration;
+
+		AddEvent(pass->name, CM_PROFILE_GPU, PROFILE_GPU_TRACK, start, duration);
+		AddSummary(pass->name, CM_PROFILE_GPU, duration);
+
+		profiler->firstGpuPass = (profiler->firstGpuPass + 1) % MAX_PROFILE_GPU_PASSES;
+		profiler->gpuPassCount--;
+	}
+}
+
+static void RefreshOverlay()
+{
+	Profiler* profiler = &CM_PROFILER;
+	char* title = profiler->overlayTitle;
+	size_t size = sizeof(profiler->overlayTitle);
+	int length = snprintf(title, size, "%s", profiler->baseTitle);
+
+	for (uint32_t i = 0; i < profiler->summaryCount && length < (int)size; ++i)
+	{
+		ProfileSummary* summary = &profiler->summaries[i];
+		length += snprintf(title + length, size - length, " | %s%s %.2f ms", summary->category == CM_PROFILE_GPU ? "gpu " : "",
+		                   summary->name, summary->total * 1000.0 / profiler->summaryFrames);
+	}
+
+	set_window_title(title);
+}
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef CMPROFILER_H
+#define CMPROFILER_H
+
+#include "coal_miner.h"
+
+//Every thread records complete spans into one event buffer, the frame boundary collects the GPU passes
+//whose queries finished and refreshes the overlay. Without ENABLE_PROFILER these calls compile to nothing.
+#ifdef ENABLE_PROFILER
+void load_profiler(const char* title);   // Main thread, after the GL context
+void update_profiler();                  // End of the frame
+void unload_profiler();                  // Writes the trace to PROFILE_TRACE_PATH, before the GL context is destroyed
+#else
+#define load_profiler(title) ((void)0)
+#define update_profiler() ((void)0)
+#define unload_profiler() ((void)0)
+#endif
+
+#endif //CMPROFILER_H
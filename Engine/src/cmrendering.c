@@ -1,6 +1,7 @@
 #include "cmrendering.h"
 #include "coal_miner.h"
 #include "cmgl.h"
+#include "cmreplay.h"
 
 struct CameraUbo
 {
@@ -41,6 +42,8 @@ void load_renderer(Window* wPtr)
 {
 	CM_RN_WIN_P = wPtr;
 	
+	// The ubos are ring buffered only when the staging ring fences the frames
+	load_staging_ring();
 	cm_load_ubo("Camera", CAMERA_UBO_BINDING_ID, sizeof(struct CameraUbo), &CM_CAMERA_UBO);
 	cm_load_ubo("GlobalLight", GLOBAL_LIGHT_UBO_BINDING_ID, sizeof(struct GlobalLightUbo), &CM_GLOBAL_LIGHT_UBO);
 	
@@ -49,6 +52,8 @@ void load_renderer(Window* wPtr)
 
 void unload_renderer()
 {
+	cm_unload_upload_thread();
+	unload_staging_ring();
 	cm_unload_vao(cmQuad);
 	unload_ubos();
 }
@@ -56,11 +61,13 @@ void unload_renderer()
 void cm_begin_mode_3d(Camera3D camera)
 {
 	float aspect = (float)CM_RN_WIN_P->currentFbo.width / (float)CM_RN_WIN_P->currentFbo.height;
+	struct CameraUbo ubo;
+	memset(&ubo, 0, sizeof(struct CameraUbo));   // Padding included, the block is compared bytewise
 
 	// NOTE: zNear and zFar values are important when computing depth buffer values
 	if (camera.projection == CAMERA_PERSPECTIVE)
 	{
-		glm_perspective(glm_rad(camera.fov), aspect, camera.nearPlane, camera.farPlane, CM_CAMERA_UBO.projection);
+		glm_perspective(glm_rad(camera.fov), aspect, camera.nearPlane, camera.farPlane, ubo.projection);
 	}
 	else if (camera.projection == CAMERA_ORTHOGRAPHIC)
 	{
@@ -68,19 +75,26 @@ void cm_begin_mode_3d(Camera3D camera)
 		float top = camera.fov * .5f;
 		float right = top*aspect;
 
-		glm_ortho(-right, right, -top, top, camera.nearPlane, camera.farPlane, CM_CAMERA_UBO.projection);
+		glm_ortho(-right, right, -top, top, camera.nearPlane, camera.farPlane, ubo.projection);
 	}
 	
 	glm_normalize(camera.direction);
+	capture_replay_camera(&camera);
 	
-	glm_look(camera.position, camera.direction, camera.up, CM_CAMERA_UBO.view);
-	glm_mat4_mul(CM_CAMERA_UBO.projection, CM_CAMERA_UBO.view, CM_CAMERA_UBO.viewProjection);
+	glm_look(camera.position, camera.direction, camera.up, ubo.view);
+	glm_mat4_mul(ubo.projection, ubo.view, ubo.viewProjection);
 
-	glm_vec3_copy(camera.position, CM_CAMERA_UBO.position);
-	glm_vec3_copy(camera.direction, CM_CAMERA_UBO.direction);
+	glm_vec3_copy(camera.position, ubo.position);
+	glm_vec3_copy(camera.direction, ubo.direction);
 	
 	cm_enable_depth_test();
 
+	// A camera that did not move is not uploaded again
+	if(memcmp(&ubo, &CM_CAMERA_UBO, sizeof(struct CameraUbo)) == 0) return;
+
+	memcpy(&CM_CAMERA_UBO, &ubo, sizeof(struct CameraUbo));
+	cm_mark_ubo_dirty(&CM_CAMERA_UBO);
+
 	vec4 planes[6];
 	glm_frustum_planes(CM_CAMERA_UBO.viewProjection, planes);
 	
@@ -90,9 +104,16 @@ void cm_begin_mode_3d(Camera3D camera)
 
 void cm_set_global_light(GlobalLight light)
 {
-	glm_vec3_copy(light.direction, CM_GLOBAL_LIGHT_UBO.direction);
-	glm_vec3_copy(light.color, CM_GLOBAL_LIGHT_UBO.color);
-	CM_GLOBAL_LIGHT_UBO.color[3] = light.luminosity;
+	struct GlobalLightUbo ubo;
+	memset(&ubo, 0, sizeof(struct GlobalLightUbo));
+	glm_vec3_copy(light.direction, ubo.direction);
+	glm_vec3_copy(light.color, ubo.color);
+	ubo.color[3] = light.luminosity;
+
+	if(memcmp(&ubo, &CM_GLOBAL_LIGHT_UBO, sizeof(struct GlobalLightUbo)) == 0) return;
+
+	memcpy(&CM_GLOBAL_LIGHT_UBO, &ubo, sizeof(struct GlobalLightUbo));
+	cm_mark_ubo_dirty(&CM_GLOBAL_LIGHT_UBO);
 }
 
 void cm_end_mode_3d()
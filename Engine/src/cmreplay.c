@@ -0,0 +1,282 @@
+#include "cmreplay.h"
+#include "cmtime.h"
+
+#define REPLAY_MAGIC "CMRP"
+#define REPLAY_VERSION 1
+
+// NOTE: Fields are written one by one, the file has no padding and only depends on the byte order
+// Frame: camera position and direction (6 floats), mouse position and wheel (4 floats), mouse buttons (1 byte),
+// changed key count (uint16) and the changed keys (uint16 each), a key state flips every time it is listed
+typedef struct
+{
+	vec3 cameraPosition;
+	vec3 cameraDirection;
+	vec2 mousePosition;
+	vec2 wheelMove;
+	uint8_t mouseButtons;
+	char keys[MAX_KEYBOARD_KEYS];
+}ReplayFrame;
+
+typedef struct
+{
+	Window* window;
+	Input* input;
+	bool isRecording;
+	bool isReplaying;
+
+	FILE* file;
+	uint32_t frameCount;        // Frames written or applied
+	ReplayFrame frame;          // Next frame to apply, or the last one written
+	Camera3D camera;            // Camera of the frame being recorded
+
+	FILE* timings;
+	uint32_t timedFrameCount;
+	double lastFrameEnd;
+	double* frameTimes;
+	uint32_t frameTimeCapacity;
+}Replay;
+
+Replay CM_REPLAY = { 0 };
+
+static bool ReadFrame(ReplayFrame* frame);
+static void WriteFrame(ReplayFrame* frame);
+static void RecordTiming();
+static void LogTimingSummary();
+static int CompareTimes(const void* a, const void* b);
+
+void load_replay(Window* window, Input* input)
+{
+	CM_REPLAY.window = window;
+	CM_REPLAY.input = input;
+}
+
+void begin_replay(const char* recordPath, const char* replayPath, const char* timingsPath)
+{
+	Replay* replay = &CM_REPLAY;
+	memset(&replay->frame, 0, sizeof(ReplayFrame));
+	replay->frameCount = 0;
+	replay->timedFrameCount = 0;
+
+	if(replayPath != NULL)
+	{
+		replay->file = fopen(replayPath, "rb");
+		char magic[4];
+		uint32_t version = 0;
+		if(replay->file == NULL || fread(magic, 1, 4, replay->file) != 4 || memcmp(magic, REPLAY_MAGIC, 4) != 0 ||
+		   fread(&version, sizeof(uint32_t), 1, replay->file) != 1 || version != REPLAY_VERSION)
+		{
+			log_error("Unable to replay %s, not a version %i recording", replayPath, REPLAY_VERSION);
+			if(replay->file != NULL) fclose(replay->file);
+			replay->file = NULL;
+		}
+		else if(ReadFrame(&replay->frame))
+		{
+			replay->isReplaying = true;
+			set_fixed_frame_time(FIXED_TIME_STEP);
+			log_info("Replaying %s", replayPath);
+		}
+	}
+	else if(recordPath != NULL)
+	{
+		replay->file = fopen(recordPath, "wb");
+		if(replay->file == NULL) log_error("Unable to record to %s", recordPath);
+		else
+		{
+			uint32_t version = REPLAY_VERSION;
+			fwrite(REPLAY_MAGIC, 1, 4, replay->file);
+			fwrite(&version, sizeof(uint32_t), 1, replay->file);
+			replay->isRecording = true;
+			log_info("Recording to %s", recordPath);
+		}
+	}
+
+	if(timingsPath != NULL)
+	{
+		replay->timings = fopen(timingsPath, "w");
+		if(replay->timings == NULL) log_warn("Unable to open %s, frame timings are not written", timingsPath);
+		else fprintf(replay->timings, "frame,time,frame_ms,work_ms\n");
+	}
+
+	replay->lastFrameEnd = get_time();
+}
+
+void update_replay()
+{
+	Replay* replay = &CM_REPLAY;
+	if(replay->timings != NULL) RecordTiming();
+
+	Input* input = replay->input;
+	ReplayFrame* frame = &replay->frame;
+
+	if(replay->isRecording)
+	{
+		glm_vec3_copy(replay->camera.position, frame->cameraPosition);
+		glm_vec3_copy(replay->camera.direction, frame->cameraDirection);
+		WriteFrame(frame);
+		replay->frameCount++;
+	}
+	else if(replay->isReplaying)
+	{
+		// The polled state is replaced, the previous state already holds the frame applied before
+		memcpy(input->Keyboard.currentKeyState, frame->keys, MAX_KEYBOARD_KEYS);
+		memset(input->Keyboard.keyRepeatInFrame, 0, MAX_KEYBOARD_KEYS);
+		input->Keyboard.keyPressedQueueCount = 0;
+		input->Keyboard.charPressedQueueCount = 0;
+
+		for (uint32_t i = 0; i < MAX_MOUSE_BUTTONS; ++i)
+			input->Mouse.currentButtonState[i] = (char)((frame->mouseButtons >> i) & 1);
+		glm_vec2_copy(frame->mousePosition, input->Mouse.currentPosition);
+		glm_vec2_copy(frame->wheelMove, input->Mouse.currentWheelMove);
+		replay->frameCount++;
+
+		if(!ReadFrame(frame))
+		{
+			log_info("Replay finished after %u frames", replay->frameCount);
+			replay->isReplaying = false;
+			replay->window->shouldClose = true;
+		}
+	}
+}
+
+void capture_replay_camera(const Camera3D* camera)
+{
+	if(CM_REPLAY.isRecording) CM_REPLAY.camera = *camera;
+}
+
+void unload_replay()
+{
+	Replay* replay = &CM_REPLAY;
+
+	if(replay->file != NULL)
+	{
+		if(replay->isRecording) log_info("Recorded %u frames", replay->frameCount);
+		fclose(replay->file);
+		replay->file = NULL;
+	}
+
+	if(replay->timings != NULL)
+	{
+		LogTimingSummary();
+		fclose(replay->timings);
+		replay->timings = NULL;
+	}
+
+	replay->isRecording = false;
+	replay->isReplaying = false;
+	CM_FREE(replay->frameTimes);
+	replay->frameTimes = NULL;
+	replay->frameTimeCapacity = 0;
+}
+
+bool cm_is_replaying() { return CM_REPLAY.isReplaying; }
+
+bool cm_replay_camera(Camera3D* camera)
+{
+	if(!CM_REPLAY.isReplaying) return false;
+
+	glm_vec3_copy(CM_REPLAY.frame.cameraPosition, camera->position);
+	glm_vec3_copy(CM_REPLAY.frame.cameraDirection, camera->direction);
+	return true;
+}
+
+//region Local Functions
+
+static bool ReadFrame(ReplayFrame* frame)
+{
+	FILE* file = CM_REPLAY.file;
+	uint16_t changedCount;
+
+	if(fread(frame->cameraPosition, sizeof(float), 3, file) != 3 ||
+	   fread(frame->cameraDirection, sizeof(float), 3, file) != 3 ||
+	   fread(frame->mousePosition, sizeof(float), 2, file) != 2 ||
+	   fread(frame->wheelMove, sizeof(float), 2, file) != 2 ||
+	   fread(&frame->mouseButtons, sizeof(uint8_t), 1, file) != 1 ||
+	   fread(&changedCount, sizeof(uint16_t), 1, file) != 1) return false;
+
+	for (uint32_t i = 0; i < changedCount; ++i)
+	{
+		uint16_t key;
+		if(fread(&key, sizeof(uint16_t), 1, file) != 1 || key >= MAX_KEYBOARD_KEYS) return false;
+		frame->keys[key] = !frame->keys[key];
+	}
+
+	return true;
+}
+
+// The frame keeps the key states written last, only the keys that changed since are listed
+static void WriteFrame(ReplayFrame* frame)
+{
+	FILE* file = CM_REPLAY.file;
+	Input* input = CM_REPLAY.input;
+
+	uint16_t changedKeys[MAX_KEYBOARD_KEYS];
+	uint16_t changedCount = 0;
+	for (uint16_t i = 0; i < MAX_KEYBOARD_KEYS; ++i)
+	{
+		char state = input->Keyboard.currentKeyState[i] != 0;
+		if(state == frame->keys[i]) continue;
+
+		frame->keys[i] = state;
+		changedKeys[changedCount++] = i;
+	}
+
+	frame->mouseButtons = 0;
+	for (uint32_t i = 0; i < MAX_MOUSE_BUTTONS; ++i)
+		if(input->Mouse.currentButtonState[i]) frame->mouseButtons |= (uint8_t)(1 << i);
+	glm_vec2_copy(input->Mouse.currentPosition, frame->mousePosition);
+	glm_vec2_copy(input->Mouse.currentWheelMove, frame->wheelMove);
+
+	fwrite(frame->cameraPosition, sizeof(float), 3, file);
+	fwrite(frame->cameraDirection, sizeof(float), 3, file);
+	fwrite(frame->mousePosition, sizeof(float), 2, file);
+	fwrite(frame->wheelMove, sizeof(float), 2, file);
+	fwrite(&frame->mouseButtons, sizeof(uint8_t), 1, file);
+	fwrite(&changedCount, sizeof(uint16_t), 1, file);
+	fwrite(changedKeys, sizeof(uint16_t), changedCount, file);
+}
+
+// Frame time is the wall time between two polls, work time the part spent before the frame pacing wait
+static void RecordTiming()
+{
+	Replay* replay = &CM_REPLAY;
+	double time = get_time();
+	double frameTime = time - replay->lastFrameEnd;
+	replay->lastFrameEnd = time;
+
+	uint32_t frame = replay->timedFrameCount++;
+	if(frame >= replay->frameTimeCapacity)
+	{
+		uint32_t capacity = replay->frameTimeCapacity == 0 ? 1024 : replay->frameTimeCapacity * 2;
+		double* frameTimes = CM_REALLOC(replay->frameTimes, capacity * sizeof(double));
+		if(frameTimes == NULL) return;
+
+		replay->frameTimes = frameTimes;
+		replay->frameTimeCapacity = capacity;
+	}
+
+	replay->frameTimes[frame] = frameTime;
+	fprintf(replay->timings, "%u,%.6f,%.3f,%.3f\n", frame, cm_time_since_start(), frameTime * 1000.0, cm_frame_time() * 1000.0);
+}
+
+static void LogTimingSummary()
+{
+	Replay* replay = &CM_REPLAY;
+	uint32_t count = replay->timedFrameCount < replay->frameTimeCapacity ? replay->timedFrameCount : replay->frameTimeCapacity;
+	if(count == 0) return;
+
+	double total = 0;
+	for (uint32_t i = 0; i < count; ++i) total += replay->frameTimes[i];
+	qsort(replay->frameTimes, count, sizeof(double), CompareTimes);
+
+	log_info("Frames: %u, Total: %.3f s, Mean: %.3f ms, p50: %.3f ms, p99: %.3f ms, Max: %.3f ms", count, total,
+	         total * 1000.0 / count, replay->frameTimes[(count - 1) / 2] * 1000.0,
+	         replay->frameTimes[(count - 1) * 99 / 100] * 1000.0, replay->frameTimes[count - 1] * 1000.0);
+}
+
+static int CompareTimes(const void* a, const void* b)
+{
+	double da = *(const double*)a, db = *(const double*)b;
+	return (da > db) - (da < db);
+}
+
+//endregion
@@ -0,0 +1,14 @@
+#ifndef CMREPLAY_H
+#define CMREPLAY_H
+
+#include "cmplatform.h"
+
+//A recording holds, for every frame after the loading, the camera it rendered with and the inputs polled at its end.
+//A replay runs one FIXED_TIME_STEP per frame without pacing and applies the recorded inputs over the polled ones.
+void load_replay(Window* window, Input* input);
+void begin_replay(const char* recordPath, const char* replayPath, const char* timingsPath);   // First frame after the loading
+void update_replay();                                   // After the inputs are polled
+void capture_replay_camera(const Camera3D* camera);     // Camera of the frame being recorded
+void unload_replay();                                   // Closes the files, logs the frame time summary
+
+#endif //CMREPLAY_H
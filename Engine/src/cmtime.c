@@ -8,52 +8,86 @@
 #include <unistd.h>
 #include <time.h>
 #endif
-#include <glfw/glfw3.h>
 
 typedef struct Time
 {
 	double deltaTime;
 	double timeSinceStart;
 	double timeScale;
-	unsigned int targetFrameRate;
+	unsigned int targetFrameRate;       // 0 for no limit
 	unsigned long frameCount;
 	double lastFrameTime;
-	double frameRecordTime;
 	unsigned int frameRate;
 
+	double frameDeadline;               // Absolute time the current frame should end
+	double spinTime;                    // Seconds before the deadline spent spinning instead of sleeping
+	bool isAdaptivePacing;
+
+	double frameTimes[FRAME_TIME_HISTORY];
+	double frameTimeSum;
+	unsigned int nextFrameTime;
+	unsigned int frameTimeCount;
+
+	double fixedAccumulator;            // Simulated time not yet covered by a fixed update
+	double fixedFrameTime;              // Delta of every frame when not 0, frames are then not paced
+	float interpolationAlpha;
+	unsigned long fixedStepCount;
+
 	void* platformPtr;
 }Time;
 
-Time TIME = { 0, 0, 1, 60, 0, 0, 0, 0 };
+Time TIME = { .timeScale = 1, .targetFrameRate = 60, .spinTime = FRAME_PACING_SPIN_TIME };
+
+static void WaitFrameDeadline(double now);
+static void RecordFrameTime(double frameTime);
+static int CompareFrameTimes(const void* a, const void* b);
 
 void load_time(Window* ptr)
 {
 	TIME.platformPtr = ptr;
-	TIME.timeSinceStart = glfwGetTime();
-	TIME.frameRecordTime = TIME.timeSinceStart;
+	TIME.timeSinceStart = get_time();
+	TIME.frameDeadline = TIME.timeSinceStart;
 
 	srand(time(0));
 }
 
 void update_time()
 {
-	double newTime = glfwGetTime();
-	TIME.lastFrameTime = newTime - TIME.timeSinceStart;
+	double frameStart = TIME.timeSinceStart;
+	double newTime = get_time();
+	TIME.lastFrameTime = newTime - frameStart;
 
-	double sleepTime = (1.0 / (double)TIME.targetFrameRate) - TIME.lastFrameTime;
-	if(sleepTime >= 0.001) cm_sleep(sleepTime);
+	if(TIME.targetFrameRate > 0 && TIME.fixedFrameTime == 0) WaitFrameDeadline(newTime);
 
-	newTime = glfwGetTime();
+	newTime = get_time();
 
-	TIME.deltaTime = newTime - TIME.timeSinceStart;
+	TIME.deltaTime = TIME.fixedFrameTime > 0 ? TIME.fixedFrameTime : newTime - frameStart;
 	TIME.timeSinceStart = newTime;
 	TIME.frameCount++;
+	RecordFrameTime(newTime - frameStart);
+}
 
-	if(TIME.frameCount % FRAME_RATE_RECORD_RATE == 0)
-	{
-		TIME.frameRate = (unsigned int)(1.0 / ((TIME.timeSinceStart - TIME.frameRecordTime) / (double)FRAME_RATE_RECORD_RATE));
-		TIME.frameRecordTime = TIME.timeSinceStart;
-	}
+void set_fixed_frame_time(double frameTime)
+{
+	TIME.fixedFrameTime = frameTime;
+	TIME.fixedAccumulator = 0;
+	if(frameTime > 0) TIME.deltaTime = frameTime;
+	TIME.frameDeadline = get_time();
+}
+
+uint32_t consume_fixed_steps()
+{
+	TIME.fixedAccumulator += TIME.deltaTime;
+
+	uint32_t steps = (uint32_t)(TIME.fixedAccumulator / FIXED_TIME_STEP);
+	TIME.fixedAccumulator -= steps * FIXED_TIME_STEP;
+
+	// A stalled frame runs a bounded catch up instead of spiralling, the remaining time is lost
+	if(steps > MAX_FIXED_STEPS_PER_FRAME) steps = MAX_FIXED_STEPS_PER_FRAME;
+
+	TIME.interpolationAlpha = (float)(TIME.fixedAccumulator / FIXED_TIME_STEP);
+	TIME.fixedStepCount += steps;
+	return steps;
 }
 
 void cm_sleep(double sleepTime)
@@ -75,6 +109,91 @@ float cm_delta_time_f() { return (float)TIME.deltaTime; }
 double cm_delta_time() { return TIME.deltaTime; }
 double cm_time_since_start() { return TIME.timeSinceStart; }
 unsigned int cm_get_target_frame_rate() { return TIME.targetFrameRate; }
-void cm_set_target_frame_rate(unsigned int t) { TIME.targetFrameRate = t; }
+void cm_set_target_frame_rate(unsigned int t)
+{
+	TIME.targetFrameRate = t;
+	TIME.frameDeadline = get_time();
+}
+
+float cm_fixed_delta_time_f() { return (float)FIXED_TIME_STEP; }
+double cm_fixed_delta_time() { return FIXED_TIME_STEP; }
+float cm_interpolation_alpha() { return TIME.interpolationAlpha; }
+unsigned long cm_fixed_step_count() { return TIME.fixedStepCount; }
+
 unsigned int cm_frame_rate() { return TIME.frameRate; }
-double cm_frame_time() { return TIME.lastFrameTime; }
\ No newline at end of file
+double cm_frame_time() { return TIME.lastFrameTime; }
+void cm_set_adaptive_frame_pacing(bool isAdaptive) { TIME.isAdaptivePacing = isAdaptive; }
+
+// The clock of the C library instead of the platform one, tools time themselves without opening a window
+double cm_get_time()
+{
+	struct timespec now;
+#ifdef _WIN32
+	timespec_get(&now, TIME_UTC);
+#else
+	clock_gettime(CLOCK_MONOTONIC, &now);
+#endif
+	return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
+
+FrameTimeStats cm_get_frame_time_stats()
+{
+	FrameTimeStats stats = { .count = TIME.frameTimeCount };
+	if(stats.count == 0) return stats;
+
+	double sorted[FRAME_TIME_HISTORY];
+	memcpy(sorted, TIME.frameTimes, stats.count * sizeof(double));
+	qsort(sorted, stats.count, sizeof(double), CompareFrameTimes);
+
+	stats.p50 = sorted[(stats.count - 1) / 2];
+	stats.p99 = sorted[(stats.count - 1) * 99 / 100];
+	stats.max = sorted[stats.count - 1];
+	return stats;
+}
+
+// The deadline moves by whole frames, a late wake up shortens the next frame instead of delaying every later one
+static void WaitFrameDeadline(double now)
+{
+	double frameDuration = 1.0 / (double)TIME.targetFrameRate;
+	TIME.frameDeadline += frameDuration;
+
+	// More than a frame behind, the missed frames are dropped instead of being rushed
+	if(TIME.frameDeadline < now - frameDuration) TIME.frameDeadline = now;
+
+	// NOTE: Sleeps wake up late by the scheduler granularity, the last slice is spun against the deadline
+	double sleepTime = TIME.frameDeadline - now - TIME.spinTime;
+	if(sleepTime >= 0.001)
+	{
+		cm_sleep(sleepTime);
+		double overSleep = get_time() - now - sleepTime;
+
+		// Adaptive pacing spins just longer than the late wake ups, growing at once and shrinking slowly
+		if(TIME.isAdaptivePacing)
+		{
+			if(overSleep > TIME.spinTime) TIME.spinTime = overSleep;
+			else TIME.spinTime -= (TIME.spinTime - overSleep) * FRAME_PACING_SPIN_DECAY;
+			TIME.spinTime = glm_clamp(TIME.spinTime, FRAME_PACING_MIN_SPIN, FRAME_PACING_MAX_SPIN);
+		}
+	}
+
+	while(get_time() < TIME.frameDeadline);
+}
+
+// The frame rate is the average of the same frames as the stats
+static void RecordFrameTime(double frameTime)
+{
+	if(TIME.frameTimeCount == FRAME_TIME_HISTORY) TIME.frameTimeSum -= TIME.frameTimes[TIME.nextFrameTime];
+	else TIME.frameTimeCount++;
+
+	TIME.frameTimes[TIME.nextFrameTime] = frameTime;
+	TIME.frameTimeSum += frameTime;
+	TIME.nextFrameTime = (TIME.nextFrameTime + 1) % FRAME_TIME_HISTORY;
+
+	TIME.frameRate = TIME.frameTimeSum > 0 ? (unsigned int)(TIME.frameTimeCount / TIME.frameTimeSum + .5) : 0;
+}
+
+static int CompareFrameTimes(const void* a, const void* b)
+{
+	double da = *(const double*)a, db = *(const double*)b;
+	return (da > db) - (da < db);
+}
\ No newline at end of file
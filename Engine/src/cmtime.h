@@ -5,6 +5,8 @@
 
 void load_time(Window* ptr);
 void update_time();
+void set_fixed_frame_time(double frameTime);   // Replays simulate the same time every frame, 0 measures it again
+uint32_t consume_fixed_steps();   // Fixed updates due since the last call, sets the interpolation alpha of their result
 
 #ifdef _WIN32
 void __stdcall timeBeginPeriod(unsigned long precision);
@@ -1,15 +1,19 @@
 #include "cmwindow.h"
 #include <glad/glad.h>
-#include <GLFW/glfw3.h>
 #include "cmrendering.h"
+#include "cmgl.h"
 #include "cminput.h"
 #include "cmtime.h"
+#include "cmassets.h"
+#include "cmprofiler.h"
+#include "cmreplay.h"
 
 Window WINDOW;
 Input INPUT;
 
 Image icons[MAX_NUM_APPLICATION_ICONS];
 int iconCount;
+double presentTime;
 
 int FillWithAppIcons(const char* filePath, Image* storeLocation)
 {
@@ -23,19 +27,21 @@ int FillWithAppIcons(const char* filePath, Image* storeLocation)
 		return 0;
 	}
 
+	//Every icon is decoded in parallel before the first one is taken
+	Path iconPaths[MAX_NUM_APPLICATION_ICONS];
 	int imageId = 0;
 	while ((entry = readdir(dir)) && imageId < MAX_NUM_APPLICATION_ICONS)
 	{
 		if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
 
-		Path newPath;
-		snprintf(newPath, MAX_PATH_SIZE, "%s/%s", filePath, entry->d_name);
-
-		storeLocation[imageId] = cm_load_image(newPath);
+		snprintf(iconPaths[imageId], MAX_PATH_SIZE, "%s/%s", filePath, entry->d_name);
+		cm_prefetch_image(iconPaths[imageId]);
 		imageId++;
 	}
 
 	closedir(dir);
+
+	for (int i = 0; i < imageId; ++i) storeLocation[i] = cm_load_image(iconPaths[i]);
 	return imageId;
 }
 
@@ -57,11 +63,14 @@ void create_window(unsigned int width, unsigned int height,
 
 	if(!init_platform(&WINDOW, &INPUT))
 	{
-		log_error("Unable to load glfw window!!!");
+		log_error("Unable to load the platform window!!!");
 		return;
 	}
 
+	load_profiler(WINDOW.title);
+	load_gl_state();
 	load_time(WINDOW.platformHandle);
+	load_startup_assets();
 
 	iconCount = 0;
 
@@ -95,6 +104,7 @@ void create_window(unsigned int width, unsigned int height,
 
 	load_renderer(&WINDOW);
 	load_input(&INPUT);
+	load_replay(&WINDOW, &INPUT);
 }
 
 void set_window_flags(ConfigFlags hint)
@@ -116,13 +126,31 @@ void begin_draw()
 
 void end_draw()
 {
+	present_draw();
+	finish_frame();
+}
+
+void present_draw()
+{
+	update_upload_thread();
+	update_staging_ring();
+	update_gl_state();
 	swap_screen_buffer();
+	presentTime = cm_get_time();
 	update_time();
+}
+
+void finish_frame()
+{
 	poll_input_events();
+	update_replay();
+	update_profiler();
 }
 
 void close_window()
 {
+	unload_profiler();
+	unload_replay();
 	unload_renderer();
 	cm_unload_images(icons, iconCount);
 	WINDOW.ready = false;
@@ -159,5 +187,6 @@ void cm_enable_cursor(void) { enable_cursor(); }
 void cm_disable_cursor(void) { disable_cursor(); }
 void cm_set_mouse_position(const ivec2 position) { set_mouse_position(position[0], position[1]); }
 void cm_set_mouse_cursor(int cursor) { set_mouse_cursor(cursor); }
+double cm_get_present_time() { return presentTime; }
 
 //endregion
@@ -10,6 +10,8 @@ void set_window_flags(ConfigFlags hint);
 bool window_should_close();
 void begin_draw();
 void end_draw();
+void present_draw();    // First half of end_draw, swaps and paces the frame
+void finish_frame();    // Second half of end_draw, polls the inputs
 
 void close_window();
 
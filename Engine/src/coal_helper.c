@@ -1,5 +1,10 @@
 #include "coal_helper.h"
 #include <stdio.h>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
 
 void cm_spiral_loop(unsigned int width, unsigned int height,
 					void (*func)(unsigned int x, unsigned int y))
@@ -20,7 +25,7 @@ void cm_spiral_loop(unsigned int width, unsigned int height,
 
 	func(x, y); // Call function for the center
 
-	while (steps < width || steps < height)
+	while (steps <= width || steps <= height)
 	{
 		// Move in the current direction
 		for (int i = 0; i < steps; i++)
@@ -46,6 +51,11 @@ uint32_t cm_trailing_zeros(uint64_t n)
 	return n ? __builtin_ctzll(n) : 64u;
 }
 
+uint32_t cm_leading_zeros(uint64_t n)
+{
+	return n ? __builtin_clzll(n) : 64u;
+}
+
 uint32_t cm_trailing_ones(uint64_t n)
 {
 	return n ? __builtin_ctzll(~n) : 64u;
@@ -69,3 +79,24 @@ uint32_t cm_min(uint32_t u1, uint32_t u2)
 	if(u1 < u2) return u1;
 	return u2;
 }
+
+uint64_t cm_hash_bytes(uint64_t hash, const void* data, size_t size)
+{
+	const uint8_t* bytes = (const uint8_t*)data;
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+void cm_make_directory(const char* path)
+{
+#ifdef _WIN32
+	_mkdir(path);
+#else
+	mkdir(path, 0755);
+#endif
+}
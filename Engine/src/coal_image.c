@@ -1,10 +1,38 @@
 #include "coal_image.h"
 #include <stb_image.h>
 #include "cmgl.h"
+#include "cmassets.h"
+#include "coal_helper.h"
+
+//Written before the mipmap levels in the atlas cache files
+typedef struct AtlasCacheHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint64_t key;
+	int32_t tileSize;
+	int32_t layers;
+	int32_t mipmaps;
+	int32_t format;
+	uint32_t dataSize;
+	double buildTime;     // Seconds the atlases took to decode, slice, compress and read back
+} AtlasCacheHeader;
+
+#define ATLAS_CACHE_MAGIC "CMTA"
+#define ATLAS_CACHE_VERSION 1
+#define ATLAS_CACHE_MAX_TILE_SIZE 2048
+#define ATLAS_CACHE_MAX_LAYERS 2048       // Minimum GL_MAX_ARRAY_TEXTURE_LAYERS of GL 4
+
+static void GetAtlasCachePath(uint64_t key, char* path);
+static bool LoadCachedAtlas(uint64_t key, TextureFlags wrap, TextureFlags filter, Texture* texture, double* buildTime);
+static void SaveCachedAtlas(uint64_t key, Texture texture, const void* data, uint32_t dataSize, double buildTime);
+static unsigned char* BuildAtlasLayers(const char** filePaths, unsigned char** fileData, int* dataSizes, int atlasCount, int tileSize, int* layers, int* mipmaps);
+static void DownsampleLayers(const unsigned char* src, unsigned char* dest, int size, int layers);
 
 Image cm_load_image(const char* filePath)
 {
 	Image image = { 0 };
+	if(take_startup_image(filePath, &image)) return image;
 
 #if defined(SUPPORT_FILEFORMAT_PNG) || \
     defined(SUPPORT_FILEFORMAT_BMP) || \
@@ -19,6 +47,8 @@ Image cm_load_image(const char* filePath)
 #define STBI_REQUIRED
 #endif
 	
+	double startTime = cm_get_time();
+
 	// Loading file to memory
 	int dataSize = 0;
 	unsigned char *fileData = cm_load_file_data(filePath, &dataSize);
@@ -27,6 +57,7 @@ Image cm_load_image(const char* filePath)
 	if (fileData != NULL) image = cm_load_image_from_memory(cm_get_file_extension(filePath), fileData, dataSize);
 	
 	CM_FREE(fileData);
+	trace_startup_load(filePath, cm_get_time() - startTime);
 	
 	return image;
 }
@@ -49,7 +80,9 @@ Texture cm_load_texture(const char* filePath, TextureFlags wrap, TextureFlags fi
 	
 	if (image.data != NULL)
 	{
+		double startTime = cm_get_time();
 		texture = cm_load_texture_from_image(image, wrap, filter);
+		trace_startup_creation(filePath, cm_get_time() - startTime, 0);
 		cm_unload_image(image);
 	}
 	
@@ -74,6 +107,70 @@ Texture cm_load_texture_from_image(Image image, TextureFlags wrap, TextureFlags
 	return texture;
 }
 
+Texture cm_load_texture_atlas_array(const char** filePaths, int atlasCount, int tileSize, TextureFlags wrap, TextureFlags filter)
+{
+	Texture texture = { 0 };
+	unsigned char** fileData = CM_CALLOC(atlasCount, sizeof(unsigned char*));
+	int* dataSizes = CM_CALLOC(atlasCount, sizeof(int));
+
+	// The key covers the files themselves, editing an atlas builds the array again
+	uint64_t key = cm_hash_bytes(CM_HASH_SEED, &tileSize, sizeof(int));
+	bool isValid = true;
+
+	for (int i = 0; i < atlasCount && isValid; ++i)
+	{
+		double startTime = cm_get_time();
+		fileData[i] = cm_load_file_data(filePaths[i], &dataSizes[i]);
+		trace_startup_load(filePaths[i], cm_get_time() - startTime);
+
+		isValid = fileData[i] != NULL;
+		if (isValid) key = cm_hash_bytes(key, fileData[i], dataSizes[i]);
+	}
+
+	double startTime = cm_get_time();
+	double buildTime = 0;
+
+	if (!isValid) log_error("IMAGE: Unable to read the atlases of the texture array");
+	else if (LoadCachedAtlas(key, wrap, filter, &texture, &buildTime))
+	{
+		double loadTime = cm_get_time() - startTime;
+		trace_startup_creation(filePaths[0], loadTime, buildTime - loadTime);   // the array is traced on its first atlas
+	}
+	else
+	{
+		int layers = 0, mipmaps = 0;
+		unsigned char* layerData = BuildAtlasLayers(filePaths, fileData, dataSizes, atlasCount, tileSize, &layers, &mipmaps);
+
+		if (layerData != NULL)
+		{
+			texture = (Texture){ .width = tileSize, .height = tileSize, .layers = layers, .mipmaps = mipmaps, .format = PIXELFORMAT_COMPRESSED_BPTC_RGBA };
+			texture.id = load_texture_array(layerData, tileSize, tileSize, layers, wrap, filter,
+			                                PIXELFORMAT_UNCOMPRESSED_R8G8B8A8, texture.format, mipmaps);
+			CM_FREE(layerData);
+
+			// Keep what the driver compressed, the next start uploads it as is
+			int compressedSize = 0;
+			void* compressed = read_compressed_texture_array(texture.id, tileSize, tileSize, layers, texture.format, mipmaps, &compressedSize);
+
+			if (compressed != NULL) SaveCachedAtlas(key, texture, compressed, compressedSize, cm_get_time() - startTime);
+			else
+			{
+				log_warn("IMAGE: The driver did not compress %s, the texture array is not cached", filePaths[0]);
+				texture.format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8;
+			}
+
+			CM_FREE(compressed);
+			trace_startup_creation(filePaths[0], cm_get_time() - startTime, 0);
+		}
+	}
+
+	for (int i = 0; i < atlasCount; ++i) CM_FREE(fileData[i]);
+	CM_FREE(fileData);
+	CM_FREE(dataSizes);
+
+	return texture;
+}
+
 unsigned char* cm_load_file_data(const char* filePath, int* dataSize)
 {
 	unsigned char *data = NULL;
@@ -275,4 +372,173 @@ Image cm_load_image_from_memory(const char *fileType, const unsigned char *fileD
 	if (image.data == NULL) log_error("IMAGE: Failed to load image data");
 	
 	return image;
-}
\ No newline at end of file
+}
+
+static void GetAtlasCachePath(uint64_t key, char* path)
+{
+	snprintf(path, MAX_PATH_SIZE, "%s/%016llx.tex", TEXTURE_CACHE_DIRECTORY, (unsigned long long)key);
+}
+
+static bool LoadCachedAtlas(uint64_t key, TextureFlags wrap, TextureFlags filter, Texture* texture, double* buildTime)
+{
+	Path path;
+	GetAtlasCachePath(key, path);
+
+	FILE* file;
+	if (fopen_s(&file, path, "rb")) return false;
+
+	AtlasCacheHeader header;
+	bool isLoaded = false;
+
+	fseek(file, 0, SEEK_END);
+	long fileSize = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	// The sizes come from the file, the data has to match what its levels need and fill the rest of the file
+	if (fread(&header, sizeof(AtlasCacheHeader), 1, file) == 1 &&
+	    memcmp(header.magic, ATLAS_CACHE_MAGIC, 4) == 0 &&
+	    header.version == ATLAS_CACHE_VERSION && header.key == key &&
+	    header.tileSize > 0 && header.tileSize <= ATLAS_CACHE_MAX_TILE_SIZE &&
+	    header.layers > 0 && header.layers <= ATLAS_CACHE_MAX_LAYERS &&
+	    header.mipmaps > 0 && header.mipmaps < 32 && (header.tileSize >> (header.mipmaps - 1)) > 0 &&
+	    header.dataSize > 0 &&
+	    header.dataSize == get_texture_array_data_size(header.tileSize, header.tileSize, header.layers, header.format, header.mipmaps) &&
+	    fileSize > 0 && (uint64_t)fileSize == sizeof(AtlasCacheHeader) + (uint64_t)header.dataSize)
+	{
+		void* data = CM_MALLOC(header.dataSize);
+		if (data != NULL && fread(data, 1, header.dataSize, file) == header.dataSize)
+		{
+			*texture = (Texture){ .width = header.tileSize, .height = header.tileSize, .layers = header.layers, .mipmaps = header.mipmaps, .format = header.format };
+			texture->id = load_texture_array(data, header.tileSize, header.tileSize, header.layers, wrap, filter,
+			                                 header.format, header.format, header.mipmaps);
+			*buildTime = header.buildTime;
+			isLoaded = texture->id != 0;
+		}
+
+		CM_FREE(data);
+	}
+
+	fclose(file);
+	return isLoaded;
+}
+
+static void SaveCachedAtlas(uint64_t key, Texture texture, const void* data, uint32_t dataSize, double buildTime)
+{
+	AtlasCacheHeader header =
+	{
+		.magic = ATLAS_CACHE_MAGIC,
+		.version = ATLAS_CACHE_VERSION,
+		.key = key,
+		.tileSize = texture.width,
+		.layers = texture.layers,
+		.mipmaps = texture.mipmaps,
+		.format = texture.format,
+		.dataSize = dataSize,
+		.buildTime = buildTime,
+	};
+
+	Path path;
+	GetAtlasCachePath(key, path);
+	cm_make_directory(TEXTURE_CACHE_DIRECTORY);
+
+	FILE* file;
+	if (!fopen_s(&file, path, "wb"))
+	{
+		fwrite(&header, sizeof(AtlasCacheHeader), 1, file);
+		fwrite(data, 1, dataSize, file);
+		fclose(file);
+	}
+	else log_warn("IMAGE: Unable to write the atlas cache %s", path);
+}
+
+//Every tile becomes a RGBA layer, atlas after atlas and row after row from the top, followed by the mipmap levels
+static unsigned char* BuildAtlasLayers(const char** filePaths, unsigned char** fileData, int* dataSizes, int atlasCount, int tileSize, int* layers, int* mipmaps)
+{
+	Image* images = CM_CALLOC(atlasCount, sizeof(Image));
+	bool isValid = true;
+
+	for (int i = 0; i < atlasCount && isValid; ++i)
+	{
+		images[i] = cm_load_image_from_memory(cm_get_file_extension(filePaths[i]), fileData[i], dataSizes[i]);
+		isValid = images[i].data != NULL &&
+		          (images[i].format == PIXELFORMAT_UNCOMPRESSED_R8G8B8A8 || images[i].format == PIXELFORMAT_UNCOMPRESSED_R8G8B8) &&
+		          images[i].width == images[0].width && images[i].height == images[0].height &&
+		          images[i].width % tileSize == 0 && images[i].height % tileSize == 0;
+
+		if (!isValid) log_error("IMAGE: %s can't be sliced in %ix%i tiles like the other atlases", filePaths[i], tileSize, tileSize);
+	}
+
+	unsigned char* data = NULL;
+	if (isValid)
+	{
+		int tilesPerRow = images[0].width / tileSize;
+		int tilesPerAtlas = tilesPerRow * (images[0].height / tileSize);
+		*layers = atlasCount * tilesPerAtlas;
+
+		*mipmaps = 0;
+		int size = 0;
+		for (int mipSize = tileSize; mipSize >= 1; mipSize /= 2)
+		{
+			size += mipSize * mipSize * 4 * *layers;
+			(*mipmaps)++;
+		}
+
+		data = CM_MALLOC(size);
+		unsigned char* dest = data;
+
+		for (int i = 0; i < atlasCount; ++i)
+		{
+			int channels = images[i].format == PIXELFORMAT_UNCOMPRESSED_R8G8B8A8 ? 4 : 3;
+			const unsigned char* pixels = images[i].data;
+
+			for (int tile = 0; tile < tilesPerAtlas; ++tile)
+			{
+				int originX = (tile % tilesPerRow) * tileSize;
+				int originY = (tile / tilesPerRow) * tileSize;
+
+				for (int y = 0; y < tileSize; ++y)
+					for (int x = 0; x < tileSize; ++x, dest += 4)
+					{
+						const unsigned char* pixel = pixels + ((originY + y) * images[i].width + originX + x) * channels;
+						dest[0] = pixel[0];
+						dest[1] = pixel[1];
+						dest[2] = pixel[2];
+						dest[3] = channels == 4 ? pixel[3] : 255;
+					}
+			}
+		}
+
+		// The mipmaps are built here so every driver samples the same levels
+		unsigned char* src = data;
+		for (int mipSize = tileSize; mipSize > 1; mipSize /= 2)
+		{
+			DownsampleLayers(src, dest, mipSize, *layers);
+			src = dest;
+			dest += (mipSize / 2) * (mipSize / 2) * 4 * *layers;
+		}
+	}
+
+	for (int i = 0; i < atlasCount; ++i) cm_unload_image(images[i]);
+	CM_FREE(images);
+	return data;
+}
+
+//Box filter of the 2x2 texels under every texel of the next level
+static void DownsampleLayers(const unsigned char* src, unsigned char* dest, int size, int layers)
+{
+	int half = size / 2;
+	for (int layer = 0; layer < layers; ++layer)
+	{
+		const unsigned char* srcLayer = src + layer * size * size * 4;
+		unsigned char* destLayer = dest + layer * half * half * 4;
+
+		for (int y = 0; y < half; ++y)
+			for (int x = 0; x < half; ++x)
+				for (int c = 0; c < 4; ++c)
+				{
+					int sum = srcLayer[((y * 2) * size + x * 2) * 4 + c] + srcLayer[((y * 2) * size + x * 2 + 1) * 4 + c] +
+					          srcLayer[((y * 2 + 1) * size + x * 2) * 4 + c] + srcLayer[((y * 2 + 1) * size + x * 2 + 1) * 4 + c];
+					destLayer[(y * half + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+				}
+	}
+}
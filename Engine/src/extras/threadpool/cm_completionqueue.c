@@ -0,0 +1,47 @@
+#include "cm_completionqueue.h"
+#include <stddef.h>
+
+void init_completion_queue(CompletionQueue* queue)
+{
+	atomic_init(&queue->stub.next, NULL);
+	atomic_init(&queue->head, &queue->stub);
+	queue->tail = &queue->stub;
+}
+
+// The head is swapped first and linked after, a consumer reaching the previous node in between sees the queue empty
+void push_completion(CompletionQueue* queue, CompletionNode* node)
+{
+	atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+	CompletionNode* previous = atomic_exchange_explicit(&queue->head, node, memory_order_acq_rel);
+	atomic_store_explicit(&previous->next, node, memory_order_release);
+}
+
+CompletionNode* pop_completion(CompletionQueue* queue)
+{
+	CompletionNode* tail = queue->tail;
+	CompletionNode* next = atomic_load_explicit(&tail->next, memory_order_acquire);
+
+	if(tail == &queue->stub)
+	{
+		if(next == NULL) return NULL;
+		queue->tail = next;
+		tail = next;
+		next = atomic_load_explicit(&next->next, memory_order_acquire);
+	}
+
+	if(next != NULL)
+	{
+		queue->tail = next;
+		return tail;
+	}
+
+	// The tail is the last node, the stub is pushed behind it so it can be taken
+	if(tail != atomic_load_explicit(&queue->head, memory_order_acquire)) return NULL;
+	push_completion(queue, &queue->stub);
+
+	next = atomic_load_explicit(&tail->next, memory_order_acquire);
+	if(next == NULL) return NULL;
+
+	queue->tail = next;
+	return tail;
+}
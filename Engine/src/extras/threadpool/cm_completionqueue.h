@@ -0,0 +1,25 @@
+#ifndef CM_COMPLETIONQUEUE_H
+#define CM_COMPLETIONQUEUE_H
+
+#include <stdatomic.h>
+
+// Intrusive node, placed first in the structure that is queued
+typedef struct CompletionNode
+{
+	_Atomic(struct CompletionNode*) next;
+}CompletionNode;
+
+// Unbounded lock-free queue, any thread pushes and a single thread pops.
+// A push publishes every write its thread made before it to the thread popping the node.
+typedef struct
+{
+	_Atomic(CompletionNode*) head;      // Last pushed, swapped by the producers
+	CompletionNode* tail;               // Next to pop, only used by the consumer
+	CompletionNode stub;
+}CompletionQueue;
+
+void init_completion_queue(CompletionQueue* queue);
+void push_completion(CompletionQueue* queue, CompletionNode* node);
+CompletionNode* pop_completion(CompletionQueue* queue);   // NULL when empty or while a push is half done
+
+#endif //CM_COMPLETIONQUEUE_H
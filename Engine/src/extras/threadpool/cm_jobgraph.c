@@ -0,0 +1,173 @@
+#include "cm_jobgraph.h"
+#include "coal_miner.h"
+
+typedef struct
+{
+	JobGraph* graph;
+	uint32_t node;
+}GraphNodeData;
+
+static void SubmitNode(JobGraph* graph, uint32_t node);
+static void T_ExecuteNode(uint32_t threadId, void* args);
+static void OnNodeFinished(uint32_t threadId, void* args);
+
+JobGraph* cm_create_job_graph(ThreadPool* pool, uint32_t nodeCount)
+{
+	JobGraph* graph = CM_MALLOC(sizeof(JobGraph));
+
+	pthread_mutex_init(&graph->lock, NULL);
+
+	graph->pool = pool;
+	graph->nodeCount = nodeCount;
+	graph->activeNodes = 0;
+	graph->nodes = CM_CALLOC(nodeCount, sizeof(JobGraphNode));
+
+	return graph;
+}
+
+bool cm_set_job_graph_node(JobGraph* graph, uint32_t node, ThreadJob job, bool asLast)
+{
+	pthread_mutex_lock(&graph->lock);
+
+	JobGraphNode* graphNode = &graph->nodes[node];
+	if(graphNode->state != JOB_NODE_IDLE && graphNode->state != JOB_NODE_COMPLETE)
+	{
+		pthread_mutex_unlock(&graph->lock);
+		log_error("Job graph node %u is still in flight and can't be set\n", node);
+		CM_FREE(job.args);
+		return false;
+	}
+
+	graphNode->job = job;
+	graphNode->asLast = asLast;
+	graphNode->state = JOB_NODE_BUILDING;
+	graphNode->remaining = 1;
+	graphNode->dependentCount = 0;
+	graph->activeNodes++;
+
+	pthread_mutex_unlock(&graph->lock);
+	return true;
+}
+
+void cm_add_job_graph_dependency(JobGraph* graph, uint32_t node, uint32_t dependency)
+{
+	pthread_mutex_lock(&graph->lock);
+
+	JobGraphNode* dependencyNode = &graph->nodes[dependency];
+
+	//A dependency which already executed, or was never scheduled, is satisfied
+	if(dependencyNode->state == JOB_NODE_BUILDING ||
+	   dependencyNode->state == JOB_NODE_WAITING ||
+	   dependencyNode->state == JOB_NODE_QUEUED)
+	{
+		if(dependencyNode->dependentCount >= MAX_JOB_GRAPH_DEPENDENTS)
+		{
+			log_fatal("Job graph node %u exceeds %u dependents\n", dependency, MAX_JOB_GRAPH_DEPENDENTS);
+			exit(-1);
+		}
+
+		dependencyNode->dependents[dependencyNode->dependentCount++] = node;
+		graph->nodes[node].remaining++;
+	}
+
+	pthread_mutex_unlock(&graph->lock);
+}
+
+void cm_commit_job_graph_node(JobGraph* graph, uint32_t node)
+{
+	pthread_mutex_lock(&graph->lock);
+
+	JobGraphNode* graphNode = &graph->nodes[node];
+	bool isReady = --graphNode->remaining == 0;
+	graphNode->state = isReady ? JOB_NODE_QUEUED : JOB_NODE_WAITING;
+
+	pthread_mutex_unlock(&graph->lock);
+
+	if(isReady) SubmitNode(graph, node);
+}
+
+bool cm_is_job_graph_idle(JobGraph* graph)
+{
+	pthread_mutex_lock(&graph->lock);
+	bool isIdle = graph->activeNodes == 0;
+	pthread_mutex_unlock(&graph->lock);
+
+	return isIdle;
+}
+
+void cm_destroy_job_graph(JobGraph* graph)
+{
+	for (uint32_t i = 0; i < graph->nodeCount; ++i)
+	{
+		if(graph->nodes[i].state != JOB_NODE_IDLE && graph->nodes[i].state != JOB_NODE_COMPLETE)
+			CM_FREE(graph->nodes[i].job.args);
+	}
+
+	pthread_mutex_destroy(&graph->lock);
+
+	CM_FREE(graph->nodes);
+	CM_FREE(graph);
+}
+
+static void SubmitNode(JobGraph* graph, uint32_t node)
+{
+	GraphNodeData* data = CM_MALLOC(sizeof(GraphNodeData));
+	data->graph = graph;
+	data->node = node;
+
+	ThreadJob job = {0};
+	job.args = data;
+	job.job = T_ExecuteNode;
+	job.callbackJob = OnNodeFinished;
+	job.name = graph->nodes[node].job.name;
+	cm_submit_job(graph->pool, job, graph->nodes[node].asLast);
+}
+
+static void T_ExecuteNode(uint32_t threadId, void* args)
+{
+	GraphNodeData* data = (GraphNodeData*)args;
+	JobGraph* graph = data->graph;
+	JobGraphNode* graphNode = &graph->nodes[data->node];
+
+	if(graphNode->job.job != NULL) graphNode->job.job(threadId, graphNode->job.args);
+
+	uint32_t readyNodes[MAX_JOB_GRAPH_DEPENDENTS];
+	uint32_t readyCount = 0;
+
+	pthread_mutex_lock(&graph->lock);
+
+	graphNode->state = JOB_NODE_FINISHED;
+	for (uint32_t i = 0; i < graphNode->dependentCount; ++i)
+	{
+		uint32_t dependent = graphNode->dependents[i];
+		if(--graph->nodes[dependent].remaining == 0)
+		{
+			graph->nodes[dependent].state = JOB_NODE_QUEUED;
+			readyNodes[readyCount++] = dependent;
+		}
+	}
+	graphNode->dependentCount = 0;
+
+	pthread_mutex_unlock(&graph->lock);
+
+	//Submitted outside the graph lock, the pool lock is never taken while holding it
+	for (uint32_t i = 0; i < readyCount; ++i)
+		SubmitNode(graph, readyNodes[i]);
+}
+
+//Runs when the pool is drained, the node can only be set again afterwards
+static void OnNodeFinished(uint32_t threadId, void* args)
+{
+	GraphNodeData* data = (GraphNodeData*)args;
+	JobGraph* graph = data->graph;
+	JobGraphNode* graphNode = &graph->nodes[data->node];
+
+	if(graphNode->job.callbackJob != NULL) graphNode->job.callbackJob(threadId, graphNode->job.args);
+	CM_FREE(graphNode->job.args);
+	graphNode->job.args = NULL;
+
+	pthread_mutex_lock(&graph->lock);
+	graphNode->state = JOB_NODE_COMPLETE;
+	graph->activeNodes--;
+	pthread_mutex_unlock(&graph->lock);
+}
@@ -0,0 +1,36 @@
+#ifndef CM_JOBGRAPH_H
+#define CM_JOBGRAPH_H
+
+#include "cm_threadpool.h"
+
+typedef enum
+{
+	JOB_NODE_IDLE,          // Never scheduled
+	JOB_NODE_BUILDING,      // Set but not committed, dependencies can still be added
+	JOB_NODE_WAITING,       // Committed, waiting for its dependencies
+	JOB_NODE_QUEUED,        // Submitted to the thread pool
+	JOB_NODE_FINISHED,      // Job executed, callback waiting for the pool to be drained
+	JOB_NODE_COMPLETE,      // Job and callback executed, the node can be set again
+}JobNodeState;
+
+typedef struct
+{
+	ThreadJob job;
+	volatile JobNodeState state;
+	uint32_t remaining;     // Unfinished dependencies, plus one while the node is being built
+	uint32_t dependentCount;
+	uint32_t dependents[MAX_JOB_GRAPH_DEPENDENTS];
+	bool asLast;
+}JobGraphNode;
+
+typedef struct
+{
+	ThreadPool* pool;
+	JobGraphNode* nodes;
+	uint32_t nodeCount;
+	volatile uint32_t activeNodes;
+
+	pthread_mutex_t lock;
+}JobGraph;
+
+#endif //CM_JOBGRAPH_H
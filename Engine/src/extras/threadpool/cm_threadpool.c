@@ -7,6 +7,13 @@ typedef struct
 	uint32_t threadId;
 }ThreadData;
 
+typedef struct FinishedJob
+{
+	CompletionNode node;
+	ThreadJob job;
+	uint32_t threadId;
+}FinishedJob;
+
 static void* ExecuteJob(void* args);
 
 ThreadPool* cm_create_thread_pool(uint32_t numThreads, uint32_t initialCapacity)
@@ -15,17 +22,19 @@ ThreadPool* cm_create_thread_pool(uint32_t numThreads, uint32_t initialCapacity)
 
 	pthread_mutex_init(&pool->lock, NULL);
 	pthread_cond_init(&pool->signal, NULL);
+	pthread_cond_init(&pool->idle, NULL);
 	
 	pool->jobCount = 0;
 	pool->aliveThreadCount = 0;
 	pool->isAlive = true;
 	pool->workingThreads = 0;
 	pool->capacity = initialCapacity;
+	init_completion_queue(&pool->completions);
 
 	if(initialCapacity > 0)
 	{
-		pool->jobs = CM_MALLOC(initialCapacity * sizeof(ThreadJob));
-		memset(pool->jobs, 0, initialCapacity * sizeof(ThreadJob));
+		pool->jobs = CM_MALLOC(initialCapacity * sizeof(PendingJob));
+		memset(pool->jobs, 0, initialCapacity * sizeof(PendingJob));
 	}
 	else pool->jobs = NULL;
 	
@@ -45,13 +54,24 @@ ThreadPool* cm_create_thread_pool(uint32_t numThreads, uint32_t initialCapacity)
 
 void cm_submit_job(ThreadPool* pool, ThreadJob job, bool asLast)
 {
+	PendingJob pending = { .job = job };
+	if(job.callbackJob != NULL)
+	{
+		pending.finished = CM_MALLOC(sizeof(FinishedJob));
+		if (pending.finished == NULL)
+		{
+			perror("Unable to allocate memory");
+			exit(-1);
+		}
+	}
+
 	pthread_mutex_lock(&pool->lock);
 	
 	if (pool->jobCount >= pool->capacity)
 	{
 		uint32_t oldCapacity = pool->capacity;
 		pool->capacity *= 2;
-		void* mem = CM_REALLOC(pool->jobs, pool->capacity * sizeof(ThreadJob));
+		void* mem = CM_REALLOC(pool->jobs, pool->capacity * sizeof(PendingJob));
 		if (mem == NULL)
 		{
 			perror("Unable to allocate memory");
@@ -59,16 +79,16 @@ void cm_submit_job(ThreadPool* pool, ThreadJob job, bool asLast)
 		}
 		else
 		{
-			memset(((char*)mem) + (oldCapacity * sizeof(ThreadJob)), 0, (pool->capacity - oldCapacity) * sizeof(ThreadJob));
+			memset(((char*)mem) + (oldCapacity * sizeof(PendingJob)), 0, (pool->capacity - oldCapacity) * sizeof(PendingJob));
 			pool->jobs = mem;
 		}
 	}
 
-	if(asLast || pool->jobCount == 0) pool->jobs[pool->jobCount] = job;
+	if(asLast || pool->jobCount == 0) pool->jobs[pool->jobCount] = pending;
 	else
 	{
-		memcpy_s(&pool->jobs[1], sizeof(ThreadJob) * pool->jobCount, pool->jobs, sizeof(ThreadJob) * pool->jobCount);
-		pool->jobs[0] = job;
+		memmove(&pool->jobs[1], pool->jobs, sizeof(PendingJob) * pool->jobCount);
+		pool->jobs[0] = pending;
 	}
 	pool->jobCount++;
 	pthread_cond_signal(&pool->signal);
@@ -76,6 +96,33 @@ void cm_submit_job(ThreadPool* pool, ThreadJob job, bool asLast)
 	pthread_mutex_unlock(&pool->lock);
 }
 
+void cm_wait_thread_pool(ThreadPool* pool)
+{
+	pthread_mutex_lock(&pool->lock);
+
+	while (pool->jobCount > 0 || pool->workingThreads > 0)
+		pthread_cond_wait(&pool->idle, &pool->lock);
+
+	pthread_mutex_unlock(&pool->lock);
+}
+
+uint32_t cm_drain_thread_pool(ThreadPool* pool)
+{
+	uint32_t count = 0;
+	CompletionNode* node;
+
+	while ((node = pop_completion(&pool->completions)) != NULL)
+	{
+		FinishedJob* finished = (FinishedJob*)node;
+		finished->job.callbackJob(finished->threadId, finished->job.args);
+		CM_FREE(finished->job.args);
+		CM_FREE(finished);
+		count++;
+	}
+
+	return count;
+}
+
 void cm_destroy_thread_pool(ThreadPool* pool)
 {
 	pthread_mutex_lock(&pool->lock);
@@ -89,10 +136,23 @@ void cm_destroy_thread_pool(ThreadPool* pool)
 		pthread_join(pool->threads[i], NULL);
 	
 	for (int i = 0; i < pool->jobCount; ++i)
-		CM_FREE(pool->jobs[i].args);
+	{
+		CM_FREE(pool->jobs[i].job.args);
+		CM_FREE(pool->jobs[i].finished);
+	}
+
+	//Callbacks that were never drained are dropped
+	CompletionNode* node;
+	while ((node = pop_completion(&pool->completions)) != NULL)
+	{
+		FinishedJob* finished = (FinishedJob*)node;
+		CM_FREE(finished->job.args);
+		CM_FREE(finished);
+	}
 	
 	pthread_mutex_destroy(&pool->lock);
 	pthread_cond_destroy(&pool->signal);
+	pthread_cond_destroy(&pool->idle);
 
 	CM_FREE(pool->jobs);
 	CM_FREE(pool);
@@ -104,6 +164,7 @@ static void* ExecuteJob(void* args)
 
 	ThreadPool* pool = data->pool;
 	uint32_t threadId = data->threadId;
+	CM_PROFILE_THREAD("Pool Worker");
 
 	while (pool->isAlive)
 	{
@@ -122,27 +183,32 @@ static void* ExecuteJob(void* args)
 		
 		pool->workingThreads++;
 		
-		ThreadJob job = pool->jobs[pool->jobCount - 1];
+		PendingJob pending = pool->jobs[pool->jobCount - 1];
+		ThreadJob job = pending.job;
 		pool->jobCount--;
 		
 		pthread_mutex_unlock(&pool->lock);
 		
-		if(job.job != NULL)
+		CM_PROFILE_JOB_BEGIN(job.name != NULL ? job.name : "Job");
+		if(job.job != NULL) job.job(threadId, job.args);
+		CM_PROFILE_END();
+
+		//The callback and the args go to the draining thread, with the writes of the job
+		if(pending.finished != NULL)
 		{
-			job.job(threadId, job.args);
-			
-			pthread_mutex_lock(&pool->lock);
-			
-			if(job.callbackJob != NULL) job.callbackJob(threadId, job.args);
-			pool->workingThreads--;
-			if(job.args != NULL)
-			{
-				CM_FREE(job.args);
-				job.args = NULL;
-			}
-			
-			pthread_mutex_unlock(&pool->lock);
+			FinishedJob* finished = pending.finished;
+			finished->job = job;
+			finished->threadId = threadId;
+			push_completion(&pool->completions, &finished->node);
 		}
+		else if(job.args != NULL) CM_FREE(job.args);
+
+		pthread_mutex_lock(&pool->lock);
+
+		pool->workingThreads--;
+		if(pool->workingThreads == 0 && pool->jobCount == 0) pthread_cond_broadcast(&pool->idle);
+
+		pthread_mutex_unlock(&pool->lock);
 	}
 	
 	CM_FREE(args);
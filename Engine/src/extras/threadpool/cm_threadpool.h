@@ -5,17 +5,25 @@
 #include <stdbool.h>
 #include "coal_config.h"
 #include <stdint.h>
+#include "cm_completionqueue.h"
 
 typedef struct
 {
 	void* args;
 	void (*job)(uint32_t threadId, void* args);
-	void (*callbackJob)(uint32_t threadId, void* args);
+	void (*callbackJob)(uint32_t threadId, void* args);     // Runs when the pool is drained, on the draining thread
+	const char* name;       // Span name in the profiler trace, NULL traces "Job"
 }ThreadJob;
 
 typedef struct
 {
-	ThreadJob* jobs;
+	ThreadJob job;
+	struct FinishedJob* finished;   // Allocated on submit for a job with a callback, the worker can't fail to queue it
+}PendingJob;
+
+typedef struct
+{
+	PendingJob* jobs;
 	pthread_t threads[MAX_THREADS_IN_THREAD_POOL];
 	volatile unsigned int capacity;
 	volatile unsigned int jobCount;
@@ -24,7 +32,10 @@ typedef struct
 	
 	pthread_mutex_t lock;
 	pthread_cond_t signal;
+	pthread_cond_t idle;
 	volatile unsigned int workingThreads;
+
+	CompletionQueue completions;    // Finished jobs with a callback, pushed without the lock
 }ThreadPool;
 
 #endif //CM_THREADPOOL_H
@@ -1,13 +1,27 @@
 #version 430 core
 precision highp float;
 
+//Must match TERRAIN_VOXEL_SSBO in terrainConfig.h
+//#define VOXEL_SSBO
+
 const float EPSILON = .999999f;
 const uint TERRAIN_CHUNK_SIZE = 64;
-const uint TERRAIN_CHUNK_VOXEL_COUNT = TERRAIN_CHUNK_SIZE * TERRAIN_CHUNK_SIZE * TERRAIN_CHUNK_SIZE;
-const uint TERRAIN_CHUNK_VOXEL_COUNT_SPLIT = TERRAIN_CHUNK_VOXEL_COUNT / 4;
+
+//Must match terrain_voxel_pool.h
+const uint BRICK_SIZE = 8;
+const uint BRICK_AXIS = TERRAIN_CHUNK_SIZE / BRICK_SIZE;
+const uint CHUNK_BRICKS = BRICK_AXIS * BRICK_AXIS * BRICK_AXIS;
+const uint BRICK_VOXEL_COUNT = BRICK_SIZE * BRICK_SIZE * BRICK_SIZE;
+const uint BRICK_UNIFORM = 0x80000000u;
 
 const uint UV_SCALE = 16;
-const float UV_STEP = 1.0f / UV_SCALE;
+const uint ATLAS_TILES = UV_SCALE * UV_SCALE;
+
+//Atlas of the faces in the surface array: sides, top then bottom
+const uint FACE_ATLAS[6] =
+{
+    0u, 0u, 0u, 0u, 1u, 2u
+};
 
 layout(std140, binding = 8) uniform Camera
 {
@@ -29,12 +43,23 @@ const float faceColors[6] =
     0.8f, 0.8f, 0.8f, 0.8f, 1.0f, 0.6f
 };
 
+#ifdef VOXEL_SSBO
+//Pool of the bricks that are not made of a single block type
 layout(std430, binding = 16) buffer VoxelBuffer
 {
     uint[] voxels;
 };
 
+//CHUNK_BRICKS pages per chunk, a uniform block type or the index of the brick in the pool
+layout(std430, binding = 17) buffer VoxelPages
+{
+    uint[] pages;
+};
+#endif
+
+in flat uint out_chunkId;
 in flat uint out_faceId;
+in flat uint out_blockType;
 in flat uvec3 out_blockPos;
 in vec3 out_lPos;
 in vec2 out_facePos;
@@ -45,8 +70,7 @@ in flat vec3 out_normal;
 
 out vec4 finalColor;
 
-uniform sampler2D u_surfaceTex[6];
-uniform uvec4 u_chunkIndex;
+uniform sampler2DArray u_surfaceTex;
 
 uniform vec3 u_ambientColor;
 
@@ -74,18 +98,30 @@ vec3 diffuse_global_lighting(vec3 fragPosition, vec3 normal, vec3 ambientColor)
 
 void main()
 {
+#ifdef VOXEL_SSBO
     uvec3 voxelPos = out_blockPos + round_vec3(out_lPos) - uvec3(out_faceId == 2u, out_faceId == 4u, out_faceId == 0u);
-    uint id = voxelPos.y * TERRAIN_CHUNK_SIZE * TERRAIN_CHUNK_SIZE + voxelPos.x * TERRAIN_CHUNK_SIZE + voxelPos.z;
-    uint offset = (id % 4u) * 8u;
-    uint bufferIndex = u_chunkIndex.w * TERRAIN_CHUNK_VOXEL_COUNT_SPLIT + uint(id * 0.25f);
-    uint voxel = (voxels[bufferIndex] & (0xff << offset)) >> offset;
+    uvec3 brick = voxelPos / BRICK_SIZE;
+    uvec3 local = voxelPos % BRICK_SIZE;
+    uint page = pages[out_chunkId * CHUNK_BRICKS + brick.y * BRICK_AXIS * BRICK_AXIS + brick.x * BRICK_AXIS + brick.z];
+
+    //Chunks with pending bricks are kept out of the draws, their vertices have no block type in this mode
+    uint voxel;
+    if((page & BRICK_UNIFORM) != 0u) voxel = page & 255u;
+    else
+    {
+        uint id = page * BRICK_VOXEL_COUNT + local.y * BRICK_SIZE * BRICK_SIZE + local.x * BRICK_SIZE + local.z;
+        voxel = (voxels[id / 4u] >> ((id % 4u) * 8u)) & 255u;
+    }
+#else
+    uint voxel = out_blockType;
+#endif
 
     voxel--;
-    vec2 uv = vec2(voxel / UV_SCALE, voxel % UV_SCALE) + fract(out_facePos);
-    uv *= UV_STEP;
+    //Layers go row by row from the top of the atlas, the block types go up the columns from the bottom
+    uint layer = FACE_ATLAS[out_faceId] * ATLAS_TILES + (UV_SCALE - 1u - voxel % UV_SCALE) * UV_SCALE + voxel / UV_SCALE;
+    vec2 uv = vec2(out_facePos.x, 1.0f - out_facePos.y);
 
-    uv.y = 1.0f - uv.y;
-    finalColor = texture(u_surfaceTex[out_faceId], uv);
+    finalColor = texture(u_surfaceTex, vec3(uv, float(layer)));
     finalColor.rgb *= diffuse_global_lighting(out_position, out_normal, u_ambientColor);
     finalColor.rgb *= out_ao_footprint;
 //    finalColor.rgb *= faceColors[out_faceId];
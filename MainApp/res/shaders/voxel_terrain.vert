@@ -43,14 +43,17 @@ layout(std140, binding = 8) uniform Camera
 //2bit AO
 
 //Y
-//3bit FaceId
 //2bit Id
+//3bit FaceId
+//8bit BlockType
 layout(location = 0) in uvec2 vertex;
 
-//xyz index, w id
-uniform uvec4 u_chunkIndex;
+//xyz index, w id, one per draw
+layout(location = 1) in uvec4 chunkIndex;
 
+out flat uint out_chunkId;
 out flat uint out_faceId;
+out flat uint out_blockType;
 out flat uvec3 out_blockPos;
 out vec3 out_lPos;
 out vec2 out_facePos;
@@ -82,6 +85,9 @@ void main()
     out_faceId = vertY & 7u;
     vertY >>= 3;
 
+    out_blockType = vertY & 255u;
+    vertY >>= 8;
+
     ivec3 vertexPos;
 
     switch(out_faceId)
@@ -120,6 +126,7 @@ void main()
 
     out_normal = NORMAL_FOOTPRINT[out_faceId];
     out_lPos = vec3(vertexPos);
-    out_position = u_chunkIndex.xyz * CHUNK_SIZE - vec3(WORLD_EDGE, 0, WORLD_EDGE) + vertexPos + out_blockPos;
+    out_chunkId = chunkIndex.w;
+    out_position = chunkIndex.xyz * CHUNK_SIZE - vec3(WORLD_EDGE, 0, WORLD_EDGE) + vertexPos + out_blockPos;
     gl_Position = cameraViewProjection * vec4(out_position, 1.0);
 }
\ No newline at end of file
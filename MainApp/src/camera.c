@@ -15,7 +15,9 @@ typedef struct CameraOffsetData
 	vec3 direction;
 }CameraOffsetData;
 
-Camera3D camera = CAMERA_INIT;
+Camera3D camera = CAMERA_INIT;          //simulated by the fixed updates
+Camera3D renderCamera = CAMERA_INIT;    //published every frame, between the last two simulated positions
+vec3 previousPosition;
 Camera3RDPerson cameraController = { 0, 50, 14, 0, 0, };
 Transform* cameraTarget;
 CameraControllerType cameraType = CC_FREE;
@@ -23,6 +25,7 @@ vec2 freeCameraPair = { 0, 90 };
 
 static CameraOffsetData CalculateOffset();
 static void FreeCamera();
+static void FreeCameraLook();
 static void ThirdPersonCamera();
 
 void load_camera()
@@ -32,10 +35,26 @@ void load_camera()
 	camera.farPlane = 10000;
 	
 	glm_normalize(camera.direction);
+	glm_vec3_copy(camera.position, previousPosition);
+	renderCamera = camera;
 }
 
+//Main thread, the simulation is idle
 void update_camera()
 {
+	if(cameraType == CC_FREE) FreeCameraLook();
+
+	renderCamera = camera;
+	glm_vec3_lerp(previousPosition, camera.position, cm_interpolation_alpha(), renderCamera.position);
+
+	//Replays stream the terrain along the recorded path whatever the simulation did
+	cm_replay_camera(&renderCamera);
+}
+
+void fixed_update_camera()
+{
+	glm_vec3_copy(camera.position, previousPosition);
+
 	switch (cameraType)
 	{
 		case CC_FREE: FreeCamera(); break;
@@ -48,7 +67,7 @@ void dispose_camera()
 
 }
 
-Camera3D get_camera() { return camera; }
+Camera3D get_camera() { return renderCamera; }
 void set_camera_target(Transform* target) { cameraTarget = target; }
 void remove_camera_target() { cameraTarget = NULL; }
 void set_camera_type(CameraControllerType type) { cameraType = type; }
@@ -91,17 +110,21 @@ static void FreeCamera()
 	if(!glm_vec3_eqv_eps(moveDir, GLM_VEC3_ZERO))
 	{
 		vec3 rDir;
-		glm_vec3_scale(right, moveDir[0] * CAM_FREE_MOVE_SPEED * cm_delta_time_f(), rDir);
+		glm_vec3_scale(right, moveDir[0] * CAM_FREE_MOVE_SPEED * cm_fixed_delta_time_f(), rDir);
 		vec3 fDir;
-		glm_vec3_scale(camera.direction, moveDir[2] * CAM_FREE_MOVE_SPEED * cm_delta_time_f(), fDir);
+		glm_vec3_scale(camera.direction, moveDir[2] * CAM_FREE_MOVE_SPEED * cm_fixed_delta_time_f(), fDir);
 		vec3 upDir;
-		glm_vec3_scale(camera.up, moveDir[1] * CAM_FREE_MOVE_SPEED * cm_delta_time_f(), upDir);
+		glm_vec3_scale(camera.up, moveDir[1] * CAM_FREE_MOVE_SPEED * cm_fixed_delta_time_f(), upDir);
 
 		glm_vec3_add(camera.position, fDir, camera.position);
 		glm_vec3_add(camera.position, rDir, camera.position);
 		glm_vec3_add(camera.position, upDir, camera.position);
 	}
-	
+}
+
+//The mouse delta covers the whole frame, the look follows it every frame instead of every fixed update
+static void FreeCameraLook()
+{
 	vec2 delta;
 	cm_get_mouse_delta(delta);
 	glm_vec2_negate(delta);
@@ -11,6 +11,7 @@ typedef enum CameraControllerType
 
 void load_camera();
 void update_camera();
+void fixed_update_camera();
 void dispose_camera();
 Camera3D get_camera();
 void set_camera_target(Transform* target);
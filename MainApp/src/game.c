@@ -12,6 +12,12 @@ void game_awake()
 {
 	log_set_level(LOG_INFO);
 
+	//Read and decoded on the startup threads while the modules load
+#if defined(DRAW_GRID)
+	prefetch_grid_assets();
+#endif
+	prefetch_terrain_assets();
+
 #if defined(DRAW_GRID)
 	load_grid();
 #endif
@@ -29,13 +35,25 @@ bool game_loading()
 
 void game_update()
 {
-	update_terrain();
-	update_light();
 	update_camera();
+	update_light();
+	update_terrain();
+
+#ifdef ENABLE_PROFILER
+	if(cm_is_key_pressed(KEY_P)) cm_toggle_profile_overlay();
+#endif
 
 //	log_info("target: %i, frame Rate: %i", cm_get_target_frame_rate(), cm_frame_rate());
 }
 
+//Worker thread, overlaps the render of the last frame. The terrain stays in game_update: its bookkeeping moves the
+//chunk groups and drawables draw_terrain reads, overlapping it would need a second copy of them
+void game_fixed_update()
+{
+	fixed_update_camera();
+	fixed_update_light();
+}
+
 void game_render()
 {
 	cm_begin_mode_3d(get_camera());
@@ -4,6 +4,7 @@
 void game_awake();
 bool game_loading();
 void game_update();
+void game_fixed_update();
 void game_render();
 void game_close();
 
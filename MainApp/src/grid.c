@@ -23,6 +23,17 @@ static void CreateGridVao();
 
 GridData gridData;
 
+static const char* gridShaderPaths[2] = { "shaders/grid.vert", "shaders/grid.frag" };
+
+void prefetch_grid_assets()
+{
+	for (int i = 0; i < 2; ++i)
+	{
+		Path shaderPath = TO_RES_PATH(shaderPath, gridShaderPaths[i]);
+		cm_prefetch_file_text(shaderPath);
+	}
+}
+
 void load_grid()
 {
 	int id = 0;
@@ -96,8 +107,8 @@ void dispose_grid()
 
 static void CreateGridShader()
 {
-	Path vsPath = TO_RES_PATH(vsPath, "shaders/grid.vert");
-	Path fsPath = TO_RES_PATH(fsPath, "shaders/grid.frag");
+	Path vsPath = TO_RES_PATH(vsPath, gridShaderPaths[0]);
+	Path fsPath = TO_RES_PATH(fsPath, gridShaderPaths[1]);
 	
 	gridData.gridShader = cm_load_shader(vsPath, fsPath);
 	gridData.u_axis_offsetId = cm_get_uniform_location(gridData.gridShader, "u_axis_offset");
@@ -1,6 +1,7 @@
 #ifndef GRID_H
 #define GRID_H
 
+void prefetch_grid_assets();
 void load_grid();
 void draw_grid();
 void dispose_grid();
@@ -3,16 +3,30 @@
 #define DAY_NIGHT_DURATION 20.0f
 
 GlobalLight MAIN_GLOBAL_LIGHT = GLOBAL_LIGHT_INIT;
+GlobalLight renderLight = GLOBAL_LIGHT_INIT;
+vec3 previousDirection;
 
 static void RotateLight(vec3 axis, float angle);
 
 void load_light()
 {
 	RotateLight((vec3){ 0, 0, 1 }, -60.0f);
+	glm_vec3_copy(MAIN_GLOBAL_LIGHT.direction, previousDirection);
+	renderLight = MAIN_GLOBAL_LIGHT;
 }
 
+//Main thread, the simulation is idle
 void update_light()
 {
+	renderLight = MAIN_GLOBAL_LIGHT;
+	glm_vec3_lerp(previousDirection, MAIN_GLOBAL_LIGHT.direction, cm_interpolation_alpha(), renderLight.direction);
+	glm_normalize(renderLight.direction);
+}
+
+void fixed_update_light()
+{
+	glm_vec3_copy(MAIN_GLOBAL_LIGHT.direction, previousDirection);
+
 #if DEBUG
 	if(cm_is_key_down(KEY_LEFT_CONTROL))
 	{
@@ -24,10 +38,10 @@ void update_light()
 		if(cm_is_key_down(KEY_RIGHT)) axis[0] = 1;
 		if(cm_is_key_down(KEY_LEFT))  axis[0] = -1;
 		
-		if(glm_vec3_norm(axis) > 0) RotateLight(axis, 20.0f * cm_delta_time_f());
+		if(glm_vec3_norm(axis) > 0) RotateLight(axis, 20.0f * cm_fixed_delta_time_f());
 	}
 #else
-	RotateLight((vec3){ 0, 0, 1 }, (360.0f / DAY_NIGHT_DURATION) * cm_delta_time_f());
+	RotateLight((vec3){ 0, 0, 1 }, (360.0f / DAY_NIGHT_DURATION) * cm_fixed_delta_time_f());
 #endif
 }
 
@@ -36,7 +50,7 @@ void dispose_light()
 
 }
 
-GlobalLight get_global_light() { return MAIN_GLOBAL_LIGHT; }
+GlobalLight get_global_light() { return renderLight; }
 
 static void RotateLight(vec3 axis, float angle)
 {
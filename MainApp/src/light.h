@@ -5,6 +5,7 @@
 
 void load_light();
 void update_light();
+void fixed_update_light();
 void dispose_light();
 GlobalLight get_global_light();
 
@@ -1,7 +1,8 @@
 #include "coal_miner_internal.h"
 #include "game.h"
 
-int main(void)
+//--record <file> or --replay <file> after the loading, --timings <csv> for the frame times, --hidden for benchmark runs
+int main(int argc, char** argv)
 {
 	EngineData data;
 	memcpy(&data, &CM_DEFAULT_ENGINE_DATA, sizeof(EngineData));
@@ -14,9 +15,20 @@ int main(void)
 	data.awakeCallback = game_awake;
 	data.loadingCallback = game_loading;
 	data.updateCallback = game_update;
+	data.fixedUpdateCallback = game_fixed_update;
 	data.renderCallback = game_render;
 	data.appCloseCallback = game_close;
 
+	for (int i = 1; i < argc; ++i)
+	{
+		bool hasValue = i + 1 < argc;
+		if(strcmp(argv[i], "--record") == 0 && hasValue) data.recordPath = argv[++i];
+		else if(strcmp(argv[i], "--replay") == 0 && hasValue) data.replayPath = argv[++i];
+		else if(strcmp(argv[i], "--timings") == 0 && hasValue) data.timingsPath = argv[++i];
+		else if(strcmp(argv[i], "--hidden") == 0) data.configFlags |= FLAG_WINDOW_HIDDEN;
+		else log_warn("Unknown argument %s", argv[i]);
+	}
+
 	coal_run(data);
 	return 0;
 }
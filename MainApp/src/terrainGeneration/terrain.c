@@ -2,6 +2,7 @@
 #include "terrain_noise.h"
 #include "terrain_meshing.h"
 #include "terrain_blocks.h"
+#include "terrain_metrics.h"
 #include "coal_miner_internal.h"
 #include "camera.h"
 #include "coal_helper.h"
@@ -12,7 +13,6 @@ static void LoadTerrainShader();
 static void LoadTerrainTextures();
 static void LoadBuffers();
 static void InitTerrainNoise();
-static void LoadTerrainChunks();
 
 static TerrainChunkGroup InitializeChunkGroup(uint32_t ssboId);
 static void RecreateChunkGroup(TerrainChunkGroup* group, uint32_t x, uint32_t z);
@@ -21,15 +21,45 @@ static void DestroyChunkGroup(TerrainChunkGroup* group);
 
 //Reloading
 static void SetupInitialChunks(Camera3D camera);
+static void RecreateInitialGroup(unsigned int x, unsigned int z);
+static void ScheduleInitialMeshing(unsigned int x, unsigned int z);
+static void CheckWindowLoaded();
 static void ReloadChunks(Camera3D camera);
 
 //Utils
-static void PassTerrainDataToShader(UniformData* data);
-static bool AllChunksAreLoaded();
-static bool SurroundGroupsAreLoaded(uint32_t xId, uint32_t zId);
-static bool GroupNeedsFaces(uint32_t xId, uint32_t zId);
 static bool DelayedLoader();
-static bool TryUploadGroup(TerrainChunkGroup* group);
+
+//Chunk Lists
+static void RefreshSlotGroups();
+static void AddDrawable(TerrainChunkGroup* group, uint32_t yId);
+static void RemoveDrawable(uint32_t chunkId);
+static void CollectMeshedChunks();
+
+//Uploading
+static double GetUploadBudget();
+static void ReadUploadTimings();
+static void AddUploadCost(uint32_t bytes, double cpuTime, double gpuTime);
+static void SortUploadQueue();
+static void UploadChunks(double budget);
+static uint32_t UploadChunk(uint32_t chunkId, bool* isSubmitted);
+static uint32_t GetChunkUploadSize(TerrainChunk* chunk);
+static bool IsChunkUploading(uint32_t chunkId);
+#ifdef TERRAIN_VOXEL_SSBO
+static bool AllocChunkBricks(uint32_t chunkId, TerrainChunk* chunk, uint32_t* previousPages);
+static void UploadChunkBricks(uint32_t chunkId, const uint32_t* pages, StagingAllocation staging,
+                              uint32_t bricksOffset, const uint8_t* packed);
+static void CopyBrickRun(StagingAllocation staging, uint32_t bricksOffset, const uint8_t* packed,
+                         uint32_t packedId, uint32_t poolId, uint32_t count);
+#endif
+#ifdef TERRAIN_UPLOAD_THREAD
+#ifdef TERRAIN_VOXEL_SSBO
+static bool SubmitChunkUpload(uint32_t chunkId, TerrainChunk* chunk, double startTime, const uint32_t* previousPages);
+#else
+static bool SubmitChunkUpload(uint32_t chunkId, TerrainChunk* chunk, double startTime);
+#endif
+static void T_UploadChunk(uint32_t threadId, void* args);
+static void ChunkUploadFinished(uint32_t threadId, void* args);
+#endif
 
 //endregion
 
@@ -38,47 +68,84 @@ static bool TryUploadGroup(TerrainChunkGroup* group);
 VoxelTerrain voxelTerrain = { 0 };
 bool terrainIsWireMode;
 
+static const char* terrainShaderPaths[2] = { "shaders/voxel_terrain.vert", "shaders/voxel_terrain.frag" };
+static const char* terrainTexturePaths[3] = { "2d/terrain/0.Map_Side.png", "2d/terrain/1.Map_Top.png", "2d/terrain/2.Map_Bottom.png" };
+
 //endregion
 
 //region Callback Functions
+void prefetch_terrain_assets()
+{
+	for (int i = 0; i < 2; ++i)
+	{
+		Path shaderPath = TO_RES_PATH(shaderPath, terrainShaderPaths[i]);
+		cm_prefetch_file_text(shaderPath);
+	}
+}
+
 void load_terrain()
 {
+	voxelTerrain.loadStartTime = cm_get_time();
 	LoadTerrainShader();
 	LoadTerrainTextures();
 	InitTerrainNoise();
 	
 	voxelTerrain.shiftGroups = CM_MALLOC(TERRAIN_VIEW_RANGE * sizeof(TerrainChunkGroup));
+	voxelTerrain.meshedChunks = list_create(0);
+	voxelTerrain.uploadQueue = list_create(0);
+	voxelTerrain.uploadHead = 0;
+	voxelTerrain.uploadEntries = list_create(0);
+	voxelTerrain.isUploadQueueSorted = false;
+	voxelTerrain.drawableCount = 0;
+	for (int i = 0; i < TERRAIN_CHUNK_COUNT; ++i) voxelTerrain.drawableIds[i] = -1;
+	voxelTerrain.uploadTimer = cm_load_gpu_timer();
+	voxelTerrain.uploadStats = (TerrainUploadStats){ .costPerMegabyte = TERRAIN_UPLOAD_INITIAL_MS_PER_MB };
 	setup_terrain_noise(&voxelTerrain);
 	setup_terrain_meshing(&voxelTerrain);
+	load_terrain_metrics(&voxelTerrain);
 
 	for (int x = 0; x < TERRAIN_VIEW_RANGE; ++x)
 		for (int z = 0; z < TERRAIN_VIEW_RANGE; ++z)
 			voxelTerrain.chunkGroups[x * TERRAIN_VIEW_RANGE + z] = InitializeChunkGroup(x * TERRAIN_VIEW_RANGE + z);
+	RefreshSlotGroups();
 	
 	LoadBuffers();
 	
 	voxelTerrain.pool = cm_create_thread_pool(TERRAIN_NUM_WORKER_THREADS, 1024);
+	voxelTerrain.graph = cm_create_job_graph(voxelTerrain.pool, TERRAIN_VIEW_RANGE * TERRAIN_VIEW_RANGE * TERRAIN_NODE_COUNT);
+
+#ifdef TERRAIN_UPLOAD_THREAD
+	if(!cm_load_upload_thread()) log_warn("%s", "Terrain chunks are uploaded by the main thread");
+#endif
 
 	SetupInitialChunks(get_camera());
 }
 
 bool loading_terrain()
 {
-	LoadTerrainChunks();
-	
-	for (uint32_t x = 0; x < TERRAIN_VIEW_RANGE; ++x)
-		for (uint32_t z = 0; z < TERRAIN_VIEW_RANGE; ++z)
-			TryUploadGroup(&voxelTerrain.chunkGroups[x * TERRAIN_VIEW_RANGE + z]);
+	cm_drain_thread_pool(voxelTerrain.pool);
+	CollectMeshedChunks();
+	UploadChunks(INFINITY);
 
 #ifdef TERRAIN_DELAYED_LOAD
-	return DelayedLoader();
-#else
-	return false;
+	if(DelayedLoader()) return true;
 #endif
+
+	return false;
 }
 
 void update_terrain()
 {
+	//The generation and meshing callbacks write the group and chunk states here, on the main thread
+	cm_drain_thread_pool(voxelTerrain.pool);
+
+	//The first frame that drew chunks was swapped at the end of the last one
+	if(voxelTerrain.isFirstFrameDrawn && voxelTerrain.firstFrameTime == 0)
+	{
+		voxelTerrain.firstFrameTime = cm_get_present_time() - voxelTerrain.loadStartTime;
+		log_info("Terrain first frame after %.1f ms\n", voxelTerrain.firstFrameTime * 1000.0);
+	}
+
 	if(cm_is_key_pressed(KEY_B))
 	{
 		if(terrainIsWireMode)
@@ -101,79 +168,123 @@ void update_terrain()
 		for (uint32_t i = 0; i < TERRAIN_VIEW_RANGE * TERRAIN_VIEW_RANGE; ++i)
 		{
 			for (uint32_t y = 0; y < TERRAIN_HEIGHT; ++y)
-				size += voxelTerrain.chunkGroups[i].chunks[y].buffer.size;
+				size += voxelTerrain.chunkGroups[i].chunks[y].meshBytes;
 		}
 
 		log_info("Allocated Buffer Bytes: %u\n", size);
+
+		TerrainMeshingStats stats = get_terrain_meshing_stats();
+		if(stats.chunkCount > 0)
+		{
+#ifdef TERRAIN_AMBIENT_OCCLUSION
+			const char* aoMode = "on";
+#else
+			const char* aoMode = "off";
+#endif
+			log_info("Meshed Chunks: %u, Average Meshing Time: %.3f ms, AO: %s\n",
+			         stats.chunkCount, stats.totalTime * 1000.0 / stats.chunkCount, aoMode);
+		}
+
+#ifdef TERRAIN_VOXEL_SSBO
+		TerrainVoxelPool* pool = &voxelTerrain.voxelPool;
+		log_info("Voxel Pool: %u / %u bricks (%u bytes), Page Table: %u bytes\n",
+		         pool->usedCount, pool->capacity, pool->usedCount * TERRAIN_BRICK_VOXEL_COUNT,
+		         TERRAIN_CHUNK_COUNT * TERRAIN_CHUNK_BRICKS * (uint32_t)sizeof(uint32_t));
+#else
+		log_info("Voxel SSBO: off, block types are carried by the %u bytes of mesh data\n", size);
+#endif
+
+		TerrainUploadStats upload = get_terrain_upload_stats();
+		log_info("First Frame: %.1f ms, Full Window: %.1f ms\n",
+		         voxelTerrain.firstFrameTime * 1000.0, voxelTerrain.windowLoadTime * 1000.0);
+
+		log_info("Uploaded Chunks: %" PRIu64 " (%" PRIu64 " bytes), Pending: %u, Budget: %.2f ms, Cost: %.3f ms/MB, Last Gpu: %.3f ms\n",
+		         upload.totalChunks, upload.totalBytes, upload.pendingChunks,
+		         upload.budget, upload.costPerMegabyte, upload.lastGpuTime);
+
+		GlStateStats gl = cm_get_gl_state_stats();
+		log_info("GL Calls (issued/skipped): Programs %u/%u, Vertex Arrays %u/%u, Textures %u/%u, Buffers %u/%u, UBO Uploads %u/%u\n",
+		         gl.issued[CM_GL_STATE_PROGRAM], gl.skipped[CM_GL_STATE_PROGRAM],
+		         gl.issued[CM_GL_STATE_VERTEX_ARRAY], gl.skipped[CM_GL_STATE_VERTEX_ARRAY],
+		         gl.issued[CM_GL_STATE_TEXTURE], gl.skipped[CM_GL_STATE_TEXTURE],
+		         gl.issued[CM_GL_STATE_BUFFER], gl.skipped[CM_GL_STATE_BUFFER],
+		         gl.issued[CM_GL_STATE_UBO_UPLOAD], gl.skipped[CM_GL_STATE_UBO_UPLOAD]);
+
+		//Percentiles since the last metrics interval
+		TerrainMetrics metrics = get_terrain_metrics();
+		static const char* stageNames[TERRAIN_STAGE_COUNT] = { "Height Map", "Caves", "Surface", "Mesh", "Upload" };
+		for (uint32_t i = 0; i < TERRAIN_STAGE_COUNT; ++i)
+		{
+			log_info("%s: %u queued, %u running, wait p50/p99 %.2f/%.2f ms, run p50/p99 %.2f/%.2f ms\n", stageNames[i],
+			         metrics.queuedJobs[i], metrics.runningJobs[i],
+			         get_terrain_histogram_percentile(&metrics.waitTimes[i], .5) / 1000.0,
+			         get_terrain_histogram_percentile(&metrics.waitTimes[i], .99) / 1000.0,
+			         get_terrain_histogram_percentile(&metrics.runTimes[i], .5) / 1000.0,
+			         get_terrain_histogram_percentile(&metrics.runTimes[i], .99) / 1000.0);
+		}
+
+		log_info("Chunks (faces/meshing/upload/ready): %u/%u/%u/%u, Voxels: %" PRIu64 " bytes, VBOs: %" PRIu64 " bytes, SSBOs: %" PRIu64 " bytes\n",
+		         metrics.chunkStates[CHUNK_REQUIRES_FACES], metrics.chunkStates[CHUNK_CREATING_FACES],
+		         metrics.chunkStates[CHUNK_REQUIRES_UPLOAD], metrics.chunkStates[CHUNK_READY_TO_DRAW],
+		         metrics.voxelBytes, metrics.vboBytes, metrics.ssboBytes);
 	}
 
+	update_terrain_metrics();
+
+	CM_PROFILE_BEGIN("Reload Chunks");
 	ReloadChunks(get_camera());
-	LoadTerrainChunks();
-	
-//	printf("FrameTime: %f\n", cm_frame_time() * 1000);
+	CM_PROFILE_END();
 }
 
 void draw_terrain()
 {
 	cm_begin_shader_mode(voxelTerrain.shader);
 	
-	for (int i = 0; i < 4; ++i)
-		cm_set_texture(voxelTerrain.uniforms.u_surfaceTex + i, voxelTerrain.textures[0].id, i);
-	
-	cm_set_texture(voxelTerrain.uniforms.u_surfaceTex + 4, voxelTerrain.textures[1].id, 4);
-	cm_set_texture(voxelTerrain.uniforms.u_surfaceTex + 5, voxelTerrain.textures[2].id, 5);
+	cm_set_texture_array(voxelTerrain.uniforms.u_surfaceTex, voxelTerrain.surfaceTextures.id, 0);
+	cm_set_uniform_vec3(voxelTerrain.uniforms.u_ambientColor, TERRAIN_SHADER_AMBIENT_COLOR);
+
+	CM_PROFILE_BEGIN("Chunk Uploads");
+	CollectMeshedChunks();
+	UploadChunks(GetUploadBudget());
+	if(voxelTerrain.windowLoadTime == 0) CheckWindowLoaded();
+	CM_PROFILE_END();
 
-	UniformData data = {0};
-	int numUploadsLeft = TERRAIN_GROUP_UPLOAD_LIMIT;
+	BoundingVolume volume = { .extents = { TERRAIN_CHUNK_SIZE * .5f, TERRAIN_CHUNK_SIZE * .5f, TERRAIN_CHUNK_SIZE * .5f } };
 	uint32_t drawCount = 0;
 
-	for (uint32_t x = 0; x < TERRAIN_VIEW_RANGE; ++x)
+	for (uint32_t i = 0; i < voxelTerrain.drawableCount; ++i)
 	{
-		for (uint32_t z = 0; z < TERRAIN_VIEW_RANGE; ++z)
-		{
-			TerrainChunkGroup* group = &voxelTerrain.chunkGroups[x * TERRAIN_VIEW_RANGE + z];
-			if(numUploadsLeft > 0) numUploadsLeft -= TryUploadGroup(group);
+		UniformData* data = &voxelTerrain.drawables[i];
 
-			BoundingVolume volume =
-			{
-				.extents = { TERRAIN_CHUNK_SIZE * .5f, TERRAIN_CHUNK_SIZE * TERRAIN_HEIGHT * .5f, TERRAIN_CHUNK_SIZE * .5f }
-			};
-			vec3 chunkPos = { (float)group->id[0] - TERRAIN_WORLD_EDGE, 0, (float)group->id[1] - TERRAIN_WORLD_EDGE };
-			glm_vec3_mul(chunkPos, (vec3){ TERRAIN_CHUNK_SIZE, 0, TERRAIN_CHUNK_SIZE }, chunkPos);
-			glm_vec3_add(chunkPos, volume.extents, chunkPos);
-			glm_vec3_copy(chunkPos, volume.center);
+		vec3 chunkPos = { (float)data->chunk[0] - TERRAIN_WORLD_EDGE, (float)data->chunk[1], (float)data->chunk[2] - TERRAIN_WORLD_EDGE };
+		glm_vec3_scale(chunkPos, TERRAIN_CHUNK_SIZE, chunkPos);
+		glm_vec3_add(chunkPos, volume.extents, volume.center);
 
-			if(!cm_is_in_main_frustum(&volume)) continue;
+		if(!cm_is_in_main_frustum(&volume)) continue;
 
-			volume.extents[1] = TERRAIN_CHUNK_SIZE * .5f;
+		memcpy(voxelTerrain.drawData[drawCount], data->chunk, sizeof(ivec3));
+		voxelTerrain.drawData[drawCount][3] = data->chunkId;
+		drawCount++;
+	}
 
-			for (uint32_t y = 0; y < TERRAIN_HEIGHT; ++y)
-			{
-				TerrainChunk* chunk = &group->chunks[y];
-				uint16_t faceCount = chunk->flags.faceCount;
-
-				if(faceCount > 0)
-				{
-					volume.center[1] = (float)y * TERRAIN_CHUNK_SIZE + TERRAIN_CHUNK_SIZE * .5f;
-					if(!cm_is_in_main_frustum(&volume)) continue;
-
-					data.chunk[0] = (int)group->id[0];
-					data.chunk[1] = (int)y;
-					data.chunk[2] = (int)group->id[1];
-
-					data.chunkId = group->ssboId * TERRAIN_HEIGHT + y;
-
-					if(chunk->flags.isUploaded)
-					{
-						PassTerrainDataToShader(&data);
-						cm_draw_vao(voxelTerrain.chunkVaos[data.chunkId], CM_TRIANGLES);
-						drawCount++;
-					}
-				}
-			}
-		}
+	//One upload for the whole frame, every draw then only differs by its base instance
+	uint32_t baseInstance = voxelTerrain.drawDataFrame * TERRAIN_CHUNK_COUNT;
+	voxelTerrain.drawDataFrame = (voxelTerrain.drawDataFrame + 1) % TERRAIN_DRAW_DATA_FRAMES;
+
+	if(drawCount > 0)
+	{
+		voxelTerrain.drawDataVbo.data = voxelTerrain.drawData;
+		cm_reupload_vbo_partial(&voxelTerrain.drawDataVbo, baseInstance * sizeof(voxelTerrain.drawData[0]),
+		                        drawCount * sizeof(voxelTerrain.drawData[0]));
 	}
 
+	if(drawCount > 0) voxelTerrain.isFirstFrameDrawn = true;
+
+	CM_PROFILE_GPU_BEGIN("Terrain");
+	for (uint32_t i = 0; i < drawCount; ++i)
+		cm_draw_vao_base_instance(voxelTerrain.chunkVaos[voxelTerrain.drawData[i][3]], CM_TRIANGLES, baseInstance + i);
+	CM_PROFILE_GPU_END();
+
 	cm_end_shader_mode();
 
 //	printf("Draw: %i\n", drawCount);
@@ -183,6 +294,17 @@ void dispose_terrain()
 {
 	cm_destroy_thread_pool(voxelTerrain.pool);
 	voxelTerrain.pool = NULL;
+	cm_destroy_job_graph(voxelTerrain.graph);
+	voxelTerrain.graph = NULL;
+#ifdef TERRAIN_UPLOAD_THREAD
+	cm_unload_upload_thread();
+#endif
+
+	dispose_terrain_metrics();
+	list_clear(&voxelTerrain.meshedChunks);
+	list_clear(&voxelTerrain.uploadQueue);
+	list_clear(&voxelTerrain.uploadEntries);
+	cm_unload_gpu_timer(voxelTerrain.uploadTimer);
 	
 	for (int x = 0; x < TERRAIN_VIEW_RANGE; ++x)
 		for (int z = 0; z < TERRAIN_VIEW_RANGE; ++z)
@@ -190,10 +312,21 @@ void dispose_terrain()
 	
 	CM_FREE(voxelTerrain.shiftGroups);
 	
-	for (int i = 0; i < 3; ++i) cm_unload_texture(voxelTerrain.textures[i]);
+	cm_unload_texture(voxelTerrain.surfaceTextures);
 	
 	for (int i = 0; i < TERRAIN_CHUNK_COUNT; ++i)
 		cm_unload_vao(voxelTerrain.chunkVaos[i]);
+#ifdef TERRAIN_UPLOAD_THREAD
+	for (int i = 0; i < TERRAIN_CHUNK_COUNT; ++i)
+		cm_unload_vbo(voxelTerrain.spareVbos[i]);
+#endif
+	cm_unload_vbo(voxelTerrain.drawDataVbo);
+
+#ifdef TERRAIN_VOXEL_SSBO
+	cm_unload_ssbo(voxelTerrain.voxelsSsbo);
+	cm_unload_ssbo(voxelTerrain.voxelPagesSsbo);
+	destroy_terrain_voxel_pool(&voxelTerrain.voxelPool);
+#endif
 
 	cm_unload_shader(voxelTerrain.shader);
 }
@@ -203,13 +336,12 @@ void dispose_terrain()
 
 static void LoadTerrainShader()
 {
-	Path vsPath = TO_RES_PATH(vsPath, "shaders/voxel_terrain.vert");
-	Path fsPath = TO_RES_PATH(fsPath, "shaders/voxel_terrain.frag");
+	Path vsPath = TO_RES_PATH(vsPath, terrainShaderPaths[0]);
+	Path fsPath = TO_RES_PATH(fsPath, terrainShaderPaths[1]);
 	
 	voxelTerrain.shader = cm_load_shader(vsPath, fsPath);
 	TerrainShaderUniforms uniforms = {};
 	
-	uniforms.u_chunkIndex = cm_get_uniform_location(voxelTerrain.shader, "u_chunkIndex");
 	uniforms.u_surfaceTex = cm_get_uniform_location(voxelTerrain.shader, "u_surfaceTex");
 	
 	uniforms.u_ambientColor = cm_get_uniform_location(voxelTerrain.shader, "u_ambientColor");
@@ -219,17 +351,25 @@ static void LoadTerrainShader()
 
 static void LoadTerrainTextures()
 {
-	Path mapPath0 = TO_RES_PATH(mapPath0, "2d/terrain/0.Map_Side.png");
-	Path mapPath1 = TO_RES_PATH(mapPath1, "2d/terrain/1.Map_Top.png");
-	Path mapPath2 = TO_RES_PATH(mapPath2, "2d/terrain/2.Map_Bottom.png");
+	Path mapPaths[3];
+	const char* paths[3];
 
-	voxelTerrain.textures[0] = cm_load_texture(mapPath0, CM_TEXTURE_WRAP_CLAMP_TO_EDGE, CM_TEXTURE_FILTER_NEAREST, true);
-	voxelTerrain.textures[1] = cm_load_texture(mapPath1, CM_TEXTURE_WRAP_CLAMP_TO_EDGE, CM_TEXTURE_FILTER_NEAREST, true);
-	voxelTerrain.textures[2] = cm_load_texture(mapPath2, CM_TEXTURE_WRAP_CLAMP_TO_EDGE, CM_TEXTURE_FILTER_NEAREST, true);
+	for (int i = 0; i < 3; ++i)
+	{
+		Path mapPath = TO_RES_PATH(mapPath, terrainTexturePaths[i]);
+		memcpy(mapPaths[i], mapPath, sizeof(Path));
+		paths[i] = mapPaths[i];
+	}
+
+	//Faces repeat their layer over the merged quads instead of wrapping in the atlas
+	voxelTerrain.surfaceTextures = cm_load_texture_atlas_array(paths, 3, TERRAIN_TEXTURE_TILE_SIZE, CM_TEXTURE_WRAP_REPEAT, CM_TEXTURE_FILTER_NEAREST);
 }
 
 static void LoadBuffers()
 {
+	voxelTerrain.drawDataVbo = cm_load_vbo(TERRAIN_DRAW_DATA_FRAMES * sizeof(voxelTerrain.drawData), 0, NULL, (Ebo){0});
+	VaoAttribute drawAttribute = { .size = 4, .type = CM_UINT, .normalized = false, .stride = sizeof(voxelTerrain.drawData[0]) };
+
 	for (int i = 0; i < TERRAIN_CHUNK_COUNT; ++i)
 	{
 		VaoAttribute attributes[] =
@@ -245,47 +385,32 @@ static void LoadBuffers()
 		vbo.ebo = (Ebo){0};
 		
 		voxelTerrain.chunkVaos[i] = cm_load_vao(attributes, 1, vbo);
+		cm_set_vao_instance_attribute(voxelTerrain.chunkVaos[i], 1, drawAttribute, voxelTerrain.drawDataVbo);
+#ifdef TERRAIN_UPLOAD_THREAD
+		voxelTerrain.spareVbos[i] = cm_load_vbo(0, 0, NULL, (Ebo){0});
+		voxelTerrain.spareVboFrames[i] = 0;
+		voxelTerrain.isSpareVboBusy[i] = false;
+#endif
 	}
 
+#ifdef TERRAIN_VOXEL_SSBO
+	voxelTerrain.voxelPool = create_terrain_voxel_pool(TERRAIN_CHUNK_COUNT, TERRAIN_VOXEL_POOL_BRICKS);
 	voxelTerrain.voxelsSsbo = cm_load_ssbo(TERRAIN_VOXELS_SSBO_BINDING,
-	                                       TERRAIN_CHUNK_VOXEL_COUNT * TERRAIN_CHUNK_COUNT, NULL);
+	                                       TERRAIN_VOXEL_POOL_BRICKS * TERRAIN_BRICK_VOXEL_COUNT, NULL);
+	voxelTerrain.voxelPagesSsbo = cm_load_ssbo(TERRAIN_VOXEL_PAGES_SSBO_BINDING, TERRAIN_CHUNK_COUNT * TERRAIN_CHUNK_BRICKS * sizeof(uint32_t),
+	                                           voxelTerrain.voxelPool.pages);
+#endif
 }
 
 static void InitTerrainNoise()
 {
-	voxelTerrain.caveNoise = get_terrain_cave_noise();
-	voxelTerrain.biomes[BIOME_FLAT] = get_terrain_biome_flat_noise();
-	voxelTerrain.biomes[BIOME_SMALL_HILL] = get_terrain_biome_small_hill_noise();
-	voxelTerrain.biomes[BIOME_HILL] = get_terrain_biome_hill_noise();
-	voxelTerrain.biomes[BIOME_MOUNTAIN] = get_terrain_biome_mountain_noise();
-	voxelTerrain.biomes[BIOME_HIGH_MOUNTAIN] = get_terrain_biome_high_mountain_noise();
-
 #ifdef TERRAIN_RANDOM_WORLD_SEED
 	int32_t worldSeed = rand() % 10000000;
 #else
 	int32_t worldSeed = TERRAIN_WORLD_SEED % 10000000;
 #endif
 
-	for (uint32_t i = 0; i < BIOME_COUNT; ++i) voxelTerrain.biomes[i].seed = worldSeed;
-}
-
-static void LoadTerrainChunks()
-{
-	for (uint32_t x = 0; x < TERRAIN_VIEW_RANGE; ++x)
-		for (uint32_t z = 0; z < TERRAIN_VIEW_RANGE; ++z)
-		{
-			if(SurroundGroupsAreLoaded(x, z))
-			{
-				if(GroupNeedsFaces(x, z)) send_terrain_group_face_creation_job(x, z);
-				else
-				{
-					TerrainChunkGroup group = voxelTerrain.chunkGroups[x * TERRAIN_VIEW_RANGE + z];
-					for (int y = 0; y < TERRAIN_HEIGHT; ++y)
-						if(group.chunks[y].flags.state == CHUNK_REQUIRES_FACES)
-							send_terrain_face_creation_job(x, y, z);
-				}
-			}
-		}
+	init_terrain_noise(&voxelTerrain, worldSeed);
 }
 
 static TerrainChunkGroup InitializeChunkGroup(uint32_t ssboId)
@@ -296,6 +421,7 @@ static TerrainChunkGroup InitializeChunkGroup(uint32_t ssboId)
 			.id = { 0, 0 },
 			.isAlive = true,
 			.heightMap = CM_MALLOC(TERRAIN_CHUNK_HORIZONTAL_SLICE),
+			.biomeMap = CM_MALLOC(TERRAIN_BIOME_MAP_SIZE * TERRAIN_BIOME_MAP_SIZE * sizeof(float)),
 			.ssboId = ssboId
 		};
 
@@ -306,6 +432,10 @@ static TerrainChunkGroup InitializeChunkGroup(uint32_t ssboId)
 				.flags = 0,
 				.buffer = list_create(0),
 				.voxels = CM_MALLOC(TERRAIN_CHUNK_VOXEL_COUNT),
+				.occupancy = CM_CALLOC(TERRAIN_CHUNK_HORIZONTAL_SLICE, sizeof(uint64_t)),
+#ifdef TERRAIN_VOXEL_SSBO
+				.bricks = CM_MALLOC(TERRAIN_CHUNK_BRICKS * sizeof(uint32_t)),
+#endif
 			};
 
 		group.chunks[y] = chunk;
@@ -329,12 +459,26 @@ static void UnloadChunkGroup(TerrainChunkGroup* group)
 	{
 		TerrainChunk* chunk = &group->chunks[y];
 		chunk->flags.state = CHUNK_REQUIRES_FACES;
+		RemoveDrawable(group->ssboId * TERRAIN_HEIGHT + y);
 //		list_clear(&chunk->buffer);
 
 		chunk->flags.isUploaded = 0;
-		chunk->flags.faceCount = 0;
+		chunk->faceCount = 0;
+		chunk->uploadTicket++;
+		if(chunk->isStaged)
+		{
+			cm_release_staging(chunk->staging);
+			chunk->isStaged = 0;
+		}
+#ifdef TERRAIN_VOXEL_SSBO
+		//A running upload writes the bricks of the chunk, its callback frees them
+		uint32_t chunkId = group->ssboId * TERRAIN_HEIGHT + y;
+		if(!IsChunkUploading(chunkId)) free_terrain_chunk_bricks(&voxelTerrain.voxelPool, chunkId, cm_get_gpu_frame());
+		chunk->brickCount = 0;
+#endif
 
 		memset(chunk->voxels, 0, TERRAIN_CHUNK_VOXEL_COUNT);
+		memset(chunk->occupancy, 0, TERRAIN_CHUNK_HORIZONTAL_SLICE * sizeof(uint64_t));
 	}
 }
 
@@ -343,10 +487,15 @@ static void DestroyChunkGroup(TerrainChunkGroup* group)
 	if(!group->isAlive) return;
 	group->isAlive = false;
 	CM_FREE(group->heightMap);
+	CM_FREE(group->biomeMap);
 
 	for (int y = 0; y < TERRAIN_HEIGHT; ++y)
 	{
 		CM_FREE(group->chunks[y].voxels);
+		CM_FREE(group->chunks[y].occupancy);
+#ifdef TERRAIN_VOXEL_SSBO
+		CM_FREE(group->chunks[y].bricks);
+#endif
 		list_clear(&group->chunks[y].buffer);
 	}
 }
@@ -362,7 +511,7 @@ static void RecreateGroup(ivec2 id, int x, int z)
 
 	RecreateChunkGroup(&voxelTerrain.chunkGroups[x * TERRAIN_VIEW_RANGE + z],
 	                   chunkId[0], chunkId[1]);
-	send_terrain_noise_job(x, z);
+	schedule_terrain_generation(x, z);
 }
 
 static void SetupInitialChunks(Camera3D camera)
@@ -375,22 +524,40 @@ static void SetupInitialChunks(Camera3D camera)
 
 	glm_ivec2_copy(id, voxelTerrain.loadedCenter);
 
-	for (int x = 0; x < TERRAIN_VIEW_RANGE; ++x)
-		for (int z = 0; z < TERRAIN_VIEW_RANGE; ++z)
-			RecreateGroup(id, x, z);
+	//Generation jobs run in submission order and ready meshing jobs go first, so the center is drawable early
+	cm_spiral_loop(TERRAIN_VIEW_RANGE, TERRAIN_VIEW_RANGE, RecreateInitialGroup);
+	cm_spiral_loop(TERRAIN_VIEW_RANGE, TERRAIN_VIEW_RANGE, ScheduleInitialMeshing);
+}
+
+static void RecreateInitialGroup(unsigned int x, unsigned int z)
+{
+	RecreateGroup(voxelTerrain.loadedCenter, (int)x, (int)z);
 }
 
-static void SetRequiresFaces(uint32_t x, uint32_t z)
+static void ScheduleInitialMeshing(unsigned int x, unsigned int z)
 {
-	TerrainChunkGroup* group = &voxelTerrain.chunkGroups[x * TERRAIN_VIEW_RANGE + z];
+	schedule_terrain_group_meshing(x, z);
+}
+
+//The window is loaded once every chunk of the initial load reached the GPU
+static void CheckWindowLoaded()
+{
+	for (uint32_t i = 0; i < TERRAIN_VIEW_RANGE * TERRAIN_VIEW_RANGE; ++i)
+	{
+		for (uint32_t y = 0; y < TERRAIN_HEIGHT; ++y)
+		{
+			TerrainChunk* chunk = &voxelTerrain.chunkGroups[i].chunks[y];
+			if(chunk->flags.state != CHUNK_READY_TO_DRAW || (chunk->faceCount > 0 && !chunk->flags.isUploaded)) return;
+		}
+	}
 
-	for (uint32_t y = 0; y < TERRAIN_HEIGHT; ++y)
-		group->chunks[y].flags.state = CHUNK_REQUIRES_FACES;
+	voxelTerrain.windowLoadTime = cm_get_time() - voxelTerrain.loadStartTime;
+	log_info("Terrain window loaded after %.1f ms\n", voxelTerrain.windowLoadTime * 1000.0);
 }
 
 static void ReloadChunks(Camera3D camera)
 {
-	if(voxelTerrain.pool->jobCount > 0 || !AllChunksAreLoaded()) return;
+	if(!cm_is_job_graph_idle(voxelTerrain.graph)) return;
 
 	vec3 position = { 0 };
 	glm_vec3_copy(camera.position, position);
@@ -422,9 +589,9 @@ static void ReloadChunks(Camera3D camera)
 				for (int z = 0; z < TERRAIN_VIEW_RANGE; ++z)
 					RecreateGroup(id, x, z);
 
-			for (uint32_t x = TERRAIN_VIEW_RANGE - dataShift[0] - 1; x < TERRAIN_VIEW_RANGE - dataShift[0]; ++x)
+			for (uint32_t x = TERRAIN_VIEW_RANGE - dataShift[0] - 1; x < TERRAIN_VIEW_RANGE; ++x)
 				for (uint32_t z = 0; z < TERRAIN_VIEW_RANGE; ++z)
-					SetRequiresFaces(x, z);
+					schedule_terrain_group_meshing(x, z);
 
 			voxelTerrain.loadedCenter[0] = id[0];
 		}
@@ -445,9 +612,9 @@ static void ReloadChunks(Camera3D camera)
 				for (int z = 0; z < TERRAIN_VIEW_RANGE; ++z)
 					RecreateGroup(id, x, z);
 
-			for (int x = dataShift[0]; x < dataShift[0] + 1; ++x)
+			for (int x = 0; x < dataShift[0] + 1; ++x)
 				for (int z = 0; z < TERRAIN_VIEW_RANGE; ++z)
-					SetRequiresFaces(x, z);
+					schedule_terrain_group_meshing(x, z);
 
 			voxelTerrain.loadedCenter[0] = id[0];
 		}
@@ -472,8 +639,8 @@ static void ReloadChunks(Camera3D camera)
 					RecreateGroup(id, x, z);
 
 			for (int x = 0; x < TERRAIN_VIEW_RANGE; ++x)
-				for (int z = TERRAIN_VIEW_RANGE - dataShift[1] - 1; z < TERRAIN_VIEW_RANGE - dataShift[1]; ++z)
-					SetRequiresFaces(x, z);
+				for (int z = TERRAIN_VIEW_RANGE - dataShift[1] - 1; z < TERRAIN_VIEW_RANGE; ++z)
+					schedule_terrain_group_meshing(x, z);
 
 			voxelTerrain.loadedCenter[1] = id[1];
 		}
@@ -499,11 +666,13 @@ static void ReloadChunks(Camera3D camera)
 					RecreateGroup(id, x, z);
 
 			for (int x = 0; x < TERRAIN_VIEW_RANGE; ++x)
-				for (int z =  dataShift[1]; z < dataShift[1] + 1; ++z)
-					SetRequiresFaces(x, z);
+				for (int z = 0; z < dataShift[1] + 1; ++z)
+					schedule_terrain_group_meshing(x, z);
 
 			voxelTerrain.loadedCenter[1] = id[1];
 		}
+
+		RefreshSlotGroups();
 	}
 }
 
@@ -511,93 +680,564 @@ static void ReloadChunks(Camera3D camera)
 
 //region Utils
 
-static void PassTerrainDataToShader(UniformData* data)
+//Loading lasts until the chunks around the camera are drawable, not only generated
+static bool DelayedLoader()
 {
-	uint32_t index[4];
-	memcpy(index, data->chunk, sizeof(ivec3));
-	index[3] = data->chunkId;
+	uint32_t start = TERRAIN_VIEW_RANGE / 2 - TERRAIN_LOADING_EDGE, end = start + TERRAIN_LOADING_EDGE * 2;
 	
-	TerrainShaderUniforms uniforms = voxelTerrain.uniforms;
-	cm_set_uniform_uvec4(uniforms.u_chunkIndex, index);
-	cm_set_uniform_vec3(uniforms.u_ambientColor, TERRAIN_SHADER_AMBIENT_COLOR);
+	for (uint32_t x = start; x < end; ++x)
+	{
+		for (uint32_t z = start; z < end; ++z)
+		{
+			TerrainChunkGroup* group = &voxelTerrain.chunkGroups[x * TERRAIN_VIEW_RANGE + z];
+			if(group->state != CHUNK_GROUP_READY) return true;
+
+			for (uint32_t y = 0; y < TERRAIN_HEIGHT; ++y)
+				if(group->chunks[y].flags.state != CHUNK_READY_TO_DRAW) return true;
+		}
+	}
+	
+	return false;
 }
 
-static bool AllChunksAreLoaded()
+//endregion
+
+//region Chunk Lists
+
+static void RefreshSlotGroups()
 {
 	for (uint32_t i = 0; i < TERRAIN_VIEW_RANGE * TERRAIN_VIEW_RANGE; ++i)
+		voxelTerrain.slotGroups[voxelTerrain.chunkGroups[i].ssboId] = &voxelTerrain.chunkGroups[i];
+}
+
+static void AddDrawable(TerrainChunkGroup* group, uint32_t yId)
+{
+	uint32_t chunkId = group->ssboId * TERRAIN_HEIGHT + yId;
+	if(voxelTerrain.drawableIds[chunkId] >= 0) return;
+
+	UniformData data =
+		{
+			.chunkId = chunkId,
+			.chunk = { (int)group->id[0], (int)yId, (int)group->id[1] }
+		};
+
+	voxelTerrain.drawableIds[chunkId] = (int32_t)voxelTerrain.drawableCount;
+	voxelTerrain.drawables[voxelTerrain.drawableCount++] = data;
+}
+
+static void RemoveDrawable(uint32_t chunkId)
+{
+	int32_t index = voxelTerrain.drawableIds[chunkId];
+	if(index < 0) return;
+
+	UniformData last = voxelTerrain.drawables[--voxelTerrain.drawableCount];
+	voxelTerrain.drawables[index] = last;
+	voxelTerrain.drawableIds[last.chunkId] = index;
+	voxelTerrain.drawableIds[chunkId] = -1;
+}
+
+static void CollectMeshedChunks()
+{
+	List* meshed = &voxelTerrain.meshedChunks;
+	if(meshed->endPosition > 0)
 	{
-		if(voxelTerrain.chunkGroups[i].state == CHUNK_GROUP_READY)
+		List* queue = &voxelTerrain.uploadQueue;
+		if(voxelTerrain.uploadHead == queue->endPosition)
 		{
-			for (uint32_t y = 0; y < TERRAIN_HEIGHT; ++y)
-			{
-				if(voxelTerrain.chunkGroups[i].chunks[y].flags.state < CHUNK_REQUIRES_UPLOAD)
-					return false;
-			}
+			list_reset(queue);
+			voxelTerrain.uploadHead = 0;
 		}
-		else return false;
-	}
 
-	return true;
+		for (uint32_t i = 0; i < meshed->endPosition; i += sizeof(uint32_t))
+			list_add(queue, TERRAIN_CHUNK_COUNT, (char*)meshed->data + i, sizeof(uint32_t));
+		list_reset(meshed);
+		voxelTerrain.isUploadQueueSorted = false;
+	}
 }
 
-static bool SurroundGroupsAreLoaded(uint32_t xId, uint32_t zId)
+//isSubmitted is set when the upload thread got the chunk, the main thread did the upload otherwise
+static uint32_t UploadChunk(uint32_t chunkId, bool* isSubmitted)
 {
-	bool areLoaded = voxelTerrain.chunkGroups[xId * TERRAIN_VIEW_RANGE + zId].state == CHUNK_GROUP_READY;
-	areLoaded = areLoaded && (xId == 0 || voxelTerrain.chunkGroups[(xId - 1) * TERRAIN_VIEW_RANGE + zId].state == CHUNK_GROUP_READY);
-	areLoaded = areLoaded && (xId == (TERRAIN_VIEW_RANGE - 1) || voxelTerrain.chunkGroups[(xId + 1) * TERRAIN_VIEW_RANGE + zId].state == CHUNK_GROUP_READY);
+	TerrainChunkGroup* group = voxelTerrain.slotGroups[chunkId / TERRAIN_HEIGHT];
+	uint32_t yId = chunkId % TERRAIN_HEIGHT;
+	TerrainChunk* chunk = &group->chunks[yId];
+	uint16_t faceCount = chunk->faceCount;
+
+	double startTime = terrain_metrics_job_started(TERRAIN_STAGE_UPLOAD, chunkId);
+
+	chunk->flags.state = CHUNK_READY_TO_DRAW;
+	chunk->uploadTicket++;
+	*isSubmitted = false;
+	if(faceCount == 0)
+	{
+		RemoveDrawable(chunkId);
+#ifdef TERRAIN_VOXEL_SSBO
+		free_terrain_chunk_bricks(&voxelTerrain.voxelPool, chunkId, cm_get_gpu_frame());
+#endif
+		terrain_metrics_job_finished(TERRAIN_STAGE_UPLOAD, startTime);
+		return 0;
+	}
+
+#ifdef TERRAIN_VOXEL_SSBO
+	//The mesh has no block types, a chunk without its bricks is not drawn until a later frame finds room for them
+	uint32_t previousPages[TERRAIN_CHUNK_BRICKS];
+	if(!AllocChunkBricks(chunkId, chunk, previousPages))
+	{
+		RemoveDrawable(chunkId);
+		retire_terrain_bricks(&voxelTerrain.voxelPool, previousPages, cm_get_gpu_frame());
+		chunk->flags.state = CHUNK_REQUIRES_UPLOAD;
+		list_add(&voxelTerrain.meshedChunks, TERRAIN_CHUNK_COUNT, &chunkId, sizeof(uint32_t));
+		terrain_metrics_job_finished(TERRAIN_STAGE_UPLOAD, startTime);
+		return 0;
+	}
+	const uint32_t* pages = get_terrain_chunk_pages(&voxelTerrain.voxelPool, chunkId);
+#endif
+
+	uint32_t uploadSize = GetChunkUploadSize(chunk);
+#ifdef TERRAIN_UPLOAD_THREAD
+#ifdef TERRAIN_VOXEL_SSBO
+	*isSubmitted = SubmitChunkUpload(chunkId, chunk, startTime, previousPages);
+#else
+	*isSubmitted = SubmitChunkUpload(chunkId, chunk, startTime);
+#endif
+	if(*isSubmitted) return uploadSize;
+#endif
+
+	Vbo* vbo = &voxelTerrain.chunkVaos[chunkId].vbo;
+	uint32_t meshSize = chunk->buffer.endPosition;
+
+	if(chunk->isStaged)
+	{
+		cm_reserve_vbo(vbo, meshSize);
+		vbo->dataSize = meshSize;
+		vbo->data = NULL;
+		cm_copy_staging_to_buffer(chunk->staging, 0, vbo->id, 0, meshSize);
+#ifdef TERRAIN_VOXEL_SSBO
+		UploadChunkBricks(chunkId, pages, chunk->staging, meshSize, NULL);
+#endif
+		cm_release_staging(chunk->staging);
+		chunk->isStaged = false;
+	}
+	else
+	{
+		cm_reupload_vbo(vbo, meshSize, chunk->buffer.data);
+#ifdef TERRAIN_VOXEL_SSBO
+		uint8_t* packed = CM_MALLOC(chunk->brickCount * TERRAIN_BRICK_VOXEL_COUNT + 1);
+		pack_terrain_bricks(chunk->voxels, chunk->bricks, packed);
+		UploadChunkBricks(chunkId, pages, chunk->staging, 0, packed);
+		CM_FREE(packed);
+#endif
+	}
 
-	areLoaded = areLoaded && (zId == 0 || voxelTerrain.chunkGroups[xId * TERRAIN_VIEW_RANGE + zId - 1].state == CHUNK_GROUP_READY);
-	areLoaded = areLoaded && (zId == (TERRAIN_VIEW_RANGE - 1) || voxelTerrain.chunkGroups[xId * TERRAIN_VIEW_RANGE + zId + 1].state == CHUNK_GROUP_READY);
+#ifdef TERRAIN_VOXEL_SSBO
+	//The draws from this frame on read the new pages
+	retire_terrain_bricks(&voxelTerrain.voxelPool, previousPages, cm_get_gpu_frame());
+#endif
 
-	return areLoaded;
+	vbo->vertexCount = faceCount * TERRAIN_MEM_PRINT_SIZE;
+	chunk->flags.isUploaded = true;
+	AddDrawable(group, yId);
+	terrain_metrics_job_finished(TERRAIN_STAGE_UPLOAD, startTime);
+	return uploadSize;
 }
 
-static bool GroupNeedsFaces(uint32_t xId, uint32_t zId)
+static uint32_t GetChunkUploadSize(TerrainChunk* chunk)
 {
-	TerrainChunkGroup group = voxelTerrain.chunkGroups[xId * TERRAIN_VIEW_RANGE + zId];
-	bool needsFaces = true;
-	for (int y = 0; y < TERRAIN_HEIGHT; ++y)
-		needsFaces = needsFaces && group.chunks[y].flags.state == CHUNK_REQUIRES_FACES;
-	return needsFaces;
+#ifdef TERRAIN_VOXEL_SSBO
+	return chunk->buffer.endPosition + chunk->brickCount * TERRAIN_BRICK_VOXEL_COUNT;
+#else
+	return chunk->buffer.endPosition;
+#endif
 }
 
-static bool DelayedLoader()
+//The upload thread owns the spare vbo and the new bricks of the chunk until its callback ran
+static bool IsChunkUploading(uint32_t chunkId)
 {
-	uint32_t start = TERRAIN_VIEW_RANGE / 2 - TERRAIN_LOADING_EDGE, end = start + TERRAIN_LOADING_EDGE * 2;
-	
-	for (uint32_t x = start; x < end; ++x)
+#ifdef TERRAIN_UPLOAD_THREAD
+	return voxelTerrain.isSpareVboBusy[chunkId];
+#else
+	return false;
+#endif
+}
+
+#ifdef TERRAIN_VOXEL_SSBO
+//A full pool leaves the mixed bricks pending, the caller retires the previous pages once no draw reads them
+static bool AllocChunkBricks(uint32_t chunkId, TerrainChunk* chunk, uint32_t* previousPages)
+{
+	TerrainVoxelPool* pool = &voxelTerrain.voxelPool;
+
+	static bool isFullLogged = false;
+	if(alloc_terrain_chunk_bricks(pool, chunkId, chunk->bricks, previousPages))
 	{
-		for (uint32_t z = start; z < end; ++z)
+		isFullLogged = false;
+		return true;
+	}
+
+	if(!isFullLogged)
+	{
+		log_warn("Voxel pool is full (%u bricks), chunks wait for freed bricks before being drawn\n", pool->capacity);
+		isFullLogged = true;
+	}
+	return false;
+}
+
+//Mixed bricks come from the staging allocation at bricksOffset, or from packed when it is set
+static void UploadChunkBricks(uint32_t chunkId, const uint32_t* pages, StagingAllocation staging,
+                              uint32_t bricksOffset, const uint8_t* packed)
+{
+	//Bricks are handed out in increasing order, so most of them end up in a few runs
+	uint32_t runStart = 0, runLength = 0, runPackedId = 0, packedId = 0;
+	for (uint32_t i = 0; i < TERRAIN_CHUNK_BRICKS; ++i)
+	{
+		if(pages[i] & TERRAIN_BRICK_UNIFORM || pages[i] == TERRAIN_BRICK_PENDING) continue;
+
+		if(runLength > 0 && pages[i] == runStart + runLength) runLength++;
+		else
 		{
-			if(voxelTerrain.chunkGroups[x * TERRAIN_VIEW_RANGE + z].state != CHUNK_GROUP_READY)
-				return true;
+			CopyBrickRun(staging, bricksOffset, packed, runPackedId, runStart, runLength);
+			runStart = pages[i];
+			runPackedId = packedId;
+			runLength = 1;
 		}
+		packedId++;
 	}
-	
-	return false;
+	CopyBrickRun(staging, bricksOffset, packed, runPackedId, runStart, runLength);
+
+	uint32_t pagesSize = TERRAIN_CHUNK_BRICKS * sizeof(uint32_t);
+	cm_upload_ssbo(voxelTerrain.voxelPagesSsbo, chunkId * pagesSize, pagesSize, pages);
 }
 
-static bool TryUploadGroup(TerrainChunkGroup* group)
+static void CopyBrickRun(StagingAllocation staging, uint32_t bricksOffset, const uint8_t* packed,
+                         uint32_t packedId, uint32_t poolId, uint32_t count)
 {
-	bool uploaded = false;
-	for (int y = 0; y < TERRAIN_HEIGHT; ++y)
+	if(count == 0) return;
+
+	uint32_t size = count * TERRAIN_BRICK_VOXEL_COUNT;
+	uint32_t poolOffset = poolId * TERRAIN_BRICK_VOXEL_COUNT;
+	if(packed) cm_upload_ssbo(voxelTerrain.voxelsSsbo, poolOffset, size, packed + packedId * TERRAIN_BRICK_VOXEL_COUNT);
+	else cm_copy_staging_to_buffer(staging, bricksOffset + packedId * TERRAIN_BRICK_VOXEL_COUNT,
+	                               voxelTerrain.voxelsSsbo.id, poolOffset, size);
+}
+#endif
+
+#ifdef TERRAIN_UPLOAD_THREAD
+//Owns the staging allocation or the mesh of the chunk, and the spare vbo of the chunk until the GPU is done with it
+typedef struct
+{
+	uint32_t chunkId;
+	uint32_t ticket;
+	uint32_t meshSize;
+	uint32_t uploadSize;
+	double startTime;           //for the terrain metrics, the upload ends with its callback
+	Vbo vbo;
+	bool isStaged;
+	StagingAllocation staging;
+	List mesh;
+#ifdef TERRAIN_VOXEL_SSBO
+	uint32_t pages[TERRAIN_CHUNK_BRICKS];
+	uint32_t previousPages[TERRAIN_CHUNK_BRICKS];   //drawn until the callback, retired by it
+	uint8_t* packed;
+#endif
+}TerrainUploadArgs;
+
+//The upload thread writes the spare vbo while the vao keeps drawing the other one, the spare has to be back
+//from the previous upload and out of the frames still drawing it
+#ifdef TERRAIN_VOXEL_SSBO
+static bool SubmitChunkUpload(uint32_t chunkId, TerrainChunk* chunk, double startTime, const uint32_t* previousPages)
+#else
+static bool SubmitChunkUpload(uint32_t chunkId, TerrainChunk* chunk, double startTime)
+#endif
+{
+	if(!cm_is_upload_thread_available()) return false;
+	if(voxelTerrain.isSpareVboBusy[chunkId] || !cm_is_gpu_frame_done(voxelTerrain.spareVboFrames[chunkId])) return false;
+
+	TerrainUploadArgs* args = CM_MALLOC(sizeof(TerrainUploadArgs));
+	*args = (TerrainUploadArgs)
+		{
+			.chunkId = chunkId,
+			.ticket = chunk->uploadTicket,
+			.meshSize = chunk->buffer.endPosition,
+			.uploadSize = GetChunkUploadSize(chunk),
+			.startTime = startTime,
+			.vbo = voxelTerrain.spareVbos[chunkId],
+			.isStaged = chunk->isStaged,
+			.staging = chunk->staging,
+			.mesh = chunk->buffer,
+		};
+	args->vbo.vertexCount = chunk->faceCount * TERRAIN_MEM_PRINT_SIZE;
+
+#ifdef TERRAIN_VOXEL_SSBO
+	//The pool is only touched by the main thread, the upload thread gets a copy of the pages
+	memcpy(args->pages, get_terrain_chunk_pages(&voxelTerrain.voxelPool, chunkId), sizeof(args->pages));
+	memcpy(args->previousPages, previousPages, sizeof(args->previousPages));
+	args->packed = NULL;
+	if(!args->isStaged)
 	{
-		TerrainChunk* chunk = &group->chunks[y];
-		uint16_t faceCount = chunk->flags.faceCount;
-		if(faceCount == 0) continue;
+		args->packed = CM_MALLOC(chunk->brickCount * TERRAIN_BRICK_VOXEL_COUNT + 1);
+		pack_terrain_bricks(chunk->voxels, chunk->bricks, args->packed);
+	}
+#endif
 
-		if(chunk->flags.state == CHUNK_REQUIRES_UPLOAD)
+	ThreadJob job = { .args = args, .job = T_UploadChunk, .callbackJob = ChunkUploadFinished, .name = "Chunk Upload" };
+	if(!cm_submit_upload(job))
+	{
+		//The main thread uploads the chunk this frame with the same pages and retires the previous ones
+#ifdef TERRAIN_VOXEL_SSBO
+		CM_FREE(args->packed);
+#endif
+		CM_FREE(args);
+		return false;
+	}
+
+	//The meshing worker starts a new list next time, the uploaded one is freed by the upload thread
+	voxelTerrain.isSpareVboBusy[chunkId] = true;
+	if(args->isStaged) chunk->isStaged = false;
+	else chunk->buffer = list_create(0);
+	return true;
+}
+
+static void T_UploadChunk(uint32_t threadId, void* args)
+{
+	TerrainUploadArgs* upload = args;
+
+	if(upload->isStaged)
+	{
+		cm_reserve_vbo(&upload->vbo, upload->meshSize);
+		upload->vbo.dataSize = upload->meshSize;
+		cm_copy_staging_to_buffer(upload->staging, 0, upload->vbo.id, 0, upload->meshSize);
+	}
+	else
+	{
+		cm_reupload_vbo(&upload->vbo, upload->meshSize, upload->mesh.data);
+		list_clear(&upload->mesh);
+	}
+	upload->vbo.data = NULL;
+
+#ifdef TERRAIN_VOXEL_SSBO
+	UploadChunkBricks(upload->chunkId, upload->pages, upload->staging, upload->meshSize, upload->packed);
+	CM_FREE(upload->packed);
+#endif
+}
+
+//Main thread, the chunk was unloaded or uploaded again since the submission when the ticket changed
+static void ChunkUploadFinished(uint32_t threadId, void* args)
+{
+	TerrainUploadArgs* upload = args;
+	if(upload->isStaged) cm_release_staging(upload->staging);
+	terrain_metrics_job_finished(TERRAIN_STAGE_UPLOAD, upload->startTime);
+
+	double cpuTime, gpuTime;
+	cm_get_upload_timing(&cpuTime, &gpuTime);
+	AddUploadCost(upload->uploadSize, cpuTime, gpuTime);
+
+	TerrainChunkGroup* group = voxelTerrain.slotGroups[upload->chunkId / TERRAIN_HEIGHT];
+	uint32_t yId = upload->chunkId % TERRAIN_HEIGHT;
+	TerrainChunk* chunk = &group->chunks[yId];
+	voxelTerrain.isSpareVboBusy[upload->chunkId] = false;
+#ifdef TERRAIN_VOXEL_SSBO
+	retire_terrain_bricks(&voxelTerrain.voxelPool, upload->previousPages, cm_get_gpu_frame());
+#endif
+
+	//A stale upload leaves the vao untouched, its buffer stays the spare with the capacity it grew to.
+	//No other upload of the chunk runs meanwhile, only unloading makes it stale and leaves its bricks to this callback
+	if(chunk->uploadTicket != upload->ticket)
+	{
+		voxelTerrain.spareVbos[upload->chunkId] = upload->vbo;
+#ifdef TERRAIN_VOXEL_SSBO
+		free_terrain_chunk_bricks(&voxelTerrain.voxelPool, upload->chunkId, cm_get_gpu_frame());
+#endif
+		return;
+	}
+
+	//The frames drawn so far read the previous vbo, it becomes the spare once the GPU is done with them
+	Vao* vao = &voxelTerrain.chunkVaos[upload->chunkId];
+	voxelTerrain.spareVbos[upload->chunkId] = vao->vbo;
+	voxelTerrain.spareVboFrames[upload->chunkId] = cm_get_gpu_frame();
+	cm_set_vao_vbo(vao, upload->vbo);
+
+	chunk->flags.isUploaded = true;
+	AddDrawable(group, yId);
+}
+#endif
+
+//endregion
+
+//region Uploading
+
+TerrainUploadStats get_terrain_upload_stats() { return voxelTerrain.uploadStats; }
+
+//Half of what the last frame left before the target frame time, within the configured range
+static double GetUploadBudget()
+{
+	uint32_t targetFrameRate = cm_get_target_frame_rate();
+	if(targetFrameRate == 0) return TERRAIN_UPLOAD_BUDGET_MS;
+
+	double headroom = 1000.0 / targetFrameRate - cm_frame_time() * 1000.0;
+	return glm_clamp(headroom * .5, TERRAIN_UPLOAD_MIN_BUDGET_MS, TERRAIN_UPLOAD_BUDGET_MS);
+}
+
+//Main thread uploads, the ones of the upload thread are timed on its context and added by their callbacks
+static void ReadUploadTimings()
+{
+	double gpuTime;
+
+	while(cm_read_gpu_timer(&voxelTerrain.uploadTimer, &gpuTime))
+	{
+		TerrainUploadSample sample = voxelTerrain.uploadSamples[voxelTerrain.firstUploadSample];
+		voxelTerrain.firstUploadSample = (voxelTerrain.firstUploadSample + 1) % MAX_GPU_TIMER_QUERIES;
+		AddUploadCost(sample.bytes, sample.cpuTime, gpuTime);
+	}
+}
+
+static void AddUploadCost(uint32_t bytes, double cpuTime, double gpuTime)
+{
+	TerrainUploadStats* stats = &voxelTerrain.uploadStats;
+	stats->lastGpuTime = gpuTime * 1000.0;
+	if(bytes == 0) return;
+
+	double cost = glm_max(gpuTime, cpuTime) * 1000.0 / ((double)bytes / (1 << 20));
+	stats->costPerMegabyte += (cost - stats->costPerMegabyte) * TERRAIN_UPLOAD_COST_SMOOTHING;
+}
+
+typedef struct
+{
+	float priority;
+	uint32_t chunkId;
+}UploadEntry;
+
+static int CompareUploadEntries(const void* a, const void* b)
+{
+	const UploadEntry* ea = a;
+	const UploadEntry* eb = b;
+
+	if(ea->priority != eb->priority) return ea->priority < eb->priority ? -1 : 1;
+	return (ea->chunkId > eb->chunkId) - (ea->chunkId < eb->chunkId);
+}
+
+//Drops stale and duplicated entries, then orders visible chunks first and nearest first.
+//The order is kept until chunks are queued, the camera enters another chunk or turns further than TERRAIN_UPLOAD_RESORT_COS
+static void SortUploadQueue()
+{
+	List* queue = &voxelTerrain.uploadQueue;
+	uint32_t count = (queue->endPosition - voxelTerrain.uploadHead) / sizeof(uint32_t);
+	if(count == 0) return;
+
+	Camera3D camera = get_camera();
+	ivec3 cameraChunk;
+	for (int i = 0; i < 3; ++i) cameraChunk[i] = (int)floorf(camera.position[i] / TERRAIN_CHUNK_SIZE);
+
+	if(voxelTerrain.isUploadQueueSorted && memcmp(cameraChunk, voxelTerrain.uploadSortChunk, sizeof(ivec3)) == 0 &&
+	   glm_vec3_dot(camera.direction, voxelTerrain.uploadSortDirection) >= TERRAIN_UPLOAD_RESORT_COS) return;
+
+	memcpy(voxelTerrain.uploadSortChunk, cameraChunk, sizeof(ivec3));
+	glm_vec3_copy(camera.direction, voxelTerrain.uploadSortDirection);
+	voxelTerrain.isUploadQueueSorted = true;
+
+	List* entryList = &voxelTerrain.uploadEntries;
+	list_reset(entryList);
+	uint32_t* ids = (uint32_t*)((char*)queue->data + voxelTerrain.uploadHead);
+	uint32_t entryCount = 0;
+
+	vec3 cameraPosition;
+	glm_vec3_copy(camera.position, cameraPosition);
+	BoundingVolume volume = { .extents = { TERRAIN_CHUNK_SIZE * .5f, TERRAIN_CHUNK_SIZE * .5f, TERRAIN_CHUNK_SIZE * .5f } };
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		TerrainChunkGroup* group = voxelTerrain.slotGroups[ids[i] / TERRAIN_HEIGHT];
+		uint32_t yId = ids[i] % TERRAIN_HEIGHT;
+		if(group->chunks[yId].flags.state != CHUNK_REQUIRES_UPLOAD) continue;
+
+		vec3 chunkPos = { (float)group->id[0] - TERRAIN_WORLD_EDGE, (float)yId, (float)group->id[1] - TERRAIN_WORLD_EDGE };
+		glm_vec3_scale(chunkPos, TERRAIN_CHUNK_SIZE, chunkPos);
+		glm_vec3_add(chunkPos, volume.extents, volume.center);
+
+		float priority = glm_vec3_distance2(volume.center, cameraPosition);
+		if(!cm_is_in_main_frustum(&volume)) priority += 1e12f;
+
+		UploadEntry entry = { priority, ids[i] };
+		list_add(entryList, count, &entry, sizeof(UploadEntry));
+		entryCount++;
+	}
+
+	UploadEntry* entries = entryList->data;
+	qsort(entries, entryCount, sizeof(UploadEntry), CompareUploadEntries);
+
+	list_reset(queue);
+	voxelTerrain.uploadHead = 0;
+	for (uint32_t i = 0; i < entryCount; ++i)
+	{
+		if(i > 0 && entries[i].chunkId == entries[i - 1].chunkId) continue;
+		list_add(queue, TERRAIN_CHUNK_COUNT, &entries[i].chunkId, sizeof(uint32_t));
+	}
+}
+
+//Uploads while the estimated cost fits the budget (ms), at least one chunk is uploaded per call
+static void UploadChunks(double budget)
+{
+	TerrainUploadStats* stats = &voxelTerrain.uploadStats;
+	ReadUploadTimings();
+	SortUploadQueue();
+#ifdef TERRAIN_VOXEL_SSBO
+	reclaim_terrain_bricks(&voxelTerrain.voxelPool, cm_get_completed_gpu_frame());
+#endif
+
+	List* queue = &voxelTerrain.uploadQueue;
+	double msPerByte = stats->costPerMegabyte / (1 << 20);
+	double estimatedCost = 0, mainThreadTime = 0;
+	uint32_t uploadedChunks = 0, uploadedBytes = 0, mainThreadBytes = 0;
+	bool isTimed = false;
+
+	while(voxelTerrain.uploadHead < queue->endPosition)
+	{
+		uint32_t chunkId;
+		memcpy(&chunkId, (char*)queue->data + voxelTerrain.uploadHead, sizeof(uint32_t));
+
+		//The order outlives the states, entries that went stale or were uploaded as a duplicate are skipped
+		TerrainChunk* chunk = &voxelTerrain.slotGroups[chunkId / TERRAIN_HEIGHT]->chunks[chunkId % TERRAIN_HEIGHT];
+		if(chunk->flags.state != CHUNK_REQUIRES_UPLOAD)
 		{
-			uint32_t id = group->ssboId * TERRAIN_HEIGHT + y;
-			cm_reupload_vbo(&voxelTerrain.chunkVaos[id].vbo, chunk->buffer.endPosition, chunk->buffer.data);
-			cm_upload_ssbo(voxelTerrain.voxelsSsbo, id * TERRAIN_CHUNK_VOXEL_COUNT, TERRAIN_CHUNK_VOXEL_COUNT, chunk->voxels);
-			chunk->flags.state = CHUNK_READY_TO_DRAW;
-			chunk->flags.isUploaded = true;
-//			list_clear(&chunk->buffer);
-			uploaded = true;
+			voxelTerrain.uploadHead += sizeof(uint32_t);
+			continue;
 		}
+
+		//One upload of a chunk runs at a time, the queue waits for the callback of the running one
+		if(IsChunkUploading(chunkId)) break;
+
+		double cost = GetChunkUploadSize(chunk) * msPerByte;
+		if(uploadedChunks > 0 && estimatedCost + cost > budget) break;
+
+		if(!isTimed) isTimed = cm_begin_gpu_timer(&voxelTerrain.uploadTimer);
+
+		voxelTerrain.uploadHead += sizeof(uint32_t);
+		double startTime = cm_get_time();
+		bool isSubmitted;
+		uint32_t bytes = UploadChunk(chunkId, &isSubmitted);
+		if(!isSubmitted)
+		{
+			mainThreadBytes += bytes;
+			mainThreadTime += cm_get_time() - startTime;
+		}
+
+		uploadedBytes += bytes;
+		estimatedCost += cost;
+		uploadedChunks++;
+	}
+
+	if(isTimed)
+	{
+		cm_end_gpu_timer(&voxelTerrain.uploadTimer);
+		uint32_t sampleId = (voxelTerrain.firstUploadSample + voxelTerrain.uploadTimer.pending - 1) % MAX_GPU_TIMER_QUERIES;
+		voxelTerrain.uploadSamples[sampleId] = (TerrainUploadSample){ mainThreadBytes, mainThreadTime };
 	}
-	return uploaded;
+
+	stats->budget = budget;
+	stats->estimatedCost = estimatedCost;
+	stats->frameChunks = uploadedChunks;
+	stats->frameBytes = uploadedBytes;
+	stats->pendingChunks = (queue->endPosition - voxelTerrain.uploadHead) / sizeof(uint32_t);
+	stats->totalChunks += uploadedChunks;
+	stats->totalBytes += uploadedBytes;
 }
 
-//endregion
\ No newline at end of file
+//endregion
@@ -31,10 +31,25 @@ typedef enum
 	BIOME_COUNT,
 }BiomeElevationType;
 
+typedef struct
+{
+	double budget;              //ms allowed during the last frame
+	double estimatedCost;       //ms the last frame uploads were estimated to cost
+	double costPerMegabyte;     //ms, moving average of the measured cpu and gpu upload time
+	double lastGpuTime;         //ms of the latest gpu measure
+	uint32_t frameChunks;
+	uint32_t frameBytes;
+	uint32_t pendingChunks;
+	uint64_t totalChunks;
+	uint64_t totalBytes;
+}TerrainUploadStats;
+
+void prefetch_terrain_assets();
 void load_terrain();
 bool loading_terrain();
 void update_terrain();
 void draw_terrain();
 void dispose_terrain();
+TerrainUploadStats get_terrain_upload_stats();
 
 #endif //TERRAIN_H
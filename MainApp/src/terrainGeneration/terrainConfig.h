@@ -4,11 +4,22 @@
 //This should not be modified
 #define TERRAIN_CHUNK_SIZE 64
 #define TERRAIN_VOXELS_SSBO_BINDING 16
+#define TERRAIN_VOXEL_PAGES_SSBO_BINDING 17
+#define TERRAIN_BRICK_SIZE 8
 #define TERRAIN_MEM_PRINT_SIZE 12
 
 //Can be modified
 #define TERRAIN_NUM_WORKER_THREADS 16
-#define TERRAIN_GROUP_UPLOAD_LIMIT 16
+
+//Milliseconds of upload per frame, scaled down to what is left of the frame
+#define TERRAIN_UPLOAD_BUDGET_MS 2.0
+#define TERRAIN_UPLOAD_MIN_BUDGET_MS .25
+#define TERRAIN_UPLOAD_INITIAL_MS_PER_MB 1.0
+#define TERRAIN_UPLOAD_COST_SMOOTHING .1
+//Cosine of the camera turn after which the upload queue is ordered again
+#define TERRAIN_UPLOAD_RESORT_COS .9f
+//Chunk buffers are filled by a thread sharing the GL context, the main thread uploads when it can not be created
+#define TERRAIN_UPLOAD_THREAD
 
 #define TERRAIN_VIEW_RANGE 16
 #define TERRAIN_HEIGHT 4
@@ -16,6 +27,22 @@
 #define TERRAIN_UPPER_EDGE 3
 
 #define TERRAIN_MAX_GREEDY_AXIS 64
+//Pixels of a block face in the surface atlases, every face becomes a layer of one texture array
+#define TERRAIN_TEXTURE_TILE_SIZE 16
+#define TERRAIN_AMBIENT_OCCLUSION
+//Block types are read by the shader from a mirror of every chunk instead of the vertex data, must match VOXEL_SSBO in voxel_terrain.frag
+//#define TERRAIN_VOXEL_SSBO
+//Bricks of the mirror that are not made of a single block type, 512 bytes each
+#define TERRAIN_VOXEL_POOL_BRICKS (1 << 17)
+
+//region Biome Selection
+#define TERRAIN_BIOME_NOISE FNL_NOISE_OPENSIMPLEX2
+#define TERRAIN_BIOME_FREQUENCY .002f
+//The selector is sampled every cell of a group and interpolated in between
+#define TERRAIN_BIOME_CELL_SIZE 8
+//Part of the way between two biomes where both of their noises are evaluated
+#define TERRAIN_BIOME_BLEND .3f
+//endregion
 
 //region Caves
 #define TERRAIN_CAVE_NOISE FNL_NOISE_PERLIN
@@ -34,6 +61,7 @@
 #define TERRAIN_FLAT_OCTAVES 6
 #define TERRAIN_FLAT_GAIN .5f
 #define TERRAIN_FLAT_LACUNARITY 2
+#define TERRAIN_FLAT_AMPLITUDE .2f
 //endregion
 
 //region Small Hills
@@ -43,6 +71,7 @@
 #define TERRAIN_SMALL_HILL_OCTAVES 6
 #define TERRAIN_SMALL_HILL_GAIN .5f
 #define TERRAIN_SMALL_HILL_LACUNARITY 2
+#define TERRAIN_SMALL_HILL_AMPLITUDE .35f
 //endregion
 
 //region Hills
@@ -52,6 +81,7 @@
 #define TERRAIN_HILL_OCTAVES 6
 #define TERRAIN_HILL_GAIN .5f
 #define TERRAIN_HILL_LACUNARITY 2
+#define TERRAIN_HILL_AMPLITUDE .5f
 //endregion
 
 //region Mountains
@@ -61,6 +91,7 @@
 #define TERRAIN_MOUNTAIN_OCTAVES 6
 #define TERRAIN_MOUNTAIN_GAIN .5f
 #define TERRAIN_MOUNTAIN_LACUNARITY 2
+#define TERRAIN_MOUNTAIN_AMPLITUDE .8f
 //endregion
 
 //region High Mountains
@@ -70,12 +101,21 @@
 #define TERRAIN_HIGH_MOUNTAIN_OCTAVES 6
 #define TERRAIN_HIGH_MOUNTAIN_GAIN .5f
 #define TERRAIN_HIGH_MOUNTAIN_LACUNARITY 2
+#define TERRAIN_HIGH_MOUNTAIN_AMPLITUDE 1.f
 //endregion
 
 //region Phong Lighting
 #define TERRAIN_SHADER_AMBIENT_COLOR (vec3){ 0.5f, 0.5f, 0.5f }
+//Frames of draw data kept apart in its buffer so a frame never overwrites one the GPU may still read
+#define TERRAIN_DRAW_DATA_FRAMES 3
 //endregion
 
+//Seconds between two rows of the terrain metrics, histograms only cover one interval
+#define TERRAIN_METRICS_INTERVAL 1.0
+//Rows are appended to this file when it is defined
+//#define TERRAIN_METRICS_CSV "terrain_metrics.csv"
+#define TERRAIN_HISTOGRAM_BUCKETS 32
+
 #define TERRAIN_LOADING_EDGE 3
 
 #define TERRAIN_MAX_AXIS_BLOCK_TYPES 16
@@ -5,11 +5,15 @@
 #include "coal_miner.h"
 #include "terrain.h"
 #include "terrainConfig.h"
+#include "terrain_voxel_pool.h"
 
 #define TERRAIN_CHUNK_VOXEL_COUNT TERRAIN_CHUNK_SIZE * TERRAIN_CHUNK_SIZE * TERRAIN_CHUNK_SIZE
 #define TERRAIN_CHUNK_COUNT TERRAIN_VIEW_RANGE * TERRAIN_VIEW_RANGE * TERRAIN_HEIGHT
 #define TERRAIN_CHUNK_HORIZONTAL_SLICE TERRAIN_CHUNK_SIZE * TERRAIN_CHUNK_SIZE
 #define TERRAIN_MIN_BUFFER_SIZE 128
+#define TERRAIN_BIOME_MAP_SIZE (TERRAIN_CHUNK_SIZE / TERRAIN_BIOME_CELL_SIZE + 1)
+
+#define TERRAIN_GRAPH_NODE(x, z, node) (((x) * TERRAIN_VIEW_RANGE + (z)) * TERRAIN_NODE_COUNT + (node))
 
 typedef enum
 {
@@ -19,6 +23,14 @@ typedef enum
 	CHUNK_READY_TO_DRAW,
 }ChunkState;
 
+//Known once the height map is generated, from the height range of the group
+typedef enum
+{
+	CHUNK_CONTENT_MIXED,
+	CHUNK_CONTENT_AIR,      //above every column, nothing to generate or mesh
+	CHUNK_CONTENT_SOLID,    //below the surface layer of every column, only caves are carved
+}ChunkContent;
+
 typedef enum
 {
 	CHUNK_GROUP_REQUIRES_NOISE_MAP,
@@ -26,26 +38,54 @@ typedef enum
 	CHUNK_GROUP_READY,
 }ChunkGroupState;
 
+//Job graph nodes of every group slot, the per chunk stages take TERRAIN_HEIGHT consecutive nodes
+typedef enum
+{
+	TERRAIN_NODE_HEIGHT_MAP,
+	TERRAIN_NODE_CAVES,
+	TERRAIN_NODE_SURFACE = TERRAIN_NODE_CAVES + TERRAIN_HEIGHT,
+	TERRAIN_NODE_GROUP_READY = TERRAIN_NODE_SURFACE + TERRAIN_HEIGHT,
+	TERRAIN_NODE_MESH,
+	TERRAIN_NODE_COUNT = TERRAIN_NODE_MESH + TERRAIN_HEIGHT,
+}TerrainGraphNode;
+
 typedef struct
 {
 	uint32_t chunkId;
 	ivec3 chunk;
 } UniformData;
 
+//Only written by the main thread, the bits share one memory location
 struct TerrainChunkFlags
 {
 	uint32_t isUploaded:1;
 	uint32_t yId:4;
 	uint32_t state:5;
-	uint32_t faceCount:16;
 }__attribute__((packed));
 typedef struct TerrainChunkFlags TerrainChunkFlags;
 
 typedef struct
 {
 	TerrainChunkFlags flags;
+	//written by the generation and meshing workers, the main thread reads them once their callbacks were drained
+	uint16_t faceCount;
+	uint8_t content;    //ChunkContent
+	bool isStaged;
+	//allocated size of the mesh buffer when the last meshing callback ran, the worker may be resizing it since
+	uint32_t meshBytes;
 	List buffer;
 	uint8_t* voxels;
+	//bit z of occupancy[y * TERRAIN_CHUNK_SIZE + x] is set for every non empty voxel
+	uint64_t* occupancy;
+	//mesh followed by the packed mixed bricks, written by the meshing worker when isStaged is set
+	StagingAllocation staging;
+	//changes whenever the uploaded content becomes stale, uploads finishing with an older one are dropped
+	uint32_t uploadTicket;
+#ifdef TERRAIN_VOXEL_SSBO
+	//pages classified by the meshing worker, pending ones are the mixed bricks
+	uint32_t* bricks;
+	uint32_t brickCount;
+#endif
 }TerrainChunk;
 
 typedef struct
@@ -55,12 +95,21 @@ typedef struct
 	uint32_t id[2];
 	uint32_t ssboId;
 	uint8_t* heightMap;
+	uint8_t minHeight;
+	uint8_t maxHeight;
+	//selector sampled on the corners of the biome cells, as a position between the biomes
+	float* biomeMap;
 	bool isAlive;
 }TerrainChunkGroup;
 
 typedef struct
 {
-	int u_chunkIndex;
+	uint32_t bytes;
+	double cpuTime;
+}TerrainUploadSample;
+
+typedef struct
+{
 	int u_surfaceTex;
 	
 	int u_ambientColor;
@@ -73,17 +122,59 @@ typedef struct
 	
 	fnl_state caveNoise;
 	fnl_state biomes[BIOME_COUNT];
+	fnl_state biomeSelector;
 
 	ThreadPool* pool;
+	JobGraph* graph;
 
 	Shader shader;
-	Texture textures[3];
+	Texture surfaceTextures;   // A layer per atlas tile, side then top then bottom
 	Ssbo voxelsSsbo;
+	Ssbo voxelPagesSsbo;
+	TerrainVoxelPool voxelPool;
 
 	ivec2 loadedCenter;
+	//initial load, in seconds from load_terrain, 0 until reached
+	double loadStartTime;
+	double firstFrameTime;              // Until the first frame that drew chunks was swapped
+	double windowLoadTime;
+	bool isFirstFrameDrawn;             // Set by draw_terrain, the swap time is read on the next update
 	Vao chunkVaos[TERRAIN_CHUNK_COUNT];
+#ifdef TERRAIN_UPLOAD_THREAD
+	//second vbo of every chunk, written by the upload thread and swapped into the vao once the GPU is done
+	Vbo spareVbos[TERRAIN_CHUNK_COUNT];
+	uint64_t spareVboFrames[TERRAIN_CHUNK_COUNT];   //gpu frame of the last draw from the spare
+	bool isSpareVboBusy[TERRAIN_CHUNK_COUNT];       //owned by an upload that has not finished
+#endif
 	TerrainChunkGroup chunkGroups[TERRAIN_VIEW_RANGE * TERRAIN_VIEW_RANGE];
 	TerrainChunkGroup* shiftGroups;
+	TerrainChunkGroup* slotGroups[TERRAIN_VIEW_RANGE * TERRAIN_VIEW_RANGE];   //indexed by ssboId
+
+	//chunk ids pushed by the meshing callbacks when the pool is drained, moved to the upload queue once per frame
+	List meshedChunks;
+	List uploadQueue;
+	uint32_t uploadHead;
+
+	//scratch of the queue sort, kept while no chunk is queued and the camera stays in its chunk
+	List uploadEntries;
+	bool isUploadQueueSorted;
+	ivec3 uploadSortChunk;
+	vec3 uploadSortDirection;
+
+	//gpu measures come back in order, a few frames late
+	GpuTimer uploadTimer;
+	TerrainUploadSample uploadSamples[MAX_GPU_TIMER_QUERIES];
+	uint32_t firstUploadSample;
+	TerrainUploadStats uploadStats;
+
+	UniformData drawables[TERRAIN_CHUNK_COUNT];
+	int32_t drawableIds[TERRAIN_CHUNK_COUNT];   //index in drawables or -1, indexed by chunk id
+	uint32_t drawableCount;
+
+	//xyz index and id of every visible chunk, read as an instance attribute from the base instance of its draw
+	uint32_t drawData[TERRAIN_CHUNK_COUNT][4];
+	Vbo drawDataVbo;
+	uint32_t drawDataFrame;
 }VoxelTerrain;
 
 #endif //TERRAIN_STRUCTS_H
@@ -38,6 +38,15 @@ unsigned char get_terrain_block_type(float caveValue)
 }
 
 //region noise
+fnl_state get_terrain_biome_selector_noise()
+{
+	fnl_state noise = fnlCreateState();
+	noise.noise_type = TERRAIN_BIOME_NOISE;
+	noise.fractal_type = FNL_FRACTAL_NONE;
+	noise.frequency = TERRAIN_BIOME_FREQUENCY;
+	return noise;
+}
+
 fnl_state get_terrain_cave_noise()
 {
 	fnl_state noise = fnlCreateState();
@@ -64,18 +73,6 @@ fnl_state get_terrain_biome_flat_noise()
 }
 
 fnl_state get_terrain_biome_small_hill_noise()
-{
-	fnl_state noise = fnlCreateState();
-	noise.noise_type = TERRAIN_FLAT_NOISE;
-	noise.fractal_type = TERRAIN_FLAT_FRACTAL;
-	noise.frequency = TERRAIN_FLAT_FREQUENCY;
-	noise.octaves = TERRAIN_FLAT_OCTAVES;
-	noise.gain = TERRAIN_FLAT_GAIN;
-	noise.lacunarity = TERRAIN_FLAT_LACUNARITY;
-	return noise;
-}
-
-fnl_state get_terrain_biome_hill_noise()
 {
 	fnl_state noise = fnlCreateState();
 	noise.noise_type = TERRAIN_SMALL_HILL_NOISE;
@@ -87,6 +84,18 @@ fnl_state get_terrain_biome_hill_noise()
 	return noise;
 }
 
+fnl_state get_terrain_biome_hill_noise()
+{
+	fnl_state noise = fnlCreateState();
+	noise.noise_type = TERRAIN_HILL_NOISE;
+	noise.fractal_type = TERRAIN_HILL_FRACTAL;
+	noise.frequency = TERRAIN_HILL_FREQUENCY;
+	noise.octaves = TERRAIN_HILL_OCTAVES;
+	noise.gain = TERRAIN_HILL_GAIN;
+	noise.lacunarity = TERRAIN_HILL_LACUNARITY;
+	return noise;
+}
+
 fnl_state get_terrain_biome_mountain_noise()
 {
 	fnl_state noise = fnlCreateState();
@@ -6,6 +6,7 @@
 
 unsigned char get_terrain_block_type(float caveValue);
 fnl_state get_terrain_cave_noise();
+fnl_state get_terrain_biome_selector_noise();
 fnl_state get_terrain_biome_flat_noise();
 fnl_state get_terrain_biome_small_hill_noise();
 fnl_state get_terrain_biome_hill_noise();
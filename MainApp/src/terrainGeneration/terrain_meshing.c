@@ -1,82 +1,132 @@
 #include "terrain_meshing.h"
 #include "coal_helper.h"
+#include "terrain_metrics.h"
 
+static void StageChunk(TerrainChunk* chunk);
 static void T_CreateTerrainChunkFaces(uint32_t threadId, void* args);
-static void T_TerrainChunkFacesCreationFinished(uint32_t threadId, void* args);
-
-static void T_TerrainCreateGroupFaces(uint32_t threadId, void* args);
-static void T_TerrainGroupFacesCreationFinished(uint32_t threadId, void* args);
+static void TerrainChunkFacesCreationFinished(uint32_t threadId, void* args);
 
 VoxelTerrain* m_terrain;
+TerrainMeshingStats meshingStats;
+pthread_mutex_t statsLock = PTHREAD_MUTEX_INITIALIZER;
 
 void setup_terrain_meshing(VoxelTerrain* terrain)
 {
 	m_terrain = terrain;
 }
 
-void send_terrain_face_creation_job(uint32_t x, uint32_t y, uint32_t z)
+void schedule_terrain_chunk_meshing(uint32_t x, uint32_t y, uint32_t z)
 {
 	TerrainChunk* chunk = &m_terrain->chunkGroups[x * TERRAIN_VIEW_RANGE + z].chunks[y];
 	chunk->flags.state = CHUNK_CREATING_FACES;
 
-	uint32_t * args = CM_MALLOC(3 * sizeof(uint32_t));
+	//x, y, z, then the mesh buffer size the worker leaves for the callback
+	uint32_t * args = CM_MALLOC(4 * sizeof(uint32_t));
 	args[0] = x;
 	args[1] = y;
 	args[2] = z;
+	args[3] = 0;
 
 	ThreadJob job = {0};
 	job.args = args;
 	job.job = T_CreateTerrainChunkFaces;
-	job.callbackJob = T_TerrainChunkFacesCreationFinished;
-	cm_submit_job(m_terrain->pool, job, true);
+	job.callbackJob = TerrainChunkFacesCreationFinished;
+	job.name = "Meshing";
+
+	JobGraph* graph = m_terrain->graph;
+	uint32_t node = TERRAIN_GRAPH_NODE(x, z, TERRAIN_NODE_MESH + y);
+	terrain_metrics_job_queued(TERRAIN_STAGE_MESH, node);
+	cm_set_job_graph_node(graph, node, job, true);
+	cm_add_job_graph_dependency(graph, node, TERRAIN_GRAPH_NODE(x, z, TERRAIN_NODE_SURFACE + y));
+
+	//Only the occupancy of the neighbours is read, which is final once their caves are generated. The ambient
+	//occlusion of the border faces samples the edge and corner neighbours too, so all 26 are dependencies
+	for (int32_t dx = -1; dx <= 1; ++dx)
+	{
+		if((uint32_t)(x + dx) >= TERRAIN_VIEW_RANGE) continue;
+		for (int32_t dz = -1; dz <= 1; ++dz)
+		{
+			if((uint32_t)(z + dz) >= TERRAIN_VIEW_RANGE) continue;
+			for (int32_t dy = -1; dy <= 1; ++dy)
+			{
+				if((uint32_t)(y + dy) >= TERRAIN_HEIGHT || (dx == 0 && dy == 0 && dz == 0)) continue;
+				cm_add_job_graph_dependency(graph, node, TERRAIN_GRAPH_NODE(x + dx, z + dz, TERRAIN_NODE_CAVES + y + dy));
+			}
+		}
+	}
+
+	cm_commit_job_graph_node(graph, node);
 }
 
-void send_terrain_group_face_creation_job(uint32_t x, uint32_t z)
+void schedule_terrain_group_meshing(uint32_t x, uint32_t z)
 {
-	uint32_t* args = CM_MALLOC(2 * sizeof(uint32_t));
-	args[0] = x;
-	args[1] = z;
-
-	ThreadJob job = {0};
-	job.args = args;
-	job.job = T_TerrainCreateGroupFaces;
-	job.callbackJob = T_TerrainGroupFacesCreationFinished;
-
-	TerrainChunkGroup* group = &m_terrain->chunkGroups[x * TERRAIN_VIEW_RANGE + z];
+	for (uint32_t y = 0; y < TERRAIN_HEIGHT; ++y)
+		schedule_terrain_chunk_meshing(x, y, z);
+}
 
-	for (int y = 0; y < TERRAIN_HEIGHT; ++y)
-		group->chunks[y].flags.state = CHUNK_CREATING_FACES;
+//Copies the mesh and the voxels to the staging ring, the chunk keeps its cpu copy when the ring is full
+static void StageChunk(TerrainChunk* chunk)
+{
+	if(chunk->isStaged)
+	{
+		cm_release_staging(chunk->staging);
+		chunk->isStaged = false;
+	}
 
-	cm_submit_job(m_terrain->pool, job, true);
+	uint32_t meshSize = chunk->buffer.endPosition;
+	uint32_t bricksSize = 0;
+#ifdef TERRAIN_VOXEL_SSBO
+	chunk->brickCount = classify_terrain_bricks(chunk->voxels, chunk->bricks);
+	bricksSize = chunk->brickCount * TERRAIN_BRICK_VOXEL_COUNT;
+#endif
+
+	if(chunk->faceCount == 0 || !cm_alloc_staging(meshSize + bricksSize, &chunk->staging))
+		return;
+
+	memcpy(chunk->staging.data, chunk->buffer.data, meshSize);
+#ifdef TERRAIN_VOXEL_SSBO
+	pack_terrain_bricks(chunk->voxels, chunk->bricks, (uint8_t*)chunk->staging.data + meshSize);
+#endif
+	chunk->isStaged = true;
 }
 
 //region thread callbacks
 static void T_CreateTerrainChunkFaces(uint32_t threadId, void* args)
 {
 	uint32_t * cArgs = (uint32_t *)args;
-	create_terrain_chunk_faces(cArgs[0], cArgs[1], cArgs[2]);
+	double startTime = terrain_metrics_job_started(TERRAIN_STAGE_MESH, TERRAIN_GRAPH_NODE(cArgs[0], cArgs[2], TERRAIN_NODE_MESH + cArgs[1]));
+
+	TerrainChunk* chunk = &m_terrain->chunkGroups[cArgs[0] * TERRAIN_VIEW_RANGE + cArgs[2]].chunks[cArgs[1]];
+	if(chunk->content != CHUNK_CONTENT_AIR)
+	{
+		create_terrain_chunk_faces(cArgs[0], cArgs[1], cArgs[2]);
+		StageChunk(chunk);
+		terrain_metrics_chunk_meshed(chunk->faceCount, chunk->buffer.endPosition, chunk->isStaged);
+	}
+
+	cArgs[3] = chunk->buffer.size;
+	terrain_metrics_job_finished(TERRAIN_STAGE_MESH, startTime);
 }
 
-static void T_TerrainChunkFacesCreationFinished(uint32_t threadId, void* args)
+static void TerrainChunkFacesCreationFinished(uint32_t threadId, void* args)
 {
 	uint32_t * cArgs = (uint32_t *)args;
-	m_terrain->chunkGroups[cArgs[0] * TERRAIN_VIEW_RANGE + cArgs[2]].chunks[cArgs[1]].flags.state = CHUNK_REQUIRES_UPLOAD;
-}
+	TerrainChunkGroup* group = &m_terrain->chunkGroups[cArgs[0] * TERRAIN_VIEW_RANGE + cArgs[2]];
+	TerrainChunk* chunk = &group->chunks[cArgs[1]];
+	chunk->meshBytes = cArgs[3];
 
-static void T_TerrainCreateGroupFaces(uint32_t threadId, void* args)
-{
-	uint32_t* cArgs = (uint32_t*)args;
-	for (int y = 0; y < TERRAIN_HEIGHT; ++y)
-		create_terrain_chunk_faces(cArgs[0], y, cArgs[1]);
-}
+	//Unloading left it without faces, bricks or drawable, there is nothing to upload
+	if(chunk->content == CHUNK_CONTENT_AIR)
+	{
+		chunk->flags.state = CHUNK_READY_TO_DRAW;
+		return;
+	}
 
-static void T_TerrainGroupFacesCreationFinished(uint32_t threadId, void* args)
-{
-	uint32_t* cArgs = (uint32_t*)args;
-	TerrainChunkGroup* group = &m_terrain->chunkGroups[cArgs[0] * TERRAIN_VIEW_RANGE + cArgs[1]];
+	chunk->flags.state = CHUNK_REQUIRES_UPLOAD;
 
-	for (int y = 0; y < TERRAIN_HEIGHT; ++y)
-		group->chunks[y].flags.state = CHUNK_REQUIRES_UPLOAD;
+	uint32_t chunkId = group->ssboId * TERRAIN_HEIGHT + cArgs[1];
+	terrain_metrics_job_queued(TERRAIN_STAGE_UPLOAD, chunkId);
+	list_add(&m_terrain->meshedChunks, TERRAIN_CHUNK_COUNT, &chunkId, sizeof(uint32_t));
 }
 //endregion
 
@@ -88,21 +138,133 @@ struct GreedySize
 	uint32_t y;
 };
 
+#define NEIGHBOURHOOD_ID(dx, dy, dz) (((dx) + 1) * 9 + ((dy) + 1) * 3 + (dz) + 1)
+
+//Occupancy of the chunk and of the 26 chunks around it, NULL outside of the loaded terrain
+typedef struct
+{
+	const uint64_t* chunks[27];
+}OccupancyNeighbourhood;
+
+typedef struct
+{
+	const OccupancyNeighbourhood* occupancy;
+	const uint8_t* voxels;
+	uint32_t faceId;
+}FaceContext;
+
+//Direction of the face normal, of the local x (lPos.x) and of the local y (lPos.y) axes, matches voxel_terrain.vert
+static const int32_t FACE_AXES[6][3][3] =
+{
+	{ { 0, 0, 1 },  { 1, 0, 0 },  { 0, -1, 0 } }, //front
+	{ { 0, 0, -1 }, { 1, 0, 0 },  { 0, 1, 0 } },  //back
+	{ { 1, 0, 0 },  { 0, 0, 1 },  { 0, 1, 0 } },  //right
+	{ { -1, 0, 0 }, { 0, 0, -1 }, { 0, 1, 0 } },  //left
+	{ { 0, 1, 0 },  { 1, 0, 0 },  { 0, 0, 1 } },  //top
+	{ { 0, -1, 0 }, { 1, 0, 0 },  { 0, 0, -1 } }, //bottom
+};
+
 static inline uint32_t ToVoxelId(uint32_t x, uint32_t y, uint32_t z)
 {
 	return y * TERRAIN_CHUNK_HORIZONTAL_SLICE + x * TERRAIN_CHUNK_SIZE + z;
 }
 
+static inline uint64_t OccupancyBit(const uint64_t* occupancy, uint32_t x, uint32_t y, uint32_t z)
+{
+	return (occupancy[y * TERRAIN_CHUNK_SIZE + x] >> z) & 1llu;
+}
+
+static inline uint32_t IsOccupied(const OccupancyNeighbourhood* n, int32_t x, int32_t y, int32_t z)
+{
+	uint32_t outside = ((uint32_t)x >= TERRAIN_CHUNK_SIZE) +
+	                   ((uint32_t)y >= TERRAIN_CHUNK_SIZE) +
+	                   ((uint32_t)z >= TERRAIN_CHUNK_SIZE);
+	if(outside == 0) return (uint32_t)OccupancyBit(n->chunks[NEIGHBOURHOOD_ID(0, 0, 0)], x, y, z);
+
+	//samples on an edge or a corner of the chunk fall in the diagonal neighbours
+	int32_t dx = x < 0 ? -1 : x >= TERRAIN_CHUNK_SIZE;
+	int32_t dy = y < 0 ? -1 : y >= TERRAIN_CHUNK_SIZE;
+	int32_t dz = z < 0 ? -1 : z >= TERRAIN_CHUNK_SIZE;
+
+	const uint64_t* occupancy = n->chunks[NEIGHBOURHOOD_ID(dx, dy, dz)];
+	if(occupancy == NULL) return 0;
+
+	x -= dx * TERRAIN_CHUNK_SIZE;
+	y -= dy * TERRAIN_CHUNK_SIZE;
+	z -= dz * TERRAIN_CHUNK_SIZE;
+	return (uint32_t)OccupancyBit(occupancy, x, y, z);
+}
+
+static inline uint32_t VertexAO(uint32_t side1, uint32_t side2, uint32_t corner)
+{
+	if(side1 && side2) return 3;
+	return side1 + side2 + corner;
+}
+
+//Packs the occlusion of the four corners as ao00 | ao01 << 2 | ao10 << 4 | ao11 << 6
+static inline uint32_t FaceAO(const OccupancyNeighbourhood* n, uint32_t faceId, int32_t x, int32_t y, int32_t z)
+{
+	const int32_t (*axes)[3] = FACE_AXES[faceId];
+	int32_t px = x + axes[0][0], py = y + axes[0][1], pz = z + axes[0][2];
+
+	uint32_t sides[2][2], corners[2][2];
+	for (int32_t i = 0; i < 2; ++i)
+	{
+		int32_t s = i * 2 - 1;
+		sides[0][i] = IsOccupied(n, px + s * axes[1][0], py + s * axes[1][1], pz + s * axes[1][2]);
+		sides[1][i] = IsOccupied(n, px + s * axes[2][0], py + s * axes[2][1], pz + s * axes[2][2]);
+	}
+
+	for (int32_t lx = 0; lx < 2; ++lx)
+	{
+		int32_t sx = lx * 2 - 1;
+		for (int32_t ly = 0; ly < 2; ++ly)
+		{
+			int32_t sy = ly * 2 - 1;
+			corners[lx][ly] = IsOccupied(n, px + sx * axes[1][0] + sy * axes[2][0],
+			                                py + sx * axes[1][1] + sy * axes[2][1],
+			                                pz + sx * axes[1][2] + sy * axes[2][2]);
+		}
+	}
+
+	return VertexAO(sides[0][0], sides[1][0], corners[0][0]) |
+	       VertexAO(sides[0][0], sides[1][1], corners[0][1]) << 2u |
+	       VertexAO(sides[0][1], sides[1][0], corners[1][0]) << 4u |
+	       VertexAO(sides[0][1], sides[1][1], corners[1][1]) << 6u;
+}
+
+//Faces can only be merged if their keys are equal, the key holds the FaceAO in its low byte and the block type above it
+static inline uint32_t FaceKey(const FaceContext* ctx, uint32_t a, uint32_t b, uint32_t layer)
+{
+	uint32_t x, y, z;
+	switch (ctx->faceId)
+	{
+		case 0: case 1: x = a; y = b; z = layer; break;
+		case 2: case 3: x = layer; y = a; z = b; break;
+		default: x = b; y = layer; z = a; break;
+	}
+
+	uint32_t key = 0;
+#ifdef TERRAIN_AMBIENT_OCCLUSION
+	key |= FaceAO(ctx->occupancy, ctx->faceId, (int32_t)x, (int32_t)y, (int32_t)z);
+#endif
+#ifndef TERRAIN_VOXEL_SSBO
+	key |= (uint32_t)ctx->voxels[ToVoxelId(x, y, z)] << 8u;
+#endif
+	return key;
+}
+
 static inline void CreateFaceMask(const uint64_t* oMask, bool fVoxelExists, bool bVoxelExists,
                                   uint64_t* tf, uint64_t* tb, uint32_t id)
 {
 	uint64_t mask = oMask[id];
 	tf[id] = (mask & ~(mask >> 1ull)) & ~((uint64_t)fVoxelExists << (TERRAIN_CHUNK_SIZE - 1ull));
-	tb[id] = (mask & ~(mask << 1ull)) & ~(bVoxelExists);
+	tb[id] = (mask & ~(mask << 1ull)) & ~((uint64_t)bVoxelExists);
 }
 
 static inline struct GreedySize GreedyMeshing
-	(uint32_t x, uint32_t y, uint32_t offset,
+	(const FaceContext* ctx, uint32_t key,
+	 uint32_t x, uint32_t y, uint32_t offset,
 	 uint64_t* currentFace)
 {
 	uint32_t sizeX = 1u, sizeY = 1u;
@@ -114,7 +276,7 @@ static inline struct GreedySize GreedyMeshing
 		uint32_t id = y * TERRAIN_CHUNK_SIZE + sa;
 		uint64_t bitMap = currentFace[id];
 
-		if(bitMap & bitShift)
+		if((bitMap & bitShift) && FaceKey(ctx, sa, y, offset) == key)
 		{
 			sizeX++;
 			currentFace[id] = bitMap & (~bitShift);
@@ -128,7 +290,8 @@ static inline struct GreedySize GreedyMeshing
 	{
 		for (uint32_t sa = x; sa < saEnd; ++sa)
 		{
-			if((currentFace[la * TERRAIN_CHUNK_SIZE + sa] & bitShift) == 0u)
+			if((currentFace[la * TERRAIN_CHUNK_SIZE + sa] & bitShift) == 0u ||
+			   FaceKey(ctx, sa, la, offset) != key)
 				goto end;
 		}
 
@@ -145,17 +308,40 @@ static inline struct GreedySize GreedyMeshing
 static inline void AddFace(List* list,
 						   uint32_t x, uint32_t y, uint32_t z,
 						   struct GreedySize size,
-						   uint32_t faceId)
+						   uint32_t faceId, uint32_t key)
 {
 	uint32_t mainBlock = (x << 12u) | (y << 6u) | z;
 	mainBlock <<= 12;
 	mainBlock |= ((size.x - 1) << 6u) | (size.y - 1);
 	mainBlock <<= 2;
 
-	uint32_t faceBlock = faceId;
+	uint32_t faceBlock = ((key >> 8u) << 3u) | faceId;
 	faceBlock <<= 2;
 
-	uint32_t ao00 = 0, ao01 = 0, ao10 = 0, ao11 = 0;
+	uint32_t ao00 = key & 3u, ao01 = (key >> 2u) & 3u, ao10 = (key >> 4u) & 3u, ao11 = (key >> 6u) & 3u;
+
+	//flip the quad diagonal so the occlusion gradient is interpolated the same way on every corner
+	if(ao00 + ao11 < ao01 + ao10)
+	{
+		uint32_t buffer[TERRAIN_MEM_PRINT_SIZE] =
+		{
+			mainBlock | ao00,
+			faceBlock | 0b00,
+			mainBlock | ao01,
+			faceBlock | 0b01,
+			mainBlock | ao10,
+			faceBlock | 0b10,
+			mainBlock | ao01,
+			faceBlock | 0b01,
+			mainBlock | ao11,
+			faceBlock | 0b11,
+			mainBlock | ao10,
+			faceBlock | 0b10
+		};
+
+		list_add(list, 32, buffer, sizeof(buffer));
+		return;
+	}
 
 	uint32_t buffer[TERRAIN_MEM_PRINT_SIZE] =
 	{
@@ -176,59 +362,59 @@ static inline void AddFace(List* list,
 	list_add(list, 32, buffer, sizeof(buffer));
 }
 
-static inline int32_t FaceDirection(int32_t faceId)
-{
-	return ((faceId % 2) * 2 - 1) * (-1);
-}
-
 void create_terrain_chunk_faces(uint32_t xId, uint32_t yId, uint32_t zId)
 {
+	double startTime = cm_get_time();
 	uint32_t faceCount = 0;
 	TerrainChunkGroup* group = &m_terrain->chunkGroups[xId * TERRAIN_VIEW_RANGE + zId];
 	TerrainChunk* chunk = &group->chunks[yId];
 	list_reset(&chunk->buffer);
 
 	//region MaskCreation
-	uint8_t* voxels = chunk->voxels;
-	uint64_t fbMask[TERRAIN_CHUNK_HORIZONTAL_SLICE],
-		     rlMask[TERRAIN_CHUNK_HORIZONTAL_SLICE],
+	const uint64_t* fbMask = chunk->occupancy;
+	uint64_t rlMask[TERRAIN_CHUNK_HORIZONTAL_SLICE],
 		     tbMask[TERRAIN_CHUNK_HORIZONTAL_SLICE];
-	memset(fbMask, 0, TERRAIN_CHUNK_HORIZONTAL_SLICE * sizeof(uint64_t));
 	memset(rlMask, 0, TERRAIN_CHUNK_HORIZONTAL_SLICE * sizeof(uint64_t));
 	memset(tbMask, 0, TERRAIN_CHUNK_HORIZONTAL_SLICE * sizeof(uint64_t));
 
-	for (uint32_t x = 0; x < TERRAIN_CHUNK_SIZE; ++x)
+	for (uint32_t y = 0; y < TERRAIN_CHUNK_SIZE; ++y)
 	{
-		for (uint32_t y = 0; y < TERRAIN_CHUNK_SIZE; ++y)
+		for (uint32_t x = 0; x < TERRAIN_CHUNK_SIZE; ++x)
 		{
-			for (uint32_t z = 0; z < TERRAIN_CHUNK_SIZE; ++z)
+			uint64_t mask = fbMask[y * TERRAIN_CHUNK_SIZE + x];
+			while(mask != 0llu)
 			{
-				if(voxels[ToVoxelId(x, y, z)] != BLOCK_EMPTY)
-				{
-					fbMask[y * TERRAIN_CHUNK_SIZE + x] |= 1llu << z;
-					rlMask[z * TERRAIN_CHUNK_SIZE + y] |= 1llu << x;
-					tbMask[x * TERRAIN_CHUNK_SIZE + z] |= 1llu << y;
-				}
+				uint32_t z = cm_trailing_zeros(mask);
+				mask &= mask - 1u;
+
+				rlMask[z * TERRAIN_CHUNK_SIZE + y] |= 1llu << x;
+				tbMask[x * TERRAIN_CHUNK_SIZE + z] |= 1llu << y;
 			}
 		}
 	}
 	//endregion
 
-	uint8_t *frontChunk = NULL, *backChunk = NULL,
-		    *rightChunk = NULL, *leftChunk = NULL,
-		    *topChunk = NULL, *bottomChunk = NULL;
+	OccupancyNeighbourhood neighbourhood = { 0 };
+	for (int32_t dx = -1; dx <= 1; ++dx)
+	{
+		if((uint32_t)(xId + dx) >= TERRAIN_VIEW_RANGE) continue;
+		for (int32_t dz = -1; dz <= 1; ++dz)
+		{
+			if((uint32_t)(zId + dz) >= TERRAIN_VIEW_RANGE) continue;
+			TerrainChunkGroup* neighbourGroup = &m_terrain->chunkGroups[(xId + dx) * TERRAIN_VIEW_RANGE + zId + dz];
+			for (int32_t dy = -1; dy <= 1; ++dy)
+				if((uint32_t)(yId + dy) < TERRAIN_HEIGHT)
+					neighbourhood.chunks[NEIGHBOURHOOD_ID(dx, dy, dz)] = neighbourGroup->chunks[yId + dy].occupancy;
+		}
+	}
 
-	if(zId < TERRAIN_VIEW_RANGE - 1) frontChunk = m_terrain->chunkGroups[xId * TERRAIN_VIEW_RANGE + zId + 1].chunks[yId].voxels;
-	if(zId > 0) backChunk = m_terrain->chunkGroups[xId * TERRAIN_VIEW_RANGE + zId - 1].chunks[yId].voxels;
-	if(xId < TERRAIN_VIEW_RANGE - 1) rightChunk = m_terrain->chunkGroups[(xId + 1) * TERRAIN_VIEW_RANGE + zId].chunks[yId].voxels;
-	if(xId > 0) leftChunk = m_terrain->chunkGroups[(xId - 1) * TERRAIN_VIEW_RANGE + zId].chunks[yId].voxels;
-	if(yId < TERRAIN_HEIGHT - 1) topChunk = group->chunks[yId + 1].voxels;
-	if(yId > 0) bottomChunk = group->chunks[yId - 1].voxels;
+	const uint64_t *frontChunk = neighbourhood.chunks[NEIGHBOURHOOD_ID(0, 0, 1)], *backChunk = neighbourhood.chunks[NEIGHBOURHOOD_ID(0, 0, -1)],
+		           *rightChunk = neighbourhood.chunks[NEIGHBOURHOOD_ID(1, 0, 0)], *leftChunk = neighbourhood.chunks[NEIGHBOURHOOD_ID(-1, 0, 0)],
+		           *topChunk = neighbourhood.chunks[NEIGHBOURHOOD_ID(0, 1, 0)], *bottomChunk = neighbourhood.chunks[NEIGHBOURHOOD_ID(0, -1, 0)];
 
 	uint64_t fFaces[TERRAIN_CHUNK_HORIZONTAL_SLICE];
 	uint64_t bFaces[TERRAIN_CHUNK_HORIZONTAL_SLICE];
 	uint64_t *faces[6] = { fFaces, bFaces, fFaces, bFaces, fFaces, bFaces };
-	uint8_t *dirChunks[6] = { frontChunk, backChunk, rightChunk, leftChunk, topChunk, bottomChunk };
 
 	//region Front&Back
 	for (uint32_t y = 0; y < TERRAIN_CHUNK_SIZE; ++y)
@@ -236,8 +422,8 @@ void create_terrain_chunk_faces(uint32_t xId, uint32_t yId, uint32_t zId)
 		for (uint32_t x = 0; x < TERRAIN_CHUNK_SIZE; ++x)
 		{
 			uint32_t id = y * TERRAIN_CHUNK_SIZE + x;
-			bool frontVoxelExists = frontChunk == NULL || frontChunk[ToVoxelId(x, y, 0)];
-			bool backVoxelExists = backChunk == NULL || backChunk[ToVoxelId(x, y, (TERRAIN_CHUNK_SIZE - 1))];
+			bool frontVoxelExists = frontChunk == NULL || OccupancyBit(frontChunk, x, y, 0);
+			bool backVoxelExists = backChunk == NULL || OccupancyBit(backChunk, x, y, TERRAIN_CHUNK_SIZE - 1);
 			CreateFaceMask(fbMask, frontVoxelExists, backVoxelExists, fFaces, bFaces, id);
 		}
 	}
@@ -245,6 +431,7 @@ void create_terrain_chunk_faces(uint32_t xId, uint32_t yId, uint32_t zId)
 	for (uint32_t i = 0; i < 2; ++i)
 	{
 		uint64_t* currentFace = faces[i];
+		FaceContext ctx = { .occupancy = &neighbourhood, .voxels = chunk->voxels, .faceId = i };
 
 		for (uint32_t y = 0; y < TERRAIN_CHUNK_SIZE; ++y)
 		{
@@ -256,20 +443,9 @@ void create_terrain_chunk_faces(uint32_t xId, uint32_t yId, uint32_t zId)
 					uint32_t z = cm_trailing_zeros(mask);
 					mask &= mask - 1u;
 
-					struct GreedySize size = GreedyMeshing(x, y, z, currentFace);
-					int32_t aoZ = (int32_t)z + FaceDirection((int32_t)i);
-					uint8_t* bPtr = voxels;
-					if(aoZ >= TERRAIN_CHUNK_SIZE || aoZ < 0)
-					{
-						aoZ = (aoZ + TERRAIN_CHUNK_SIZE) % TERRAIN_CHUNK_SIZE;
-						bPtr = dirChunks[i];
-					}
-
-					//12 samples, 3 per vertex
-//					uint32_t aoSample = 0;
-
-
-					AddFace(&chunk->buffer, x, y, z, size, i);
+					uint32_t key = FaceKey(&ctx, x, y, z);
+					struct GreedySize size = GreedyMeshing(&ctx, key, x, y, z, currentFace);
+					AddFace(&chunk->buffer, x, y, z, size, i, key);
 					faceCount++;
 				}
 			}
@@ -283,8 +459,8 @@ void create_terrain_chunk_faces(uint32_t xId, uint32_t yId, uint32_t zId)
 		for (uint32_t x = 0; x < TERRAIN_CHUNK_SIZE; ++x)
 		{
 			uint32_t id = y * TERRAIN_CHUNK_SIZE + x;
-			bool frontVoxelExists = rightChunk == NULL || rightChunk[ToVoxelId(0, x, y)];
-			bool backVoxelExists = leftChunk == NULL || leftChunk[ToVoxelId((TERRAIN_CHUNK_SIZE - 1), x, y)];
+			bool frontVoxelExists = rightChunk == NULL || OccupancyBit(rightChunk, 0, x, y);
+			bool backVoxelExists = leftChunk == NULL || OccupancyBit(leftChunk, TERRAIN_CHUNK_SIZE - 1, x, y);
 			CreateFaceMask(rlMask, frontVoxelExists, backVoxelExists, fFaces, bFaces, id);
 		}
 	}
@@ -292,6 +468,7 @@ void create_terrain_chunk_faces(uint32_t xId, uint32_t yId, uint32_t zId)
 	for (uint32_t i = 2; i < 4; ++i)
 	{
 		uint64_t* currentFace = faces[i];
+		FaceContext ctx = { .occupancy = &neighbourhood, .voxels = chunk->voxels, .faceId = i };
 
 		for (uint32_t z = 0; z < TERRAIN_CHUNK_SIZE; ++z)
 		{
@@ -303,8 +480,9 @@ void create_terrain_chunk_faces(uint32_t xId, uint32_t yId, uint32_t zId)
 					uint32_t x = cm_trailing_zeros(mask);
 					mask &= mask - 1;
 
-					struct GreedySize size = GreedyMeshing(y, z, x, currentFace);
-					AddFace(&chunk->buffer, x, y, z, size, i);
+					uint32_t key = FaceKey(&ctx, y, z, x);
+					struct GreedySize size = GreedyMeshing(&ctx, key, y, z, x, currentFace);
+					AddFace(&chunk->buffer, x, y, z, size, i, key);
 					faceCount++;
 				}
 			}
@@ -318,8 +496,8 @@ void create_terrain_chunk_faces(uint32_t xId, uint32_t yId, uint32_t zId)
 		for (uint32_t x = 0; x < TERRAIN_CHUNK_SIZE; ++x)
 		{
 			uint32_t id = y * TERRAIN_CHUNK_SIZE + x;
-			bool frontVoxelExists = topChunk == NULL || topChunk[ToVoxelId(y, 0, x)];
-			bool backVoxelExists = bottomChunk == NULL || bottomChunk[ToVoxelId(y, (TERRAIN_CHUNK_SIZE - 1), x)];
+			bool frontVoxelExists = topChunk == NULL || OccupancyBit(topChunk, y, 0, x);
+			bool backVoxelExists = bottomChunk == NULL || OccupancyBit(bottomChunk, y, TERRAIN_CHUNK_SIZE - 1, x);
 			CreateFaceMask(tbMask, frontVoxelExists, backVoxelExists, fFaces, bFaces, id);
 		}
 	}
@@ -327,6 +505,7 @@ void create_terrain_chunk_faces(uint32_t xId, uint32_t yId, uint32_t zId)
 	for (uint32_t i = 4; i < 6; ++i)
 	{
 		uint64_t* currentFace = faces[i];
+		FaceContext ctx = { .occupancy = &neighbourhood, .voxels = chunk->voxels, .faceId = i };
 
 		for (uint32_t x = 0; x < TERRAIN_CHUNK_SIZE; ++x)
 		{
@@ -338,8 +517,9 @@ void create_terrain_chunk_faces(uint32_t xId, uint32_t yId, uint32_t zId)
 					uint32_t y = cm_trailing_zeros(mask);
 					mask &= mask - 1;
 
-					struct GreedySize size = GreedyMeshing(z, x, y, currentFace);
-					AddFace(&chunk->buffer, x, y, z, size, i);
+					uint32_t key = FaceKey(&ctx, z, x, y);
+					struct GreedySize size = GreedyMeshing(&ctx, key, z, x, y, currentFace);
+					AddFace(&chunk->buffer, x, y, z, size, i, key);
 					faceCount++;
 				}
 			}
@@ -347,11 +527,21 @@ void create_terrain_chunk_faces(uint32_t xId, uint32_t yId, uint32_t zId)
 	}
 	//endregion
 
-#undef RECT_FACE
-	chunk->flags.faceCount = faceCount;
-	m_terrain->chunkVaos[group->ssboId * TERRAIN_HEIGHT + yId].vbo.vertexCount = faceCount * TERRAIN_MEM_PRINT_SIZE;
+	chunk->faceCount = faceCount;
 
-#undef BUFFER_CHECK
+	double elapsed = cm_get_time() - startTime;
+	pthread_mutex_lock(&statsLock);
+	meshingStats.chunkCount++;
+	meshingStats.totalTime += elapsed;
+	pthread_mutex_unlock(&statsLock);
+}
+
+TerrainMeshingStats get_terrain_meshing_stats()
+{
+	pthread_mutex_lock(&statsLock);
+	TerrainMeshingStats stats = meshingStats;
+	pthread_mutex_unlock(&statsLock);
+	return stats;
 }
 
 //endregion
\ No newline at end of file
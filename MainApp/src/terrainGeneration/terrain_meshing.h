@@ -4,9 +4,16 @@
 #include "coal_miner.h"
 #include "terrainStructs.h"
 
+typedef struct
+{
+	uint32_t chunkCount;
+	double totalTime;
+}TerrainMeshingStats;
+
 void setup_terrain_meshing(VoxelTerrain* terrain);
-void send_terrain_face_creation_job(uint32_t x, uint32_t y, uint32_t z);
-void send_terrain_group_face_creation_job(uint32_t x, uint32_t z);
+void schedule_terrain_chunk_meshing(uint32_t x, uint32_t y, uint32_t z);
+void schedule_terrain_group_meshing(uint32_t x, uint32_t z);
 void create_terrain_chunk_faces(uint32_t xId, uint32_t yId, uint32_t zId);
+TerrainMeshingStats get_terrain_meshing_stats();
 
 #endif //TERRAIN_MESHING_H
@@ -0,0 +1,277 @@
+#include "terrain_metrics.h"
+#include "coal_helper.h"
+
+#define METRICS_KEY_COUNT (TERRAIN_VIEW_RANGE * TERRAIN_VIEW_RANGE * TERRAIN_NODE_COUNT)
+
+typedef struct
+{
+	VoxelTerrain* terrain;
+	pthread_mutex_t lock;
+	double startTime;
+	double lastWriteTime;
+	FILE* sink;
+
+	TerrainMetrics metrics;
+	double queuedTimes[TERRAIN_STAGE_COUNT][METRICS_KEY_COUNT];
+}TerrainMetricsState;
+
+static TerrainMetricsState metricsState;
+
+static void AddValue(TerrainHistogram* histogram, double value);
+static void SampleTerrain(TerrainMetrics* metrics);
+static void ResetHistograms(TerrainMetrics* metrics);
+static void OpenSink();
+static void WriteSinkRow(const TerrainMetrics* metrics);
+
+void load_terrain_metrics(VoxelTerrain* terrain)
+{
+	TerrainMetricsState* state = &metricsState;
+	pthread_mutex_init(&state->lock, NULL);
+	state->terrain = terrain;
+	state->startTime = cm_get_time();
+	state->lastWriteTime = state->startTime;
+	state->metrics = (TerrainMetrics){ 0 };
+	OpenSink();
+}
+
+void update_terrain_metrics()
+{
+	TerrainMetricsState* state = &metricsState;
+	double time = cm_get_time();
+
+	pthread_mutex_lock(&state->lock);
+	AddValue(&state->metrics.frameTimes, cm_frame_time() * 1e6);
+
+	if(time - state->lastWriteTime >= TERRAIN_METRICS_INTERVAL)
+	{
+		state->lastWriteTime = time;
+		SampleTerrain(&state->metrics);
+		WriteSinkRow(&state->metrics);
+		ResetHistograms(&state->metrics);
+	}
+
+	pthread_mutex_unlock(&state->lock);
+}
+
+void dispose_terrain_metrics()
+{
+	TerrainMetricsState* state = &metricsState;
+	if(state->sink != NULL) fclose(state->sink);
+	state->sink = NULL;
+	pthread_mutex_destroy(&state->lock);
+}
+
+TerrainMetrics get_terrain_metrics()
+{
+	TerrainMetricsState* state = &metricsState;
+	pthread_mutex_lock(&state->lock);
+	SampleTerrain(&state->metrics);
+	TerrainMetrics metrics = state->metrics;
+	pthread_mutex_unlock(&state->lock);
+	return metrics;
+}
+
+void terrain_metrics_job_queued(TerrainStage stage, uint32_t key)
+{
+	TerrainMetricsState* state = &metricsState;
+	double time = cm_get_time();
+
+	pthread_mutex_lock(&state->lock);
+	state->metrics.queuedJobs[stage]++;
+	state->queuedTimes[stage][key] = time;
+	pthread_mutex_unlock(&state->lock);
+}
+
+double terrain_metrics_job_started(TerrainStage stage, uint32_t key)
+{
+	TerrainMetricsState* state = &metricsState;
+	double time = cm_get_time();
+
+	pthread_mutex_lock(&state->lock);
+	//Uploads can be dropped or merged by the queue, their count is replaced by the queue size on every sample
+	if(state->metrics.queuedJobs[stage] > 0) state->metrics.queuedJobs[stage]--;
+	state->metrics.runningJobs[stage]++;
+	AddValue(&state->metrics.waitTimes[stage], (time - state->queuedTimes[stage][key]) * 1e6);
+	pthread_mutex_unlock(&state->lock);
+
+	return time;
+}
+
+void terrain_metrics_job_finished(TerrainStage stage, double startTime)
+{
+	TerrainMetricsState* state = &metricsState;
+	double time = cm_get_time();
+
+	pthread_mutex_lock(&state->lock);
+	state->metrics.runningJobs[stage]--;
+	AddValue(&state->metrics.runTimes[stage], (time - startTime) * 1e6);
+	pthread_mutex_unlock(&state->lock);
+}
+
+void terrain_metrics_chunk_meshed(uint32_t faceCount, uint32_t meshSize, bool isStaged)
+{
+	TerrainMetricsState* state = &metricsState;
+
+	pthread_mutex_lock(&state->lock);
+	AddValue(&state->metrics.faceCounts, faceCount);
+	AddValue(&state->metrics.meshSizes, meshSize);
+	if(isStaged) state->metrics.stagedChunks++;
+	else state->metrics.unstagedChunks++;
+	pthread_mutex_unlock(&state->lock);
+}
+
+double get_terrain_histogram_percentile(const TerrainHistogram* histogram, double fraction)
+{
+	if(histogram->count == 0) return 0;
+
+	double target = fraction * histogram->count;
+	uint32_t below = 0;
+	for (uint32_t i = 0; i < TERRAIN_HISTOGRAM_BUCKETS; ++i)
+	{
+		uint32_t count = histogram->buckets[i];
+		if(count == 0 || below + count < target)
+		{
+			below += count;
+			continue;
+		}
+
+		double lower = i == 0 ? 0 : (double)(1ull << (i - 1));
+		double upper = (double)(1ull << i);
+		double value = lower + (upper - lower) * (target - below) / count;
+		return value < histogram->max ? value : histogram->max;
+	}
+
+	return histogram->max;
+}
+
+double get_terrain_gl_state_hit_rate(const GlStateStats* stats, GlStateType type)
+{
+	uint32_t total = stats->issued[type] + stats->skipped[type];
+	return total == 0 ? 0 : (double)stats->skipped[type] / total;
+}
+
+static void AddValue(TerrainHistogram* histogram, double value)
+{
+	uint32_t bucket = 0;
+	if(value >= 1)
+	{
+		uint64_t integer = (uint64_t)value;
+		bucket = 64 - cm_leading_zeros(integer);
+		if(bucket >= TERRAIN_HISTOGRAM_BUCKETS) bucket = TERRAIN_HISTOGRAM_BUCKETS - 1;
+	}
+
+	histogram->buckets[bucket]++;
+	histogram->count++;
+	histogram->sum += value;
+	if(value > histogram->max) histogram->max = value;
+}
+
+//Main thread, only reads what the main thread and the drained callbacks write
+static void SampleTerrain(TerrainMetrics* metrics)
+{
+	VoxelTerrain* terrain = metricsState.terrain;
+	metrics->time = cm_get_time() - metricsState.startTime;
+	metrics->queuedJobs[TERRAIN_STAGE_UPLOAD] = terrain->uploadStats.pendingChunks;
+	metrics->glState = cm_get_gl_state_stats();
+
+	memset(metrics->chunkStates, 0, sizeof(metrics->chunkStates));
+	memset(metrics->groupStates, 0, sizeof(metrics->groupStates));
+	metrics->meshBytes = 0;
+	metrics->voxelBytes = 0;
+
+	for (uint32_t i = 0; i < TERRAIN_VIEW_RANGE * TERRAIN_VIEW_RANGE; ++i)
+	{
+		TerrainChunkGroup* group = &terrain->chunkGroups[i];
+		metrics->groupStates[group->state]++;
+
+		for (uint32_t y = 0; y < TERRAIN_HEIGHT; ++y)
+		{
+			TerrainChunk* chunk = &group->chunks[y];
+			metrics->chunkStates[chunk->flags.state]++;
+			metrics->meshBytes += chunk->meshBytes;
+			if(chunk->voxels != NULL) metrics->voxelBytes += TERRAIN_CHUNK_VOXEL_COUNT;
+			if(chunk->occupancy != NULL) metrics->voxelBytes += TERRAIN_CHUNK_HORIZONTAL_SLICE * sizeof(uint64_t);
+		}
+	}
+
+	metrics->vboBytes = 0;
+	for (uint32_t i = 0; i < TERRAIN_CHUNK_COUNT; ++i)
+		metrics->vboBytes += terrain->chunkVaos[i].vbo.capacity;
+
+#ifdef TERRAIN_VOXEL_SSBO
+	metrics->ssboBytes = (uint64_t)terrain->voxelPool.usedCount * TERRAIN_BRICK_VOXEL_COUNT +
+	                     (uint64_t)TERRAIN_CHUNK_COUNT * TERRAIN_CHUNK_BRICKS * sizeof(uint32_t);
+#else
+	metrics->ssboBytes = 0;
+#endif
+}
+
+static void ResetHistograms(TerrainMetrics* metrics)
+{
+	memset(metrics->waitTimes, 0, sizeof(metrics->waitTimes));
+	memset(metrics->runTimes, 0, sizeof(metrics->runTimes));
+	memset(&metrics->frameTimes, 0, sizeof(TerrainHistogram));
+	memset(&metrics->faceCounts, 0, sizeof(TerrainHistogram));
+	memset(&metrics->meshSizes, 0, sizeof(TerrainHistogram));
+}
+
+//One row per interval, times in milliseconds
+static void OpenSink()
+{
+#ifdef TERRAIN_METRICS_CSV
+	static const char* stageNames[TERRAIN_STAGE_COUNT] = { "height_map", "caves", "surface", "mesh", "upload" };
+	TerrainMetricsState* state = &metricsState;
+	state->sink = fopen(TERRAIN_METRICS_CSV, "w");
+	if(state->sink == NULL)
+	{
+		log_warn("Unable to open %s, terrain metrics are not written\n", TERRAIN_METRICS_CSV);
+		return;
+	}
+
+	fprintf(state->sink, "time,frame_p50,frame_p99,frame_max");
+	for (uint32_t i = 0; i < TERRAIN_STAGE_COUNT; ++i)
+		fprintf(state->sink, ",%s_queued,%s_running,%s_wait_p50,%s_wait_p99,%s_run_p50,%s_run_p99,%s_count",
+		        stageNames[i], stageNames[i], stageNames[i], stageNames[i], stageNames[i], stageNames[i], stageNames[i]);
+
+	fprintf(state->sink, ",chunks_requires_faces,chunks_creating_faces,chunks_requires_upload,chunks_ready"
+	                     ",groups_requires_noise,groups_generating,groups_ready"
+	                     ",faces_p50,faces_p99,mesh_size_p50,mesh_size_p99"
+	                     ",mesh_bytes,voxel_bytes,ssbo_bytes,vbo_bytes"
+	                     ",staging_hit_rate,program_hit_rate,vertex_array_hit_rate,texture_hit_rate,buffer_hit_rate,ubo_hit_rate\n");
+#endif
+}
+
+static void WriteSinkRow(const TerrainMetrics* metrics)
+{
+	FILE* sink = metricsState.sink;
+	if(sink == NULL) return;
+
+	fprintf(sink, "%.3f,%.3f,%.3f,%.3f", metrics->time,
+	        get_terrain_histogram_percentile(&metrics->frameTimes, .5) / 1000.0,
+	        get_terrain_histogram_percentile(&metrics->frameTimes, .99) / 1000.0, metrics->frameTimes.max / 1000.0);
+
+	for (uint32_t i = 0; i < TERRAIN_STAGE_COUNT; ++i)
+		fprintf(sink, ",%u,%u,%.3f,%.3f,%.3f,%.3f,%u", metrics->queuedJobs[i], metrics->runningJobs[i],
+		        get_terrain_histogram_percentile(&metrics->waitTimes[i], .5) / 1000.0,
+		        get_terrain_histogram_percentile(&metrics->waitTimes[i], .99) / 1000.0,
+		        get_terrain_histogram_percentile(&metrics->runTimes[i], .5) / 1000.0,
+		        get_terrain_histogram_percentile(&metrics->runTimes[i], .99) / 1000.0, metrics->runTimes[i].count);
+
+	for (uint32_t i = 0; i <= CHUNK_READY_TO_DRAW; ++i) fprintf(sink, ",%u", metrics->chunkStates[i]);
+	for (uint32_t i = 0; i <= CHUNK_GROUP_READY; ++i) fprintf(sink, ",%u", metrics->groupStates[i]);
+
+	uint32_t meshedChunks = metrics->stagedChunks + metrics->unstagedChunks;
+	fprintf(sink, ",%.0f,%.0f,%.0f,%.0f,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%.3f",
+	        get_terrain_histogram_percentile(&metrics->faceCounts, .5),
+	        get_terrain_histogram_percentile(&metrics->faceCounts, .99),
+	        get_terrain_histogram_percentile(&metrics->meshSizes, .5),
+	        get_terrain_histogram_percentile(&metrics->meshSizes, .99),
+	        metrics->meshBytes, metrics->voxelBytes, metrics->ssboBytes, metrics->vboBytes,
+	        meshedChunks == 0 ? 0 : (double)metrics->stagedChunks / meshedChunks);
+
+	for (uint32_t i = 0; i < CM_GL_STATE_COUNT; ++i)
+		fprintf(sink, ",%.3f", get_terrain_gl_state_hit_rate(&metrics->glState, i));
+
+	fprintf(sink, "\n");
+	fflush(sink);
+}
@@ -0,0 +1,66 @@
+#ifndef TERRAIN_METRICS_H
+#define TERRAIN_METRICS_H
+
+#include "coal_miner.h"
+#include "terrainStructs.h"
+
+typedef enum
+{
+	TERRAIN_STAGE_HEIGHT_MAP,
+	TERRAIN_STAGE_CAVES,
+	TERRAIN_STAGE_SURFACE,
+	TERRAIN_STAGE_MESH,
+	TERRAIN_STAGE_UPLOAD,
+	TERRAIN_STAGE_COUNT,
+}TerrainStage;
+
+//Bucket 0 counts the values below 1, bucket i the values from 2^(i-1) to 2^i
+typedef struct
+{
+	uint32_t buckets[TERRAIN_HISTOGRAM_BUCKETS];
+	uint32_t count;
+	double sum;
+	double max;
+}TerrainHistogram;
+
+//Counters are live, histograms cover the values recorded since the last interval
+typedef struct
+{
+	double time;                                        //seconds since the metrics were loaded
+	uint32_t queuedJobs[TERRAIN_STAGE_COUNT];           //scheduled and not started, uploads are the queue after the last frame
+	uint32_t runningJobs[TERRAIN_STAGE_COUNT];          //uploads run until the GPU finished them
+	TerrainHistogram waitTimes[TERRAIN_STAGE_COUNT];    //microseconds from scheduling (meshed for uploads) to start
+	TerrainHistogram runTimes[TERRAIN_STAGE_COUNT];     //microseconds
+	TerrainHistogram frameTimes;                        //microseconds
+	TerrainHistogram faceCounts;                        //per meshed chunk
+	TerrainHistogram meshSizes;                         //bytes per meshed chunk
+
+	uint32_t chunkStates[CHUNK_READY_TO_DRAW + 1];
+	uint32_t groupStates[CHUNK_GROUP_READY + 1];
+	uint64_t meshBytes;                                 //cpu buffers of the meshes
+	uint64_t voxelBytes;                                //voxels and occupancy of the loaded chunks
+	uint64_t ssboBytes;                                 //used part of the voxel pool and its page table
+	uint64_t vboBytes;                                  //capacity of the chunk buffers
+
+	uint32_t stagedChunks;                              //meshes that found room in the staging ring
+	uint32_t unstagedChunks;
+	GlStateStats glState;                               //last frame
+}TerrainMetrics;
+
+void load_terrain_metrics(VoxelTerrain* terrain);
+void update_terrain_metrics();      //Main thread, once per frame, appends to the sink every TERRAIN_METRICS_INTERVAL
+void dispose_terrain_metrics();
+TerrainMetrics get_terrain_metrics();
+
+//Any thread, key is the graph node of the job or the chunk id of an upload
+void terrain_metrics_job_queued(TerrainStage stage, uint32_t key);
+double terrain_metrics_job_started(TerrainStage stage, uint32_t key);
+void terrain_metrics_job_finished(TerrainStage stage, double startTime);
+void terrain_metrics_chunk_meshed(uint32_t faceCount, uint32_t meshSize, bool isStaged);
+
+//Value below which the fraction of the recorded values falls, interpolated inside its bucket
+double get_terrain_histogram_percentile(const TerrainHistogram* histogram, double fraction);
+//Skipped calls over all the calls of a GL state type, 0 without calls
+double get_terrain_gl_state_hit_rate(const GlStateStats* stats, GlStateType type);
+
+#endif //TERRAIN_METRICS_H
@@ -1,9 +1,31 @@
 #include "terrain_noise.h"
 #include "terrain_blocks.h"
+#include "terrain_metrics.h"
 #include "coal_miner.h"
 
-static void T_GenerateTerrainNoise(uint32_t threadId, void* args);
-static void T_OnTerrainNoiseGenerationFinished(uint32_t threadId, void* args);
+static ThreadJob CreateGenerationJob(const char* name, uint32_t x, uint32_t y, uint32_t z,
+                                     void (*job)(uint32_t, void*), void (*callbackJob)(uint32_t, void*));
+static void T_GenerateTerrainHeightMap(uint32_t threadId, void* args);
+static void T_GenerateTerrainCaves(uint32_t threadId, void* args);
+static void T_GenerateTerrainSurface(uint32_t threadId, void* args);
+static void OnTerrainGroupGenerated(uint32_t threadId, void* args);
+static void GenerateBiomeMap(const uint32_t sourceId[2], float* biomeMap);
+static float GetBiomePosition(const float* biomeMap, uint32_t x, uint32_t z);
+static float GetBiomeHeight(uint32_t biome, uint32_t px, uint32_t pz);
+static ChunkContent ClassifyChunk(uint8_t minHeight, uint8_t maxHeight, uint32_t yId);
+static void GenerateSolidChunkCaves(TerrainChunkGroup* group, uint32_t yId);
+
+//Voxels of a column rewritten by the surface pass, the top one included
+#define SURFACE_DEPTH 3
+
+const float biomeAmplitudes[BIOME_COUNT] =
+{
+	TERRAIN_FLAT_AMPLITUDE,
+	TERRAIN_SMALL_HILL_AMPLITUDE,
+	TERRAIN_HILL_AMPLITUDE,
+	TERRAIN_MOUNTAIN_AMPLITUDE,
+	TERRAIN_HIGH_MOUNTAIN_AMPLITUDE,
+};
 
 VoxelTerrain* n_terrain;
 
@@ -12,46 +34,114 @@ void setup_terrain_noise(VoxelTerrain* terrain)
 	n_terrain = terrain;
 }
 
-void send_terrain_noise_job(uint32_t x, uint32_t z)
+void init_terrain_noise(VoxelTerrain* terrain, int32_t worldSeed)
+{
+	terrain->caveNoise = get_terrain_cave_noise();
+	terrain->biomes[BIOME_FLAT] = get_terrain_biome_flat_noise();
+	terrain->biomes[BIOME_SMALL_HILL] = get_terrain_biome_small_hill_noise();
+	terrain->biomes[BIOME_HILL] = get_terrain_biome_hill_noise();
+	terrain->biomes[BIOME_MOUNTAIN] = get_terrain_biome_mountain_noise();
+	terrain->biomes[BIOME_HIGH_MOUNTAIN] = get_terrain_biome_high_mountain_noise();
+	terrain->biomeSelector = get_terrain_biome_selector_noise();
+
+	for (uint32_t i = 0; i < BIOME_COUNT; ++i) terrain->biomes[i].seed = worldSeed;
+	terrain->biomeSelector.seed = worldSeed + 1;
+}
+
+void schedule_terrain_generation(uint32_t x, uint32_t z)
 {
 	TerrainChunkGroup* group = &n_terrain->chunkGroups[x * TERRAIN_VIEW_RANGE + z];
 	group->state = CHUNK_GROUP_GENERATING_NOISE_MAP;
 
-	uint32_t * args = CM_MALLOC(4 * sizeof(uint32_t ));
-	args[0] = group->id[0];
-	args[1] = group->id[1];
-	args[2] = x;
-	args[3] = z;
-	ThreadJob job = {0};
-	job.args = args;
-	job.job = T_GenerateTerrainNoise;
-	job.callbackJob = T_OnTerrainNoiseGenerationFinished;
-	cm_submit_job(n_terrain->pool, job, false);
+	JobGraph* graph = n_terrain->graph;
+	uint32_t heightMapNode = TERRAIN_GRAPH_NODE(x, z, TERRAIN_NODE_HEIGHT_MAP);
+	uint32_t readyNode = TERRAIN_GRAPH_NODE(x, z, TERRAIN_NODE_GROUP_READY);
+
+	terrain_metrics_job_queued(TERRAIN_STAGE_HEIGHT_MAP, heightMapNode);
+	cm_set_job_graph_node(graph, heightMapNode, CreateGenerationJob("Height Map", x, 0, z, T_GenerateTerrainHeightMap, NULL), false);
+	cm_set_job_graph_node(graph, readyNode, CreateGenerationJob("Group Generated", x, 0, z, NULL, OnTerrainGroupGenerated), false);
+
+	for (uint32_t y = 0; y < TERRAIN_HEIGHT; ++y)
+	{
+		uint32_t cavesNode = TERRAIN_GRAPH_NODE(x, z, TERRAIN_NODE_CAVES + y);
+		uint32_t surfaceNode = TERRAIN_GRAPH_NODE(x, z, TERRAIN_NODE_SURFACE + y);
+
+		terrain_metrics_job_queued(TERRAIN_STAGE_CAVES, cavesNode);
+		terrain_metrics_job_queued(TERRAIN_STAGE_SURFACE, surfaceNode);
+		cm_set_job_graph_node(graph, cavesNode, CreateGenerationJob("Caves", x, y, z, T_GenerateTerrainCaves, NULL), false);
+		cm_set_job_graph_node(graph, surfaceNode, CreateGenerationJob("Surface", x, y, z, T_GenerateTerrainSurface, NULL), false);
+
+		cm_add_job_graph_dependency(graph, cavesNode, heightMapNode);
+		cm_add_job_graph_dependency(graph, surfaceNode, cavesNode);
+		cm_add_job_graph_dependency(graph, readyNode, surfaceNode);
+
+		cm_commit_job_graph_node(graph, cavesNode);
+		cm_commit_job_graph_node(graph, surfaceNode);
+	}
+
+	cm_commit_job_graph_node(graph, readyNode);
+	cm_commit_job_graph_node(graph, heightMapNode);
+}
+
+static ThreadJob CreateGenerationJob(const char* name, uint32_t x, uint32_t y, uint32_t z,
+                                     void (*job)(uint32_t, void*), void (*callbackJob)(uint32_t, void*))
+{
+	uint32_t * args = CM_MALLOC(3 * sizeof(uint32_t));
+	args[0] = x;
+	args[1] = y;
+	args[2] = z;
+
+	ThreadJob threadJob = {0};
+	threadJob.args = args;
+	threadJob.job = job;
+	threadJob.callbackJob = callbackJob;
+	threadJob.name = name;
+	return threadJob;
 }
 
-static void T_GenerateTerrainNoise(uint32_t threadId, void* args)
+//region thread callbacks
+static void T_GenerateTerrainHeightMap(uint32_t threadId, void* args)
 {
 	uint32_t * cArgs = (uint32_t *)args;
-	generate_terrain_height_map((uint32_t[2]) {cArgs[0], cArgs[1]}, (uint32_t[2]) {cArgs[2], cArgs[3]});
-	for (int y = 0; y < TERRAIN_HEIGHT; ++y)
-	{
-		generate_terrain_pre_chunk(cArgs[2], y, cArgs[3]);
-		generate_terrain_post_chunk(cArgs[2], y, cArgs[3]);
-	}
+	double startTime = terrain_metrics_job_started(TERRAIN_STAGE_HEIGHT_MAP, TERRAIN_GRAPH_NODE(cArgs[0], cArgs[2], TERRAIN_NODE_HEIGHT_MAP));
+
+	TerrainChunkGroup* group = &n_terrain->chunkGroups[cArgs[0] * TERRAIN_VIEW_RANGE + cArgs[2]];
+	generate_terrain_height_map((uint32_t[2]) {group->id[0], group->id[1]}, (uint32_t[2]) {cArgs[0], cArgs[2]});
+	terrain_metrics_job_finished(TERRAIN_STAGE_HEIGHT_MAP, startTime);
+}
+
+static void T_GenerateTerrainCaves(uint32_t threadId, void* args)
+{
+	uint32_t * cArgs = (uint32_t *)args;
+	double startTime = terrain_metrics_job_started(TERRAIN_STAGE_CAVES, TERRAIN_GRAPH_NODE(cArgs[0], cArgs[2], TERRAIN_NODE_CAVES + cArgs[1]));
+	generate_terrain_pre_chunk(cArgs[0], cArgs[1], cArgs[2]);
+	terrain_metrics_job_finished(TERRAIN_STAGE_CAVES, startTime);
+}
+
+static void T_GenerateTerrainSurface(uint32_t threadId, void* args)
+{
+	uint32_t * cArgs = (uint32_t *)args;
+	double startTime = terrain_metrics_job_started(TERRAIN_STAGE_SURFACE, TERRAIN_GRAPH_NODE(cArgs[0], cArgs[2], TERRAIN_NODE_SURFACE + cArgs[1]));
+	generate_terrain_post_chunk(cArgs[0], cArgs[1], cArgs[2]);
+	terrain_metrics_job_finished(TERRAIN_STAGE_SURFACE, startTime);
 }
 
-void T_OnTerrainNoiseGenerationFinished(uint32_t threadId, void* args)
+static void OnTerrainGroupGenerated(uint32_t threadId, void* args)
 {
 	uint32_t * cArgs = (uint32_t *)args;
 
-	TerrainChunkGroup* group = &n_terrain->chunkGroups[cArgs[2] * TERRAIN_VIEW_RANGE + cArgs[3]];
+	TerrainChunkGroup* group = &n_terrain->chunkGroups[cArgs[0] * TERRAIN_VIEW_RANGE + cArgs[2]];
 	group->state = CHUNK_GROUP_READY;
 }
+//endregion
 
+//Columns away from the border of two biomes only evaluate the noise of one of them
 void generate_terrain_height_map(const uint32_t sourceId[2], const uint32_t destination[2])
 {
-	uint8_t * heightMap = n_terrain->chunkGroups[destination[0] * TERRAIN_VIEW_RANGE + destination[1]].heightMap;
-	fnl_state noise = n_terrain->biomes[BIOME_FLAT];
+	TerrainChunkGroup* group = &n_terrain->chunkGroups[destination[0] * TERRAIN_VIEW_RANGE + destination[1]];
+	uint8_t * heightMap = group->heightMap;
+	uint8_t minHeight = UINT8_MAX, maxHeight = 0;
+	GenerateBiomeMap(sourceId, group->biomeMap);
 
 	for (uint32_t x = 0; x < TERRAIN_CHUNK_SIZE; ++x)
 	{
@@ -60,21 +150,86 @@ void generate_terrain_height_map(const uint32_t sourceId[2], const uint32_t dest
 		{
 			uint32_t pz = sourceId[1] * TERRAIN_CHUNK_SIZE + z;
 
-			float val2D = fnlGetNoise2D(&noise, (double)(px), (double)(pz));
-			val2D = (val2D + 1) * .5f;
+			float position = GetBiomePosition(group->biomeMap, x, z);
+			uint32_t biome = glm_imin((int)position, BIOME_COUNT - 2);
+			float blend = glm_clamp((position - (float)biome - .5f) / TERRAIN_BIOME_BLEND + .5f, 0.f, 1.f);
+
+			float val2D = 0;
+			if(blend < 1) val2D += (1 - blend) * GetBiomeHeight(biome, px, pz);
+			if(blend > 0) val2D += blend * GetBiomeHeight(biome + 1, px, pz);
 			uint8_t height = (TERRAIN_LOWER_EDGE * TERRAIN_CHUNK_SIZE) +
 			                 (uint8_t)(val2D * (TERRAIN_CHUNK_SIZE * (TERRAIN_UPPER_EDGE - TERRAIN_LOWER_EDGE) - 1));
 
 			heightMap[x * TERRAIN_CHUNK_SIZE + z] = height;
+			minHeight = height < minHeight ? height : minHeight;
+			maxHeight = height > maxHeight ? height : maxHeight;
 		}
 	}
+
+	group->minHeight = minHeight;
+	group->maxHeight = maxHeight;
+	for (uint32_t y = 0; y < TERRAIN_HEIGHT; ++y)
+		group->chunks[y].content = ClassifyChunk(minHeight, maxHeight, y);
+}
+
+//Heights are the last filled y of the columns
+static ChunkContent ClassifyChunk(uint8_t minHeight, uint8_t maxHeight, uint32_t yId)
+{
+	int bottom = (int)(yId * TERRAIN_CHUNK_SIZE);
+	int top = bottom + TERRAIN_CHUNK_SIZE - 1;
+
+	if(maxHeight < bottom) return CHUNK_CONTENT_AIR;
+	if(minHeight - (SURFACE_DEPTH - 1) > top) return CHUNK_CONTENT_SOLID;
+	return CHUNK_CONTENT_MIXED;
+}
+
+static void GenerateBiomeMap(const uint32_t sourceId[2], float* biomeMap)
+{
+	for (uint32_t x = 0; x < TERRAIN_BIOME_MAP_SIZE; ++x)
+	{
+		uint32_t px = sourceId[0] * TERRAIN_CHUNK_SIZE + x * TERRAIN_BIOME_CELL_SIZE;
+		for (uint32_t z = 0; z < TERRAIN_BIOME_MAP_SIZE; ++z)
+		{
+			uint32_t pz = sourceId[1] * TERRAIN_CHUNK_SIZE + z * TERRAIN_BIOME_CELL_SIZE;
+
+			float selector = fnlGetNoise2D(&n_terrain->biomeSelector, (double)(px), (double)(pz));
+			biomeMap[x * TERRAIN_BIOME_MAP_SIZE + z] = glm_clamp((selector + 1) * .5f, 0.f, 1.f) * (BIOME_COUNT - 1);
+		}
+	}
+}
+
+static float GetBiomePosition(const float* biomeMap, uint32_t x, uint32_t z)
+{
+	uint32_t cx = x / TERRAIN_BIOME_CELL_SIZE, cz = z / TERRAIN_BIOME_CELL_SIZE;
+	float fx = (float)(x % TERRAIN_BIOME_CELL_SIZE) / TERRAIN_BIOME_CELL_SIZE;
+	float fz = (float)(z % TERRAIN_BIOME_CELL_SIZE) / TERRAIN_BIOME_CELL_SIZE;
+
+	const float* corner = &biomeMap[cx * TERRAIN_BIOME_MAP_SIZE + cz];
+	float nearRow = glm_lerp(corner[0], corner[1], fz);
+	float farRow = glm_lerp(corner[TERRAIN_BIOME_MAP_SIZE], corner[TERRAIN_BIOME_MAP_SIZE + 1], fz);
+	return glm_lerp(nearRow, farRow, fx);
+}
+
+static float GetBiomeHeight(uint32_t biome, uint32_t px, uint32_t pz)
+{
+	float value = fnlGetNoise2D(&n_terrain->biomes[biome], (double)(px), (double)(pz));
+	return (value + 1) * .5f * biomeAmplitudes[biome];
 }
 
 void generate_terrain_pre_chunk(uint32_t xId, uint32_t yId, uint32_t zId)
 {
 	TerrainChunkGroup* group = &n_terrain->chunkGroups[xId * TERRAIN_VIEW_RANGE + zId];
+	ChunkContent content = group->chunks[yId].content;
+	if(content == CHUNK_CONTENT_AIR) return;
+	if(content == CHUNK_CONTENT_SOLID)
+	{
+		GenerateSolidChunkCaves(group, yId);
+		return;
+	}
+
 	uint8_t* heightMap = group->heightMap;
 	uint8_t* cells = group->chunks[yId].voxels;
+	uint64_t* occupancy = group->chunks[yId].occupancy;
 	uint32_t groupId[2] = { group->id[0], group->id[1] };
 	fnl_state* caveNoise = &n_terrain->caveNoise;
 
@@ -102,15 +257,49 @@ void generate_terrain_pre_chunk(uint32_t xId, uint32_t yId, uint32_t zId)
 					uint32_t id = y * TERRAIN_CHUNK_HORIZONTAL_SLICE + xzId;
 					uint8_t block = get_terrain_block_type(caveValue);
 					cells[id] = block;
+					occupancy[y * TERRAIN_CHUNK_SIZE + x] |= 1llu << z;
 				}
 			}
 		}
 	}
 }
 
+//Columns are walked in voxel order, there is no height to check
+static void GenerateSolidChunkCaves(TerrainChunkGroup* group, uint32_t yId)
+{
+	uint8_t* cells = group->chunks[yId].voxels;
+	uint64_t* occupancy = group->chunks[yId].occupancy;
+	fnl_state* caveNoise = &n_terrain->caveNoise;
+
+	for (uint32_t y = 0; y < TERRAIN_CHUNK_SIZE; ++y)
+	{
+		uint32_t py = yId * TERRAIN_CHUNK_SIZE + y;
+		for (uint32_t x = 0; x < TERRAIN_CHUNK_SIZE; ++x)
+		{
+			uint32_t px = group->id[0] * TERRAIN_CHUNK_SIZE + x;
+			uint64_t row = 0;
+
+			for (uint32_t z = 0; z < TERRAIN_CHUNK_SIZE; ++z)
+			{
+				uint32_t pz = group->id[1] * TERRAIN_CHUNK_SIZE + z;
+				float caveValue = fnlGetNoise3D(caveNoise, (double)(px), (double)(py), (double)(pz));
+				if(caveValue < TERRAIN_CAVE_EDGE) continue;
+
+				caveValue = (caveValue - TERRAIN_CAVE_EDGE) / (1 - TERRAIN_CAVE_EDGE);
+				cells[y * TERRAIN_CHUNK_HORIZONTAL_SLICE + x * TERRAIN_CHUNK_SIZE + z] = get_terrain_block_type(caveValue);
+				row |= 1llu << z;
+			}
+
+			occupancy[y * TERRAIN_CHUNK_SIZE + x] = row;
+		}
+	}
+}
+
 void generate_terrain_post_chunk(uint32_t xId, uint32_t yId, uint32_t zId)
 {
 	TerrainChunkGroup* group = &n_terrain->chunkGroups[xId * TERRAIN_VIEW_RANGE + zId];
+	if(group->chunks[yId].content != CHUNK_CONTENT_MIXED) return;
+
 	uint8_t* heightMap = group->heightMap;
 	uint8_t* cells = group->chunks[yId].voxels;
 	for (uint32_t x = 0; x < TERRAIN_CHUNK_SIZE; ++x)
@@ -128,7 +317,7 @@ void generate_terrain_post_chunk(uint32_t xId, uint32_t yId, uint32_t zId)
 				if(cells[id] == BLOCK_EMPTY) continue;
 
 				if(y == maxY) cells[id] = BLOCK_GRASS;
-				else if(maxY - y < 3) cells[id] = BLOCK_DIRT;
+				else if(maxY - y < SURFACE_DEPTH) cells[id] = BLOCK_DIRT;
 			}
 		}
 	}
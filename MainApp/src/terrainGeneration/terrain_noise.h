@@ -6,7 +6,9 @@
 #include "terrainStructs.h"
 
 void setup_terrain_noise(VoxelTerrain* terrain);
-void send_terrain_noise_job(uint32_t x, uint32_t z);
+//Same seed, same world, whatever the thread count
+void init_terrain_noise(VoxelTerrain* terrain, int32_t worldSeed);
+void schedule_terrain_generation(uint32_t x, uint32_t z);
 
 void generate_terrain_height_map(const uint32_t sourceId[2], const uint32_t destination[2]);
 void generate_terrain_pre_chunk(uint32_t xId, uint32_t yId, uint32_t zId);
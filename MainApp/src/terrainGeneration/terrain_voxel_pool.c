@@ -0,0 +1,169 @@
+#include <string.h>
+#include "coal_miner.h"
+#include "coal_helper.h"
+#include "terrain_voxel_pool.h"
+
+#define BRICK_ROW (TERRAIN_CHUNK_SIZE)
+#define BRICK_SLICE (TERRAIN_CHUNK_SIZE * TERRAIN_CHUNK_SIZE)
+
+static uint32_t GetBrickOrigin(uint32_t brickId);
+static uint32_t TakeFreeBrick(TerrainVoxelPool* pool);
+
+TerrainVoxelPool create_terrain_voxel_pool(uint32_t chunkCount, uint32_t capacity)
+{
+	TerrainVoxelPool pool =
+		{
+			.capacity = capacity,
+			.chunkCount = chunkCount,
+			.usedBricks = CM_CALLOC((capacity + 63) / 64, sizeof(uint64_t)),
+			.pages = CM_MALLOC(chunkCount * TERRAIN_CHUNK_BRICKS * sizeof(uint32_t)),
+			.retired = list_create(0),
+		};
+
+	for (uint32_t i = 0; i < chunkCount * TERRAIN_CHUNK_BRICKS; ++i)
+		pool.pages[i] = TERRAIN_BRICK_UNIFORM;
+
+	//Bits past the capacity are never handed out
+	if(capacity % 64 != 0) pool.usedBricks[capacity / 64] = ~0ull << (capacity % 64);
+	return pool;
+}
+
+void destroy_terrain_voxel_pool(TerrainVoxelPool* pool)
+{
+	CM_FREE(pool->usedBricks);
+	CM_FREE(pool->pages);
+	list_clear(&pool->retired);
+	*pool = (TerrainVoxelPool){0};
+}
+
+uint32_t classify_terrain_bricks(const uint8_t* voxels, uint32_t* pages)
+{
+	uint32_t mixedCount = 0;
+	for (uint32_t brickId = 0; brickId < TERRAIN_CHUNK_BRICKS; ++brickId)
+	{
+		const uint8_t* origin = voxels + GetBrickOrigin(brickId);
+		uint8_t type = origin[0];
+		bool isUniform = true;
+
+		for (uint32_t y = 0; y < TERRAIN_BRICK_SIZE && isUniform; ++y)
+			for (uint32_t x = 0; x < TERRAIN_BRICK_SIZE && isUniform; ++x)
+			{
+				const uint8_t* row = origin + y * BRICK_SLICE + x * BRICK_ROW;
+				for (uint32_t z = 0; z < TERRAIN_BRICK_SIZE; ++z)
+					isUniform &= row[z] == type;
+			}
+
+		if(isUniform) pages[brickId] = TERRAIN_BRICK_UNIFORM | type;
+		else
+		{
+			pages[brickId] = TERRAIN_BRICK_PENDING;
+			mixedCount++;
+		}
+	}
+
+	return mixedCount;
+}
+
+void pack_terrain_bricks(const uint8_t* voxels, const uint32_t* pages, uint8_t* dest)
+{
+	for (uint32_t brickId = 0; brickId < TERRAIN_CHUNK_BRICKS; ++brickId)
+	{
+		if(pages[brickId] & TERRAIN_BRICK_UNIFORM) continue;
+
+		const uint8_t* origin = voxels + GetBrickOrigin(brickId);
+		for (uint32_t y = 0; y < TERRAIN_BRICK_SIZE; ++y)
+			for (uint32_t x = 0; x < TERRAIN_BRICK_SIZE; ++x)
+			{
+				memcpy(dest, origin + y * BRICK_SLICE + x * BRICK_ROW, TERRAIN_BRICK_SIZE);
+				dest += TERRAIN_BRICK_SIZE;
+			}
+	}
+}
+
+bool alloc_terrain_chunk_bricks(TerrainVoxelPool* pool, uint32_t chunkId, const uint32_t* pages, uint32_t* previousPages)
+{
+	uint32_t* chunkPages = get_terrain_chunk_pages(pool, chunkId);
+	memcpy(previousPages, chunkPages, TERRAIN_CHUNK_BRICKS * sizeof(uint32_t));
+	memcpy(chunkPages, pages, TERRAIN_CHUNK_BRICKS * sizeof(uint32_t));
+
+	uint32_t mixedCount = 0;
+	for (uint32_t i = 0; i < TERRAIN_CHUNK_BRICKS; ++i)
+		mixedCount += !(chunkPages[i] & TERRAIN_BRICK_UNIFORM);
+
+	if(pool->usedCount + mixedCount > pool->capacity) return false;
+
+	for (uint32_t i = 0; i < TERRAIN_CHUNK_BRICKS; ++i)
+	{
+		if(!(chunkPages[i] & TERRAIN_BRICK_UNIFORM))
+			chunkPages[i] = TakeFreeBrick(pool);
+	}
+
+	return true;
+}
+
+void retire_terrain_bricks(TerrainVoxelPool* pool, const uint32_t* pages, uint64_t frame)
+{
+	for (uint32_t i = 0; i < TERRAIN_CHUNK_BRICKS; ++i)
+	{
+		if(pages[i] & TERRAIN_BRICK_UNIFORM || pages[i] == TERRAIN_BRICK_PENDING) continue;
+
+		TerrainRetiredBrick retired = { .frame = frame, .brick = pages[i] };
+		list_add(&pool->retired, TERRAIN_CHUNK_BRICKS, &retired, sizeof(TerrainRetiredBrick));
+		pool->retiredCount++;
+	}
+}
+
+void free_terrain_chunk_bricks(TerrainVoxelPool* pool, uint32_t chunkId, uint64_t frame)
+{
+	uint32_t* chunkPages = get_terrain_chunk_pages(pool, chunkId);
+	retire_terrain_bricks(pool, chunkPages, frame);
+
+	for (uint32_t i = 0; i < TERRAIN_CHUNK_BRICKS; ++i)
+		chunkPages[i] = TERRAIN_BRICK_UNIFORM;
+}
+
+void reclaim_terrain_bricks(TerrainVoxelPool* pool, uint64_t completedFrame)
+{
+	TerrainRetiredBrick* retired = pool->retired.data;
+	uint32_t count = list_count(&pool->retired, sizeof(TerrainRetiredBrick));
+
+	uint32_t reclaimedCount = 0;
+	for (; reclaimedCount < count && retired[reclaimedCount].frame <= completedFrame; ++reclaimedCount)
+	{
+		uint32_t brick = retired[reclaimedCount].brick;
+		pool->usedBricks[brick / 64] &= ~(1ull << (brick % 64));
+		pool->firstFreeWord = cm_min(pool->firstFreeWord, brick / 64);
+	}
+
+	if(reclaimedCount == 0) return;
+
+	memmove(retired, retired + reclaimedCount, (count - reclaimedCount) * sizeof(TerrainRetiredBrick));
+	pool->retired.endPosition -= reclaimedCount * sizeof(TerrainRetiredBrick);
+	pool->usedCount -= reclaimedCount;
+	pool->retiredCount -= reclaimedCount;
+}
+
+uint32_t* get_terrain_chunk_pages(TerrainVoxelPool* pool, uint32_t chunkId)
+{
+	return pool->pages + chunkId * TERRAIN_CHUNK_BRICKS;
+}
+
+static uint32_t GetBrickOrigin(uint32_t brickId)
+{
+	uint32_t z = brickId % TERRAIN_BRICK_AXIS;
+	uint32_t x = (brickId / TERRAIN_BRICK_AXIS) % TERRAIN_BRICK_AXIS;
+	uint32_t y = brickId / (TERRAIN_BRICK_AXIS * TERRAIN_BRICK_AXIS);
+	return (y * BRICK_SLICE + x * BRICK_ROW + z) * TERRAIN_BRICK_SIZE;
+}
+
+//Lowest free brick, the caller checks that there is one
+static uint32_t TakeFreeBrick(TerrainVoxelPool* pool)
+{
+	while(pool->usedBricks[pool->firstFreeWord] == ~0ull) pool->firstFreeWord++;
+
+	uint64_t* word = &pool->usedBricks[pool->firstFreeWord];
+	uint32_t bit = cm_trailing_zeros(~*word);
+	*word |= 1ull << bit;
+	pool->usedCount++;
+	return pool->firstFreeWord * 64 + bit;
+}
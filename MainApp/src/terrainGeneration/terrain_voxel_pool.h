@@ -0,0 +1,58 @@
+#ifndef TERRAIN_VOXEL_POOL_H
+#define TERRAIN_VOXEL_POOL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "list/list.h"
+#include "terrainConfig.h"
+
+//Bricks keep the voxel order of the chunks (y, x, z), and so do the bricks of a chunk
+#define TERRAIN_BRICK_AXIS (TERRAIN_CHUNK_SIZE / TERRAIN_BRICK_SIZE)
+#define TERRAIN_CHUNK_BRICKS (TERRAIN_BRICK_AXIS * TERRAIN_BRICK_AXIS * TERRAIN_BRICK_AXIS)
+#define TERRAIN_BRICK_VOXEL_COUNT (TERRAIN_BRICK_SIZE * TERRAIN_BRICK_SIZE * TERRAIN_BRICK_SIZE)
+
+//A page holds the block type of a brick made of a single type (air included) when this bit is set,
+//otherwise the index of the brick in the pool, must match voxel_terrain.frag
+#define TERRAIN_BRICK_UNIFORM 0x80000000u
+//Mixed brick that could not be given pool space yet
+#define TERRAIN_BRICK_PENDING 0x7fffffffu
+
+typedef struct
+{
+	uint64_t frame;
+	uint32_t brick;
+}TerrainRetiredBrick;
+
+//Has no GPU state, the owner mirrors the pages and the pool bricks in its buffers.
+//Released bricks are retired with the frame of the last draw reading them and reused once the owner reclaims that frame
+typedef struct
+{
+	uint32_t capacity;
+	uint32_t usedCount;     //retired bricks included
+	uint32_t retiredCount;
+	uint32_t chunkCount;
+	uint32_t firstFreeWord;
+	uint64_t* usedBricks;   //bit per pool brick
+	uint32_t* pages;        //TERRAIN_CHUNK_BRICKS per chunk
+	List retired;           //TerrainRetiredBrick in retirement order, the frames never decrease
+}TerrainVoxelPool;
+
+TerrainVoxelPool create_terrain_voxel_pool(uint32_t chunkCount, uint32_t capacity);
+void destroy_terrain_voxel_pool(TerrainVoxelPool* pool);
+
+//Fills the TERRAIN_CHUNK_BRICKS pages of a chunk, mixed bricks are left pending, returns how many there are
+uint32_t classify_terrain_bricks(const uint8_t* voxels, uint32_t* pages);
+//Copies the mixed bricks one after another, in the order of their pages
+void pack_terrain_bricks(const uint8_t* voxels, const uint32_t* pages, uint8_t* dest);
+
+//Replaces the pages of a chunk and gives pool bricks to the pending ones in increasing order, on failure the mixed
+//pages stay pending. The previous pages are copied to previousPages, their bricks are used until they are retired
+bool alloc_terrain_chunk_bricks(TerrainVoxelPool* pool, uint32_t chunkId, const uint32_t* pages, uint32_t* previousPages);
+//Retires the bricks of the pages, frame is the last one reading them
+void retire_terrain_bricks(TerrainVoxelPool* pool, const uint32_t* pages, uint64_t frame);
+void free_terrain_chunk_bricks(TerrainVoxelPool* pool, uint32_t chunkId, uint64_t frame);
+//Bricks retired up to completedFrame can be handed out again
+void reclaim_terrain_bricks(TerrainVoxelPool* pool, uint64_t completedFrame);
+uint32_t* get_terrain_chunk_pages(TerrainVoxelPool* pool, uint32_t chunkId);
+
+#endif //TERRAIN_VOXEL_POOL_H
@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include "coal_miner.h"
+
+//Submits jobs with callbacks from the main thread while the workers finish them, every callback has to run once,
+//on the draining thread and after the writes of its job. Build it with -fsanitize=thread to check the completion queue
+
+#define STRESS_DRAIN_INTERVAL 1000
+
+typedef struct
+{
+	uint32_t id;
+}StressArgs;
+
+static uint32_t* jobResults;
+static uint32_t* callbackCounts;
+static atomic_uint jobCount;
+
+static void T_StressJob(uint32_t threadId, void* args);
+static void StressCallback(uint32_t threadId, void* args);
+
+int main(int argc, char** argv)
+{
+	uint32_t count = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 10) : 200000;
+	uint32_t threadCount = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 10) : 8;
+
+	if(count == 0 || threadCount == 0 || threadCount > MAX_THREADS_IN_THREAD_POOL)
+	{
+		fprintf(stderr, "usage: pool_stress [jobs] [threads], at most %i threads\n", MAX_THREADS_IN_THREAD_POOL);
+		return 1;
+	}
+
+	jobResults = CM_CALLOC(count, sizeof(uint32_t));
+	callbackCounts = CM_CALLOC(count, sizeof(uint32_t));
+	ThreadPool* pool = cm_create_thread_pool(threadCount, 1024);
+
+	double startTime = cm_get_time();
+	uint32_t drained = 0;
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		StressArgs* args = CM_MALLOC(sizeof(StressArgs));
+		args->id = i;
+		cm_submit_job(pool, (ThreadJob){ .args = args, .job = T_StressJob, .callbackJob = StressCallback }, true);
+
+		if(i % STRESS_DRAIN_INTERVAL == 0) drained += cm_drain_thread_pool(pool);
+	}
+
+	cm_wait_thread_pool(pool);
+	while(drained < count) drained += cm_drain_thread_pool(pool);
+	double totalTime = cm_get_time() - startTime;
+
+	uint32_t failures = 0;
+	for (uint32_t i = 0; i < count; ++i)
+		if(callbackCounts[i] != 1) failures++;
+
+	// Callbacks that are never drained are dropped with their args
+	for (uint32_t i = 0; i < threadCount * 4; ++i)
+	{
+		StressArgs* args = CM_MALLOC(sizeof(StressArgs));
+		args->id = i % count;
+		cm_submit_job(pool, (ThreadJob){ .args = args, .job = T_StressJob, .callbackJob = StressCallback }, true);
+	}
+
+	cm_wait_thread_pool(pool);
+	cm_destroy_thread_pool(pool);
+	CM_FREE(jobResults);
+	CM_FREE(callbackCounts);
+
+	printf("%u jobs on %u threads in %.3fs, %u ran, %u callbacks drained, %u failures\n",
+	       count, threadCount, totalTime, atomic_load(&jobCount) - threadCount * 4, drained, failures);
+	return failures == 0 ? 0 : 2;
+}
+
+static void T_StressJob(uint32_t threadId, void* args)
+{
+	StressArgs* sArgs = (StressArgs*)args;
+	jobResults[sArgs->id] = sArgs->id + 1;
+	atomic_fetch_add_explicit(&jobCount, 1, memory_order_relaxed);
+}
+
+//Not atomic on purpose, the callbacks only run on this thread
+static void StressCallback(uint32_t threadId, void* args)
+{
+	StressArgs* sArgs = (StressArgs*)args;
+	if(jobResults[sArgs->id] == sArgs->id + 1) callbackCounts[sArgs->id]++;
+}
@@ -0,0 +1,243 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "coal_miner.h"
+#include "coal_helper.h"
+#include "terrainGeneration/terrainStructs.h"
+#include "terrainGeneration/terrain_noise.h"
+
+//Generates a rectangle of chunk groups without a window and writes them to a file, the groups are independent
+//so every worker bakes whole groups and the file is written in group order, the hash only depends on the seed
+
+#ifndef TERRAIN_WORLD_SEED
+#error terrain_bake needs a fixed TERRAIN_WORLD_SEED, undefine TERRAIN_RANDOM_WORLD_SEED
+#endif
+
+#define BAKE_MAGIC "CMTB"
+#define BAKE_VERSION 1
+#define BAKE_GROUPS_PER_THREAD 4
+#define BAKE_MAX_RUN UINT16_MAX
+#define BAKE_RUN_SIZE 3
+
+//Followed by width * depth groups, x major, each made of TERRAIN_HEIGHT chunks from the bottom:
+//uint32_t run count then the runs as {uint16_t length, uint8_t block type} in the voxel order of the chunks
+typedef struct
+{
+	char magic[4];
+	uint32_t version;
+	int32_t worldSeed;
+	int32_t x;
+	int32_t z;
+	uint32_t width;
+	uint32_t depth;
+	uint32_t chunkSize;
+	uint32_t height;
+}BakeHeader;
+
+typedef struct
+{
+	uint32_t slot;
+	uint32_t id[2];
+}BakeArgs;
+
+static VoxelTerrain bakeTerrain;
+static List bakeOutputs[TERRAIN_VIEW_RANGE * TERRAIN_VIEW_RANGE];
+
+static void InitBakeSlot(uint32_t slot);
+static void DestroyBakeSlot(uint32_t slot);
+static void T_BakeGroup(uint32_t threadId, void* args);
+static void EncodeChunk(const uint8_t* voxels, List* output);
+static void WriteBytes(FILE* file, const void* data, uint32_t size, uint64_t* hash);
+
+int main(int argc, char** argv)
+{
+	if(argc < 5)
+	{
+		printf("usage: terrain_bake <x> <z> <width> <depth> [threads] [output] [expected hash]\n");
+		return 1;
+	}
+
+	int32_t originX = (int32_t)strtol(argv[1], NULL, 10);
+	int32_t originZ = (int32_t)strtol(argv[2], NULL, 10);
+	uint32_t width = (uint32_t)strtoul(argv[3], NULL, 10);
+	uint32_t depth = (uint32_t)strtoul(argv[4], NULL, 10);
+	uint32_t threadCount = argc > 5 ? (uint32_t)strtoul(argv[5], NULL, 10) : TERRAIN_NUM_WORKER_THREADS;
+	const char* outputPath = argc > 6 ? argv[6] : "terrain.bake";
+
+	if(width == 0 || depth == 0 || threadCount == 0 || threadCount > MAX_THREADS_IN_THREAD_POOL)
+	{
+		fprintf(stderr, "Invalid bake size or thread count, at most %i threads\n", MAX_THREADS_IN_THREAD_POOL);
+		return 1;
+	}
+
+	FILE* file = fopen(outputPath, "wb");
+	if(file == NULL)
+	{
+		fprintf(stderr, "Unable to open %s\n", outputPath);
+		return 1;
+	}
+
+	setup_terrain_noise(&bakeTerrain);
+	init_terrain_noise(&bakeTerrain, TERRAIN_WORLD_SEED % 10000000);
+
+	uint32_t groupCount = width * depth;
+	uint32_t batchSize = cm_min(cm_min(threadCount * BAKE_GROUPS_PER_THREAD, TERRAIN_VIEW_RANGE * TERRAIN_VIEW_RANGE), groupCount);
+	for (uint32_t i = 0; i < batchSize; ++i) InitBakeSlot(i);
+
+	ThreadPool* pool = cm_create_thread_pool(threadCount, batchSize);
+
+	uint64_t hash = 14695981039346656037ull;
+	uint64_t bytesWritten = sizeof(BakeHeader);
+	BakeHeader header =
+		{
+			.magic = BAKE_MAGIC,
+			.version = BAKE_VERSION,
+			.worldSeed = TERRAIN_WORLD_SEED % 10000000,
+			.x = originX,
+			.z = originZ,
+			.width = width,
+			.depth = depth,
+			.chunkSize = TERRAIN_CHUNK_SIZE,
+			.height = TERRAIN_HEIGHT,
+		};
+	WriteBytes(file, &header, sizeof(BakeHeader), &hash);
+
+	double startTime = cm_get_time();
+	double writeTime = 0;
+
+	for (uint32_t first = 0; first < groupCount; first += batchSize)
+	{
+		uint32_t count = cm_min(batchSize, groupCount - first);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			BakeArgs* args = CM_MALLOC(sizeof(BakeArgs));
+			args->slot = i;
+			args->id[0] = TERRAIN_WORLD_EDGE + originX + (first + i) / depth;
+			args->id[1] = TERRAIN_WORLD_EDGE + originZ + (first + i) % depth;
+
+			ThreadJob job = {0};
+			job.args = args;
+			job.job = T_BakeGroup;
+			cm_submit_job(pool, job, true);
+		}
+
+		cm_wait_thread_pool(pool);
+
+		double writeStart = cm_get_time();
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			WriteBytes(file, bakeOutputs[i].data, bakeOutputs[i].endPosition, &hash);
+			bytesWritten += bakeOutputs[i].endPosition;
+		}
+		writeTime += cm_get_time() - writeStart;
+	}
+
+	double totalTime = cm_get_time() - startTime;
+	cm_destroy_thread_pool(pool);
+	fclose(file);
+	for (uint32_t i = 0; i < batchSize; ++i) DestroyBakeSlot(i);
+
+	double voxelCount = (double)groupCount * TERRAIN_HEIGHT * TERRAIN_CHUNK_VOXEL_COUNT;
+	printf("baked %u groups (%u chunks) on %u threads in %.3fs, %.3fs writing\n",
+	       groupCount, groupCount * TERRAIN_HEIGHT, threadCount, totalTime, writeTime);
+	printf("%.1f groups/s, %.1f Mvoxels/s, %.2f MB written at %.1f MB/s, %.1fx smaller than raw voxels\n",
+	       groupCount / totalTime, voxelCount / totalTime / 1e6, bytesWritten / 1e6,
+	       bytesWritten / 1e6 / totalTime, voxelCount / (double)bytesWritten);
+	printf("hash %016llx\n", (unsigned long long)hash);
+
+	if(argc > 7 && strtoull(argv[7], NULL, 16) != hash)
+	{
+		fprintf(stderr, "Hash mismatch, expected %s\n", argv[7]);
+		return 2;
+	}
+
+	return 0;
+}
+
+static void InitBakeSlot(uint32_t slot)
+{
+	TerrainChunkGroup* group = &bakeTerrain.chunkGroups[slot];
+	group->heightMap = CM_MALLOC(TERRAIN_CHUNK_HORIZONTAL_SLICE);
+	group->biomeMap = CM_MALLOC(TERRAIN_BIOME_MAP_SIZE * TERRAIN_BIOME_MAP_SIZE * sizeof(float));
+
+	for (uint32_t y = 0; y < TERRAIN_HEIGHT; ++y)
+	{
+		group->chunks[y].voxels = CM_MALLOC(TERRAIN_CHUNK_VOXEL_COUNT);
+		group->chunks[y].occupancy = CM_MALLOC(TERRAIN_CHUNK_HORIZONTAL_SLICE * sizeof(uint64_t));
+	}
+
+	bakeOutputs[slot] = list_create(0);
+}
+
+static void DestroyBakeSlot(uint32_t slot)
+{
+	TerrainChunkGroup* group = &bakeTerrain.chunkGroups[slot];
+	CM_FREE(group->heightMap);
+	CM_FREE(group->biomeMap);
+
+	for (uint32_t y = 0; y < TERRAIN_HEIGHT; ++y)
+	{
+		CM_FREE(group->chunks[y].voxels);
+		CM_FREE(group->chunks[y].occupancy);
+	}
+
+	list_clear(&bakeOutputs[slot]);
+}
+
+static void T_BakeGroup(uint32_t threadId, void* args)
+{
+	BakeArgs* bArgs = (BakeArgs*)args;
+	uint32_t x = bArgs->slot / TERRAIN_VIEW_RANGE, z = bArgs->slot % TERRAIN_VIEW_RANGE;
+	TerrainChunkGroup* group = &bakeTerrain.chunkGroups[bArgs->slot];
+	List* output = &bakeOutputs[bArgs->slot];
+
+	group->id[0] = bArgs->id[0];
+	group->id[1] = bArgs->id[1];
+	generate_terrain_height_map(group->id, (uint32_t[2]) {x, z});
+	list_reset(output);
+
+	for (uint32_t y = 0; y < TERRAIN_HEIGHT; ++y)
+	{
+		TerrainChunk* chunk = &group->chunks[y];
+		memset(chunk->voxels, BLOCK_EMPTY, TERRAIN_CHUNK_VOXEL_COUNT);
+		memset(chunk->occupancy, 0, TERRAIN_CHUNK_HORIZONTAL_SLICE * sizeof(uint64_t));
+
+		generate_terrain_pre_chunk(x, y, z);
+		generate_terrain_post_chunk(x, y, z);
+		EncodeChunk(chunk->voxels, output);
+	}
+}
+
+static void EncodeChunk(const uint8_t* voxels, List* output)
+{
+	uint32_t countPosition = output->endPosition;
+	uint32_t runCount = 0;
+	list_add(output, 1024, &runCount, sizeof(uint32_t));
+
+	for (uint32_t i = 0; i < TERRAIN_CHUNK_VOXEL_COUNT;)
+	{
+		uint8_t type = voxels[i];
+		uint32_t length = 1;
+		while(i + length < TERRAIN_CHUNK_VOXEL_COUNT && length < BAKE_MAX_RUN && voxels[i + length] == type) length++;
+
+		uint8_t run[BAKE_RUN_SIZE] = { length & 0xff, length >> 8, type };
+		list_add(output, 1024, run, BAKE_RUN_SIZE);
+		runCount++;
+		i += length;
+	}
+
+	memcpy((uint8_t*)output->data + countPosition, &runCount, sizeof(uint32_t));
+}
+
+//FNV-1a over every byte of the file
+static void WriteBytes(FILE* file, const void* data, uint32_t size, uint64_t* hash)
+{
+	const uint8_t* bytes = (const uint8_t*)data;
+	for (uint32_t i = 0; i < size; ++i)
+	{
+		*hash ^= bytes[i];
+		*hash *= 1099511628211ull;
+	}
+
+	fwrite(data, 1, size, file);
+}
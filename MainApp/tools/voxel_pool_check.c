@@ -0,0 +1,201 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "coal_miner.h"
+#include "terrainGeneration/terrain_voxel_pool.h"
+
+//Runs the brick pool without a window: chunks are classified, given bricks and packed into a copy of the pool
+//buffer, then read back through their pages. Freed bricks have to stay out of the pool until their frame is reclaimed
+
+#define CHECK_CHUNK_COUNT 16
+#define CHECK_CAPACITY 16384
+#define CHECK_ROUNDS 64
+#define CHECK_VOXEL_COUNT (TERRAIN_CHUNK_SIZE * TERRAIN_CHUNK_SIZE * TERRAIN_CHUNK_SIZE)
+
+static uint8_t* poolBricks;
+static uint8_t* chunkVoxels[CHECK_CHUNK_COUNT];
+static uint32_t failures;
+
+static void FillChunk(uint8_t* voxels);
+static void UploadChunk(TerrainVoxelPool* pool, uint32_t chunkId, uint64_t frame);
+static void CheckChunk(TerrainVoxelPool* pool, uint32_t chunkId);
+static void CheckBrickOwners(TerrainVoxelPool* pool);
+static void CheckDelayedReuse();
+static void CheckFullPool();
+static void Fail(const char* message, uint32_t value);
+
+int main(int argc, char** argv)
+{
+	uint32_t seed = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 10) : 1;
+	srand(seed);
+
+	TerrainVoxelPool pool = create_terrain_voxel_pool(CHECK_CHUNK_COUNT, CHECK_CAPACITY);
+	poolBricks = CM_CALLOC(CHECK_CAPACITY, TERRAIN_BRICK_VOXEL_COUNT);
+	for (uint32_t i = 0; i < CHECK_CHUNK_COUNT; ++i) chunkVoxels[i] = CM_CALLOC(1, CHECK_VOXEL_COUNT);
+
+	//Every round remeshes a few chunks and unloads one, frames are reclaimed two rounds late like a GPU in flight
+	for (uint32_t round = 0; round < CHECK_ROUNDS; ++round)
+	{
+		uint64_t frame = round + 1;
+		if(round >= 2) reclaim_terrain_bricks(&pool, frame - 2);
+
+		for (uint32_t i = 0; i < 4; ++i)
+		{
+			uint32_t chunkId = rand() % CHECK_CHUNK_COUNT;
+			FillChunk(chunkVoxels[chunkId]);
+			UploadChunk(&pool, chunkId, frame);
+		}
+
+		uint32_t unloadedId = rand() % CHECK_CHUNK_COUNT;
+		free_terrain_chunk_bricks(&pool, unloadedId, frame);
+		memset(chunkVoxels[unloadedId], 0, CHECK_VOXEL_COUNT);
+
+		for (uint32_t i = 0; i < CHECK_CHUNK_COUNT; ++i) CheckChunk(&pool, i);
+		CheckBrickOwners(&pool);
+	}
+
+	uint32_t usedCount = pool.usedCount, retiredCount = pool.retiredCount;
+	destroy_terrain_voxel_pool(&pool);
+	CM_FREE(poolBricks);
+	for (uint32_t i = 0; i < CHECK_CHUNK_COUNT; ++i) CM_FREE(chunkVoxels[i]);
+
+	CheckDelayedReuse();
+	CheckFullPool();
+
+	printf("%u rounds of %u chunks, %u bricks used (%u retired) of %u, %u failures\n",
+	       CHECK_ROUNDS, CHECK_CHUNK_COUNT, usedCount, retiredCount, CHECK_CAPACITY, failures);
+	return failures == 0 ? 0 : 2;
+}
+
+//A third of the bricks get a single type, air included, the others random types
+static void FillChunk(uint8_t* voxels)
+{
+	for (uint32_t y = 0; y < TERRAIN_CHUNK_SIZE; ++y)
+		for (uint32_t x = 0; x < TERRAIN_CHUNK_SIZE; ++x)
+			for (uint32_t z = 0; z < TERRAIN_CHUNK_SIZE; ++z)
+			{
+				uint32_t brickId = ((y / TERRAIN_BRICK_SIZE) * TERRAIN_BRICK_AXIS + x / TERRAIN_BRICK_SIZE) * TERRAIN_BRICK_AXIS
+				                   + z / TERRAIN_BRICK_SIZE;
+				uint8_t type = brickId % 3 == 0 ? brickId % 5 : rand() % 8;
+				voxels[(y * TERRAIN_CHUNK_SIZE + x) * TERRAIN_CHUNK_SIZE + z] = type;
+			}
+}
+
+//What terrain.c does on the main thread, the packed bricks are copied where their pages point
+static void UploadChunk(TerrainVoxelPool* pool, uint32_t chunkId, uint64_t frame)
+{
+	uint32_t pages[TERRAIN_CHUNK_BRICKS], previousPages[TERRAIN_CHUNK_BRICKS];
+	uint32_t mixedCount = classify_terrain_bricks(chunkVoxels[chunkId], pages);
+
+	uint8_t* packed = CM_MALLOC(mixedCount * TERRAIN_BRICK_VOXEL_COUNT + 1);
+	pack_terrain_bricks(chunkVoxels[chunkId], pages, packed);
+
+	if(!alloc_terrain_chunk_bricks(pool, chunkId, pages, previousPages)) Fail("pool full for chunk", chunkId);
+	retire_terrain_bricks(pool, previousPages, frame);
+
+	const uint32_t* chunkPages = get_terrain_chunk_pages(pool, chunkId);
+	uint32_t packedId = 0;
+	for (uint32_t i = 0; i < TERRAIN_CHUNK_BRICKS; ++i)
+	{
+		if(chunkPages[i] & TERRAIN_BRICK_UNIFORM) continue;
+		memcpy(poolBricks + chunkPages[i] * TERRAIN_BRICK_VOXEL_COUNT, packed + packedId++ * TERRAIN_BRICK_VOXEL_COUNT,
+		       TERRAIN_BRICK_VOXEL_COUNT);
+	}
+
+	if(packedId != mixedCount) Fail("packed brick count differs for chunk", chunkId);
+	CM_FREE(packed);
+}
+
+//Reads every voxel through the pages like voxel_terrain.frag
+static void CheckChunk(TerrainVoxelPool* pool, uint32_t chunkId)
+{
+	const uint32_t* pages = get_terrain_chunk_pages(pool, chunkId);
+	for (uint32_t y = 0; y < TERRAIN_CHUNK_SIZE; ++y)
+		for (uint32_t x = 0; x < TERRAIN_CHUNK_SIZE; ++x)
+			for (uint32_t z = 0; z < TERRAIN_CHUNK_SIZE; ++z)
+			{
+				uint32_t brickId = ((y / TERRAIN_BRICK_SIZE) * TERRAIN_BRICK_AXIS + x / TERRAIN_BRICK_SIZE) * TERRAIN_BRICK_AXIS
+				                   + z / TERRAIN_BRICK_SIZE;
+				uint32_t local = ((y % TERRAIN_BRICK_SIZE) * TERRAIN_BRICK_SIZE + x % TERRAIN_BRICK_SIZE) * TERRAIN_BRICK_SIZE
+				                 + z % TERRAIN_BRICK_SIZE;
+
+				uint32_t page = pages[brickId];
+				uint8_t type = page & TERRAIN_BRICK_UNIFORM ? (uint8_t)page : poolBricks[page * TERRAIN_BRICK_VOXEL_COUNT + local];
+				if(type != chunkVoxels[chunkId][(y * TERRAIN_CHUNK_SIZE + x) * TERRAIN_CHUNK_SIZE + z])
+				{
+					Fail("voxel read back wrong in chunk", chunkId);
+					return;
+				}
+			}
+}
+
+//A brick belongs to one chunk page or to the retired list, and the used count covers both
+static void CheckBrickOwners(TerrainVoxelPool* pool)
+{
+	uint8_t* owners = CM_CALLOC(pool->capacity, 1);
+	uint32_t ownedCount = 0;
+
+	for (uint32_t i = 0; i < pool->chunkCount * TERRAIN_CHUNK_BRICKS; ++i)
+	{
+		uint32_t page = pool->pages[i];
+		if(page & TERRAIN_BRICK_UNIFORM || page == TERRAIN_BRICK_PENDING) continue;
+		if(owners[page]++) Fail("brick used twice", page);
+		ownedCount++;
+	}
+
+	TerrainRetiredBrick* retired = pool->retired.data;
+	for (uint32_t i = 0; i < pool->retiredCount; ++i)
+	{
+		if(owners[retired[i].brick]++) Fail("retired brick still used", retired[i].brick);
+		if(i > 0 && retired[i].frame < retired[i - 1].frame) Fail("retired frames out of order at", i);
+		ownedCount++;
+	}
+
+	if(ownedCount != pool->usedCount) Fail("used count differs from the owned bricks", pool->usedCount);
+	CM_FREE(owners);
+}
+
+static void CheckDelayedReuse()
+{
+	TerrainVoxelPool pool = create_terrain_voxel_pool(2, CHECK_CAPACITY);
+	uint32_t pages[TERRAIN_CHUNK_BRICKS], previousPages[TERRAIN_CHUNK_BRICKS];
+	for (uint32_t i = 0; i < TERRAIN_CHUNK_BRICKS; ++i) pages[i] = TERRAIN_BRICK_PENDING;
+
+	alloc_terrain_chunk_bricks(&pool, 0, pages, previousPages);
+	free_terrain_chunk_bricks(&pool, 0, 5);
+
+	//Until frame 5 is done the second chunk gets the bricks after the freed ones
+	alloc_terrain_chunk_bricks(&pool, 1, pages, previousPages);
+	if(get_terrain_chunk_pages(&pool, 1)[0] != TERRAIN_CHUNK_BRICKS) Fail("brick reused before its frame, got", get_terrain_chunk_pages(&pool, 1)[0]);
+
+	reclaim_terrain_bricks(&pool, 4);
+	alloc_terrain_chunk_bricks(&pool, 0, pages, previousPages);
+	if(get_terrain_chunk_pages(&pool, 0)[0] != TERRAIN_CHUNK_BRICKS * 2) Fail("brick reused before its frame, got", get_terrain_chunk_pages(&pool, 0)[0]);
+
+	reclaim_terrain_bricks(&pool, 5);
+	alloc_terrain_chunk_bricks(&pool, 1, pages, previousPages);
+	if(get_terrain_chunk_pages(&pool, 1)[0] != 0) Fail("reclaimed brick not reused, got", get_terrain_chunk_pages(&pool, 1)[0]);
+	if(previousPages[0] != TERRAIN_CHUNK_BRICKS) Fail("previous page not returned, got", previousPages[0]);
+
+	destroy_terrain_voxel_pool(&pool);
+}
+
+//A full pool leaves the mixed pages pending and still hands back the previous ones
+static void CheckFullPool()
+{
+	TerrainVoxelPool pool = create_terrain_voxel_pool(2, TERRAIN_CHUNK_BRICKS + 1);
+	uint32_t pages[TERRAIN_CHUNK_BRICKS], previousPages[TERRAIN_CHUNK_BRICKS];
+	for (uint32_t i = 0; i < TERRAIN_CHUNK_BRICKS; ++i) pages[i] = TERRAIN_BRICK_PENDING;
+
+	if(!alloc_terrain_chunk_bricks(&pool, 0, pages, previousPages)) Fail("first chunk does not fit", 0);
+	if(alloc_terrain_chunk_bricks(&pool, 1, pages, previousPages)) Fail("second chunk fits a full pool", 1);
+	if(get_terrain_chunk_pages(&pool, 1)[0] != TERRAIN_BRICK_PENDING) Fail("page not pending, got", get_terrain_chunk_pages(&pool, 1)[0]);
+	if(pool.usedCount != TERRAIN_CHUNK_BRICKS) Fail("failed allocation took bricks", pool.usedCount);
+
+	destroy_terrain_voxel_pool(&pool);
+}
+
+static void Fail(const char* message, uint32_t value)
+{
+	if(failures++ < 16) fprintf(stderr, "%s %u\n", message, value);
+}